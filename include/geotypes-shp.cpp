@@ -211,47 +211,50 @@ _ShpBBox2(f64 XMin, f64 YMin, f64 XMax, f64 YMax)
 // Creation functions
 //=================================
 
-internal shapefile
-_InitShapefile(void* ShpPtr, void* ShxPtr, void* DbfPtr, shp_type Type)
+internal void
+_InitShpHeader(shp_header* ShpHeader, shp_type Type)
 {
-    shapefile Result = {0};
-    Result.Type = Type;
+    ShpHeader->FileCode = 0xa270000; // 9994 in BE
+    ShpHeader->FileLength = 0x32000000; // 50 in BE (number of 16-bit words for header).
+    ShpHeader->Version = 1000;
+    ShpHeader->Type = Type;
     
-    Result.ShpFilePtr = (u8*)ShpPtr;
+    f64 ZMin, ZMax, MMin, MMax;
+    switch (Type)
     {
-        shp_header* ShpHeader = (shp_header*)ShpPtr;
-        ShpHeader->FileCode = 0xa270000; // 9994 in BE
-        ShpHeader->FileLength = 0x32000000; // 50 in BE (number of 16-bit words for header).
-        ShpHeader->Version = 1000;
-        ShpHeader->Type = Type;
+        case ShpType_PointZM:
+        case ShpType_MultiPointZM:
+        case ShpType_PolylineZM:
+        case ShpType_PolygonZM:
+        case ShpType_MultiPatch:
+        {
+            ZMin = DBL_MAX; ZMax = -DBL_MAX; MMin = DBL_MAX; MMax = -DBL_MAX;
+        } break;
         
-        f64 ZMin, ZMax, MMin, MMax;
-        switch (Type)
+        case ShpType_PointM:
+        case ShpType_MultiPointM:
+        case ShpType_PolylineM:
+        case ShpType_PolygonM:
         {
-            case ShpType_PointZM:
-            case ShpType_MultiPointZM:
-            case ShpType_PolylineZM:
-            case ShpType_PolygonZM:
-            case ShpType_MultiPatch:
-            {
-                ZMin = DBL_MAX; ZMax = -DBL_MAX; MMin = DBL_MAX; MMax = -DBL_MAX;
-            } break;
-            
-            case ShpType_PointM:
-            case ShpType_MultiPointM:
-            case ShpType_PolylineM:
-            case ShpType_PolygonM:
-            {
-                ZMin = 0; ZMax = 0; MMin = DBL_MAX; MMax = -DBL_MAX;
-            } break;
-            
-            default:
-            {
-                ZMin = 0; ZMax = 0; MMin = 0; MMax = 0;
-            }
+            ZMin = 0; ZMax = 0; MMin = DBL_MAX; MMax = -DBL_MAX;
+        } break;
+        
+        default:
+        {
+            ZMin = 0; ZMax = 0; MMin = 0; MMax = 0;
         }
-        ShpHeader->BBox = { DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX, ZMin, ZMax, MMin, MMax };
     }
+    ShpHeader->BBox = { DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX, ZMin, ZMax, MMin, MMax };
+}
+
+internal shapefile
+_InitShapefile(void* ShpPtr, void* ShxPtr, void* DbfPtr, shp_type Type)
+{
+    shapefile Result = {0};
+    Result.Type = Type;
+    
+    Result.ShpFilePtr = (u8*)ShpPtr;
+    _InitShpHeader((shp_header*)ShpPtr, Type);
     Result.ShpFileSize = SHAPEFILE_HEADER_SIZE;
     
     Result.ShxFilePtr = (u8*)ShxPtr;
@@ -376,6 +379,10 @@ CreateField(shapefile* Shape, char* FieldName, u8 FieldLen, u8 Precision, shp_fi
     dbf_header* Dbf = (dbf_header*)Shape->DbfFilePtr;
     dbf_fd* FD = (dbf_fd*)(Shape->DbfFilePtr + sizeof(dbf_header)) + Shape->NumFields;
     
+    // OBS: Descriptor may hold the previous end-of-header bytes.
+    buffer FDBuffer = Buffer(FD, sizeof(dbf_fd), sizeof(dbf_fd));
+    ClearMemory(&FDBuffer);
+    
     usz FieldNameSize = strlen(FieldName);
     if (CopyData(FD->Name, 11, FieldName, FieldNameSize))
     {
@@ -440,35 +447,43 @@ ImportShp(buffer _Shp, buffer _Shx, buffer _Dbf)
     shx_header* Shx = (shx_header*)_Shx.Base;
     dbf_header* Dbf = (dbf_header*)_Dbf.Base;
     
-    i32 ShpReadSize = 2 * FlipEndian32(Shp->FileLength);
-    i32 ShxReadSize = 2 * FlipEndian32(Shx->FileLength);
-    i32 DbfReadSize = Dbf->HeaderSize + (Dbf->RecordSize * Dbf->NumRecords);
-    if (ShpReadSize > _Shp.WriteCur || ShxReadSize > _Shx.WriteCur || DbfReadSize > _Dbf.WriteCur
-        || ShpReadSize < 0 || ShxReadSize < 0 || DbfReadSize < 0)
+    if (_Shp.WriteCur < SHAPEFILE_HEADER_SIZE || _Shx.WriteCur < SHAPEFILE_HEADER_SIZE
+        || _Dbf.WriteCur < sizeof(dbf_header))
     {
         return Result;
     }
     
-    i32 ShpNumRecords = 0;
-    i32 LastFeatIdx = 0;
-    u8* RecordPtr = (u8*)Shp + SHAPEFILE_HEADER_SIZE;
-    u8* EndOfFile = (u8*)Shp + ShpReadSize;
-    while (RecordPtr < EndOfFile)
+    usz ShpReadSize = 2 * (usz)(u32)FlipEndian32(Shp->FileLength);
+    usz ShxReadSize = 2 * (usz)(u32)FlipEndian32(Shx->FileLength);
+    usz DbfReadSize = (u16)Dbf->HeaderSize + ((usz)(u16)Dbf->RecordSize * (u32)Dbf->NumRecords);
+    if (ShpReadSize > _Shp.WriteCur || ShxReadSize > _Shx.WriteCur || DbfReadSize > _Dbf.WriteCur
+        || ShpReadSize < SHAPEFILE_HEADER_SIZE || ShxReadSize < SHAPEFILE_HEADER_SIZE)
     {
-        ShpNumRecords++;
-        LastFeatIdx = ((shp_record*)RecordPtr)->RecordNumber;
-        i32 ContentLength = 2 * FlipEndian32(((shp_record*)RecordPtr)->ContentLength);
-        RecordPtr += ContentLength + sizeof(shp_record);
+        return Result;
     }
-    LastFeatIdx = FlipEndian32(LastFeatIdx);
     
-    i32 ShxNumRecords = ((i32)ShxReadSize - sizeof(shx_header)) / sizeof(shx_record);
-    i32 DbfNumRecords = Dbf->NumRecords;
-    if (ShpNumRecords != ShxNumRecords || ShpNumRecords != DbfNumRecords)
+    // OBS: The record count comes from the [.shx] size, so opening doesn't touch the
+    //      [.shp] records (which would fault in the whole file when it's mapped).
+    //      Only the last record is read, to know the next feature number.
+    usz ShxNumRecords = (ShxReadSize - SHAPEFILE_HEADER_SIZE) / sizeof(shx_record);
+    if (ShxNumRecords != (u32)Dbf->NumRecords || ShxNumRecords > I32_MAX)
     {
         return Result;
     }
     
+    i32 LastFeatIdx = 0;
+    if (ShxNumRecords > 0)
+    {
+        shx_record* LastShx = (shx_record*)(_Shx.Base + SHAPEFILE_HEADER_SIZE) + (ShxNumRecords - 1);
+        usz DataOffset = 2 * (usz)(u32)FlipEndian32(LastShx->DataOffset);
+        if (DataOffset < SHAPEFILE_HEADER_SIZE || DataOffset + sizeof(shp_record) > ShpReadSize)
+        {
+            return Result;
+        }
+        shp_record* LastShp = (shp_record*)(_Shp.Base + DataOffset);
+        LastFeatIdx = FlipEndian32(LastShp->RecordNumber);
+    }
+    
     Result.ShpFilePtr = (u8*)Shp;
     Result.ShpFileSize = ShpReadSize;
     Result.ShxFilePtr = (u8*)Shx;
@@ -477,24 +492,21 @@ ImportShp(buffer _Shp, buffer _Shx, buffer _Dbf)
     Result.DbfFileSize = DbfReadSize;
     
     Result.Type = Shp->Type;
-    Result.NumFeatures = ShpNumRecords;
+    Result.NumFeatures = (i32)ShxNumRecords;
     Result.NumFields = (Dbf->HeaderSize - sizeof(dbf_header) - 1) / sizeof(dbf_fd);
     Result.LastFeatIdx = LastFeatIdx;
     
     return Result;
 }
 
-external shapefile
-OpenAndImportShp(void* ShpPathStr)
+internal bool
+_OpenShpFiles(void* ShpPathStr, file* Files, i32 Flags, bool Create)
 {
-    shapefile Result = {0};
-    
     path ShpPath = Path(ShpPathStr);
     ShpPath.WriteCur = StringLen(ShpPath, LEN_CSTRING);
     if (ShpPath.WriteCur > 0)
     {
-        file ShpFile = OpenFileHandle(ShpPathStr, READ_SHARE);
-        usz ShpFileSize = FileSizeOf(ShpFile);
+        Files[0] = (Create) ? CreateNewFile(ShpPathStr, Flags) : OpenFileHandle(ShpPathStr, Flags);
         
         char AccompanyFiles[MAX_PATH_SIZE] = {0};
         path AccompanyPath = Path(AccompanyFiles);
@@ -503,13 +515,28 @@ OpenAndImportShp(void* ShpPathStr)
         
         AccompanyPath.WriteCur = ExtIdx;
         AppendStringToString(StringLit("shx"), &AccompanyPath);
-        file ShxFile = OpenFileHandle(AccompanyFiles, READ_SHARE);
-        usz ShxFileSize = FileSizeOf(ShxFile);
+        Files[1] = (Create) ? CreateNewFile(AccompanyFiles, Flags) : OpenFileHandle(AccompanyFiles, Flags);
         
         AccompanyPath.WriteCur = ExtIdx;
         AppendStringToString(StringLit("dbf"), &AccompanyPath);
-        file DbfFile = OpenFileHandle(AccompanyFiles, READ_SHARE);
-        usz DbfFileSize = FileSizeOf(DbfFile);
+        Files[2] = (Create) ? CreateNewFile(AccompanyFiles, Flags) : OpenFileHandle(AccompanyFiles, Flags);
+        
+        return true;
+    }
+    return false;
+}
+
+external shapefile
+OpenAndImportShp(void* ShpPathStr)
+{
+    shapefile Result = {0};
+    
+    file Files[3];
+    if (_OpenShpFiles(ShpPathStr, Files, READ_SHARE, false))
+    {
+        usz ShpFileSize = FileSizeOf(Files[0]);
+        usz ShxFileSize = FileSizeOf(Files[1]);
+        usz DbfFileSize = FileSizeOf(Files[2]);
         
         buffer Mem = {0};
         if (ShpFileSize > 0 && ShxFileSize > 0 && DbfFileSize > 0
@@ -519,18 +546,58 @@ OpenAndImportShp(void* ShpPathStr)
             buffer Shx = Buffer(Shp.Base+ShpFileSize, 0, ShxFileSize);
             buffer Dbf = Buffer(Shx.Base+ShxFileSize, 0, DbfFileSize);
             
-            if (ReadFromFile(ShpFile, &Shp, ShpFileSize, 0)
-                && ReadFromFile(ShxFile, &Shx, ShxFileSize, 0)
-                && ReadFromFile(DbfFile, &Dbf, DbfFileSize, 0))
+            if (ReadFromFile(Files[0], &Shp, ShpFileSize, 0)
+                && ReadFromFile(Files[1], &Shx, ShxFileSize, 0)
+                && ReadFromFile(Files[2], &Dbf, DbfFileSize, 0))
             {
                 Result = ImportShp(Shp, Shx, Dbf);
                 Result.InternalAlloc = 1;
             }
         }
         
-        CloseFileHandle(ShpFile);
-        CloseFileHandle(ShxFile);
-        CloseFileHandle(DbfFile);
+        CloseFileHandle(Files[0]);
+        CloseFileHandle(Files[1]);
+        CloseFileHandle(Files[2]);
+    }
+    
+    return Result;
+}
+
+external shapefile
+OpenAndMapShp(void* ShpPathStr)
+{
+    shapefile Result = {0};
+    
+    file Files[3];
+    if (_OpenShpFiles(ShpPathStr, Files, READ_SHARE, false))
+    {
+        // OBS: Copy-on-write views, so attribute edits stay in memory like with
+        // OpenAndImportShp(), and pages only get read from disk as features are touched.
+        buffer Shp = MapFileToMemory(Files[0], MEM_WRITE);
+        buffer Shx = MapFileToMemory(Files[1], MEM_WRITE);
+        buffer Dbf = MapFileToMemory(Files[2], MEM_WRITE);
+        
+        CloseFileHandle(Files[0]);
+        CloseFileHandle(Files[1]);
+        CloseFileHandle(Files[2]);
+        
+        if (Shp.Base && Shx.Base && Dbf.Base)
+        {
+            Result = ImportShp(Shp, Shx, Dbf);
+        }
+        
+        if (Result.ShpFilePtr)
+        {
+            Result.Mapping[0] = Shp;
+            Result.Mapping[1] = Shx;
+            Result.Mapping[2] = Dbf;
+        }
+        else
+        {
+            UnmapFileFromMemory(&Shp);
+            UnmapFileFromMemory(&Shx);
+            UnmapFileFromMemory(&Dbf);
+        }
     }
     
     return Result;
@@ -545,6 +612,12 @@ CloseShp(shapefile* Shape)
         buffer Mem = Buffer(Shape->ShpFilePtr, 0, MemSize);
         FreeMemory(&Mem);
     }
+    else if (Shape->Mapping[0].Base)
+    {
+        UnmapFileFromMemory(&Shape->Mapping[0]);
+        UnmapFileFromMemory(&Shape->Mapping[1]);
+        UnmapFileFromMemory(&Shape->Mapping[2]);
+    }
     buffer ShapeBuffer = Buffer(Shape, sizeof(shapefile), sizeof(shapefile));
     ClearMemory(&ShapeBuffer);
 }
@@ -596,7 +669,7 @@ GetFeature(shapefile* Shape, i32 TargetIdx)
     if (TargetIdx < Shape->NumFeatures)
     {
         shx_record* ShxRecords = (shx_record*)(Shape->ShxFilePtr + SHAPEFILE_HEADER_SIZE);
-        i32 DataOffset = 2 * FlipEndian32(ShxRecords[TargetIdx].DataOffset);
+        usz DataOffset = 2 * (usz)(u32)FlipEndian32(ShxRecords[TargetIdx].DataOffset);
         
         u8* ShpRecordPtr = Shape->ShpFilePtr + DataOffset;
         Result = _ReadRecordInfo(ShpRecordPtr);
@@ -701,6 +774,167 @@ GetGeometry(shp_feature Feat, i32 TargetIdx)
     return Result;
 }
 
+#if defined(TT_X64)
+
+internal u64
+_ParseDigits16(u8* Digits, i32 Count)
+{
+    // OBS: Digits are right-aligned over a '0' background, and folded pairwise into
+    // 2-, 4- and then 8-digit lanes.
+    u8 Buf[16] = { '0','0','0','0','0','0','0','0','0','0','0','0','0','0','0','0' };
+    CopyData(Buf + 16 - Count, Count, Digits, Count);
+    
+    __m128i Chunk = _mm_sub_epi8(_mm_loadu_si128((__m128i*)Buf), _mm_set1_epi8('0'));
+    __m128i Pairs = _mm_maddubs_epi16(Chunk, _mm_setr_epi8(10,1,10,1,10,1,10,1,10,1,10,1,10,1,10,1));
+    __m128i Quads = _mm_madd_epi16(Pairs, _mm_setr_epi16(100,1,100,1,100,1,100,1));
+    i32 Q[4];
+    _mm_storeu_si128((__m128i*)Q, Quads);
+    
+    u64 Result = ((((u64)Q[0] * 10000 + Q[1]) * 10000 + Q[2]) * 10000) + Q[3];
+    return Result;
+}
+
+internal u64
+_ParseDigits(u8* Digits, i32 Count)
+{
+    if (Count <= 16)
+    {
+        return _ParseDigits16(Digits, Count);
+    }
+    u64 Result = (_ParseDigits16(Digits, Count - 16) * 10000000000000000ULL
+                  + _ParseDigits16(Digits + Count - 16, 16));
+    return Result;
+}
+
+internal bool
+_ParseDbfNumber(u8* Data, i32 Len, i64* Mantissa, i32* Scale)
+{
+    if (Len > 32)
+    {
+        return false;
+    }
+    
+    u8 Buf[32];
+    memset(Buf, ' ', sizeof(Buf));
+    CopyData(Buf, sizeof(Buf), Data, Len);
+    
+    __m256i Chunk = _mm256_loadu_si256((__m256i*)Buf);
+    __m256i Digit = _mm256_sub_epi8(Chunk, _mm256_set1_epi8('0'));
+    u32 DigitMask = _mm256_movemask_epi8(_mm256_andnot_si256(_mm256_cmpgt_epi8(Digit, _mm256_set1_epi8(9)),
+                                                             _mm256_cmpgt_epi8(Digit, _mm256_set1_epi8(-1))));
+    u32 DotMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(Chunk, _mm256_set1_epi8('.')));
+    u32 FilledMask = ~(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Chunk, _mm256_set1_epi8(' ')));
+    if (FilledMask == 0)
+    {
+        return false;
+    }
+    
+    i32 Start = GetFirstBitSet(FilledMask);
+    i32 End = GetLastBitSet(FilledMask) + 1;
+    bool Negative = (Buf[Start] == '-');
+    Start += Negative;
+    
+    // OBS: Between the first and last non-blank there can only be digits and one dot;
+    // anything else (exponents, '*' nulls) is left to the generic parser.
+    u32 RangeMask = (u32)(((u64)1 << End) - ((u64)1 << Start));
+    if (Start >= End
+        || ((DigitMask | DotMask) & RangeMask) != RangeMask
+        || ((DotMask & RangeMask) & ((DotMask & RangeMask) - 1)) != 0)
+    {
+        return false;
+    }
+    
+    i32 Dot = (DotMask & RangeMask) ? GetFirstBitSet(DotMask & RangeMask) : End;
+    i32 IntCount = Dot - Start;
+    i32 FracCount = (Dot < End) ? End - Dot - 1 : 0;
+    if (IntCount + FracCount > 18)
+    {
+        return false;
+    }
+    
+    local const i64 Pow10[19] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+        10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+        1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+    };
+    i64 Int = (IntCount > 0) ? (i64)_ParseDigits(Buf + Start, IntCount) : 0;
+    i64 Frac = (FracCount > 0) ? (i64)_ParseDigits(Buf + Dot + 1, FracCount) : 0;
+    
+    *Mantissa = (Int * Pow10[FracCount] + Frac) * ((Negative) ? -1 : 1);
+    *Scale = FracCount;
+    return true;
+}
+
+#else
+
+internal bool
+_ParseDbfNumber(u8* Data, i32 Len, i64* Mantissa, i32* Scale)
+{
+    return false;
+}
+
+#endif //TT_X64
+
+internal string
+_TrimDbfValue(u8* Data, i32 Len)
+{
+    u8* End = Data + Len;
+    while (Data < End && *Data == ' ') Data++;
+    while (End > Data && End[-1] == ' ') End--;
+    string Result = String(Data, End - Data, 0, EC_ASCII);
+    return Result;
+}
+
+internal isz
+_DbfToInt(u8* Data, i32 Len)
+{
+    i64 Mantissa;
+    i32 Scale;
+    if (_ParseDbfNumber(Data, Len, &Mantissa, &Scale))
+    {
+        for (; Scale > 0; Scale--) Mantissa /= 10;
+        return (isz)Mantissa;
+    }
+    return StringToInt(_TrimDbfValue(Data, Len));
+}
+
+internal f64
+_DbfToReal(u8* Data, i32 Len)
+{
+    // OBS: Exponent may be present, as in "-2.975e+002" written by AddAttrReal().
+    i32 ExpIdx = 0;
+    while (ExpIdx < Len && Data[ExpIdx] != 'e' && Data[ExpIdx] != 'E') ExpIdx++;
+    
+    i64 Exponent = 0;
+    i32 ExpScale = 0;
+    bool ValidExp = true;
+    if (ExpIdx < Len)
+    {
+        u8* Exp = Data + ExpIdx + 1;
+        i32 ExpLen = Len - ExpIdx - 1;
+        if (ExpLen > 0 && *Exp == '+') { Exp++; ExpLen--; }
+        ValidExp = _ParseDbfNumber(Exp, ExpLen, &Exponent, &ExpScale) && ExpScale == 0;
+    }
+    
+    i64 Mantissa;
+    i32 Scale;
+    if (ValidExp && _ParseDbfNumber(Data, ExpIdx, &Mantissa, &Scale)
+        && Mantissa < ((i64)1 << 53) && Mantissa > -((i64)1 << 53))
+    {
+        // OBS: Exact integer scaled by an exact power of ten is correctly rounded.
+        local const f64 Pow10[23] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        i64 Pow = Exponent - Scale;
+        if (Pow >= -22 && Pow <= 22)
+        {
+            return (Pow < 0) ? (f64)Mantissa / Pow10[-Pow] : (f64)Mantissa * Pow10[Pow];
+        }
+    }
+    return StringToFloat(_TrimDbfValue(Data, Len));
+}
+
 internal shp_field
 _ReadFieldInfo(dbf_fd* FD, usz FieldOffset, u8* DbfRecord)
 {
@@ -713,16 +947,16 @@ _ReadFieldInfo(dbf_fd* FD, usz FieldOffset, u8* DbfRecord)
     }
     
     u8* Data = DbfRecord + FieldOffset + 1;
-    u8* DataEnd = Data + FD->FieldLen;
     switch (FD->Type)
     {
         case DbfField_Char:
         {
             Result.Type = ShpField_String;
             Result.String = (char*)Data;
-            for (u8* Ptr = Data; Ptr[0] != 0x20 && Ptr < DataEnd; Ptr++)
+            Result.StringSize = FD->FieldLen;
+            while (Result.StringSize > 0 && Data[Result.StringSize-1] == ' ')
             {
-                Result.StringSize++;
+                Result.StringSize--;
             }
         } break;
         
@@ -737,8 +971,7 @@ _ReadFieldInfo(dbf_fd* FD, usz FieldOffset, u8* DbfRecord)
         case DbfField_Float:
         {
             Result.Type = ShpField_Real;
-            while (*Data++ == 0x20) {}
-            Result.Real = StringToFloat(String(Data, DataEnd-Data, 0, EC_ASCII));
+            Result.Real = _DbfToReal(Data, FD->FieldLen);
         } break;
         
         case DbfField_Logical:
@@ -749,16 +982,15 @@ _ReadFieldInfo(dbf_fd* FD, usz FieldOffset, u8* DbfRecord)
         
         case DbfField_Numeric:
         {
-            while (*Data == 0x20) { Data++; }
             if (FD->Decimals > 0)
             {
                 Result.Type = ShpField_Real;
-                Result.Real = StringToFloat(String(Data, DataEnd-Data, 0, EC_ASCII));
+                Result.Real = _DbfToReal(Data, FD->FieldLen);
             }
             else
             {
                 Result.Type = ShpField_Integer;
-                Result.Integer = StringToInt(String(Data, DataEnd-Data, 0, EC_ASCII));
+                Result.Integer = _DbfToInt(Data, FD->FieldLen);
             }
         } break;
     }
@@ -778,7 +1010,7 @@ _GetFDByIdx(u8* Dbf, i32 TargetIdx)
 {
     dbf_fd* FD = (dbf_fd*)(Dbf + sizeof(dbf_header));
     usz FieldOffset = 0;
-    for (usz Count = 0; Count < TargetIdx; Count++)
+    for (i32 Count = 0; Count < TargetIdx; Count++)
     {
         FieldOffset += FD->FieldLen;
         FD++;
@@ -799,126 +1031,408 @@ GetFieldByIdx(shp_feature Feat, i32 TargetIdx)
     return Result;
 }
 
-external shp_field
-GetFieldByName(shp_feature Feat, char* TargetName)
+external i32
+GetFieldIdx(shapefile* Shape, char* TargetName)
 {
-    shp_field Result = {};
-    
-    dbf_header* Header = (dbf_header*)Feat.Shape->DbfFilePtr;
-    dbf_fd* FD = (dbf_fd*)(Feat.Shape->DbfFilePtr + sizeof(dbf_header));
-    dbf_fd* FDEnd = (dbf_fd*)(Feat.Shape->DbfFilePtr + Header->HeaderSize);
+    usz TargetNameSize = strlen(TargetName);
+    if (TargetNameSize > 11)
+    {
+        return -1;
+    }
     
-    usz TargetNameSize = sizeof(TargetName);
-    usz FieldOffset = 0;
-    while (FD < FDEnd)
+    dbf_fd* FD = (dbf_fd*)(Shape->DbfFilePtr + sizeof(dbf_header));
+    for (i32 Idx = 0; Idx < Shape->NumFields; Idx++, FD++)
     {
-        FieldOffset += FD->FieldLen;
-        
-        buffer Field = Buffer(FD->Name, 11, 0);
-        buffer Target = Buffer(TargetName, TargetNameSize, 0);
-        if (EqualBuffers(Field, Target))
+        // OBS: Names are zero-padded to 11 bytes, and not terminated when all 11 are used.
+        if (memcmp(FD->Name, TargetName, TargetNameSize) == 0
+            && (TargetNameSize == 11 || FD->Name[TargetNameSize] == 0))
         {
-            Result = _ReadFieldInfo(FD, FieldOffset, Feat.DbfRecord);
-            break;
+            return Idx;
         }
-        FD++;
     }
-    
-    return Result;
+    return -1;
 }
 
-
-//=================================
-// Write data functions
-//=================================
+external shp_field
+GetFieldByName(shp_feature Feat, char* TargetName)
+{
+    shp_field Result = {};
+    i32 FieldIdx = GetFieldIdx(Feat.Shape, TargetName);
+    if (FieldIdx >= 0)
+    {
+        Result = GetFieldByIdx(Feat, FieldIdx);
+    }
+    return Result;
+}
 
 internal void
-_SetDbfRecordToNull(u8* RecordPtr, dbf_header* Header, usz NumFields)
+_DecodeColumnValue(shp_column* Col, target_fd Field, u8* DbfRecord, i32 Idx)
 {
-    // TODO: Write function.
-    // - Numeric and Float types get set to ***
-    // - Char type gets set to 0x20
-    // - Date type gets set to 00000000
-    // - Logical type (?)
-    
-    string Record = String(RecordPtr+1, 0, Header->RecordSize, EC_ASCII);
-    dbf_fd* FD = (dbf_fd*)&Header[1];
-    for (usz Count = 0; Count < NumFields; Count++)
+    u8* Data = DbfRecord + Field.Offset + 1;
+    i32 Len = Field.FD->FieldLen;
+    switch (Col->Type)
     {
-        mb_char SetChar;
-        switch (FD->Type)
+        case ShpField_String:
         {
-            case DbfField_Date: SetChar = '0'; break;
-            case DbfField_Float:
-            case DbfField_Numeric: SetChar = '*'; break;
-            default: SetChar = ' '; break;
-        }
-        AppendCharToStringNTimes(SetChar, FD->FieldLen, &Record);
-        FD++;
+            usz Size = Len;
+            while (Size > 0 && Data[Size-1] == ' ') Size--;
+            Col->String[Idx] = (char*)Data;
+            Col->StringSize[Idx] = Size;
+        } break;
+        
+        case ShpField_Real: Col->Real[Idx] = _DbfToReal(Data, Len); break;
+        case ShpField_Integer: Col->Integer[Idx] = _DbfToInt(Data, Len); break;
+        
+        case ShpField_Boolean:
+        {
+            Col->Integer[Idx] = (*Data == 'Y' || *Data == 'y' || *Data == 'T' || *Data == 't');
+        } break;
+        
+        case ShpField_Date:
+        {
+            // OBS: YYYYMMDD text already has the value of Year*10000 + Month*100 + Day.
+            isz Date = _DbfToInt(Data, 8);
+            Col->Integer[Idx] = (Date == ISZ_MAX) ? 0 : Date;
+        } break;
     }
-    RecordPtr[0] = 0x20;
 }
 
-external shp_feature
-AddFeature(shapefile* Shape, i32 NumParts, i32 NumPoints)
+internal shp_field_type
+_GetColumnType(dbf_fd* FD)
 {
-    Shape->LastFeatIdx++;
-    Shape->NumFeatures++;
-    
-    shp_record* NextShp = (shp_record*)(Shape->ShpFilePtr + Shape->ShpFileSize);
-    NextShp->RecordNumber = FlipEndian32(Shape->LastFeatIdx);
-    
-    shx_record* NextShx = (shx_record*)(Shape->ShxFilePtr + Shape->ShxFileSize);
-    NextShx->DataOffset = FlipEndian32(Shape->ShpFileSize / 2);
-    shx_header* ShxHeader = (shx_header*)Shape->ShxFilePtr;
-    
-    Shape->ShpFileSize += sizeof(shp_record) + sizeof(shp_null);
-    Shape->ShxFileSize += sizeof(shx_record);
-    ShxHeader->FileLength = FlipEndian32(Shape->ShxFileSize / 2);
-    
-    u8* NextDbf = Shape->DbfFilePtr + Shape->DbfFileSize - 1;
-    dbf_header* DbfHeader = (dbf_header*)Shape->DbfFilePtr;
-    DbfHeader->NumRecords++;
-    _SetDbfRecordToNull(NextDbf, DbfHeader, Shape->NumFields);
-    Shape->DbfFileSize += DbfHeader->RecordSize;
-    u8* EndOfRecord = NextDbf + DbfHeader->RecordSize;
-    EndOfRecord[0] = 0x1a;
-    
-    shp_feature Result = { Shape, NumParts, NumPoints, (u8*)NextShp, (u8*)NextShx, NextDbf };
-    return Result;
+    switch (FD->Type)
+    {
+        case DbfField_Char: return ShpField_String;
+        case DbfField_Float: return ShpField_Real;
+        case DbfField_Numeric: return (FD->Decimals > 0) ? ShpField_Real : ShpField_Integer;
+        case DbfField_Logical: return ShpField_Boolean;
+        case DbfField_Date: return ShpField_Date;
+        default: break;
+    }
+    return ShpField_String;
 }
 
-external bool
-AddPoint(shp_feature* Feat, v2 Vertex, f64 Z, f64 M = DBL_MIN)
+external shp_column
+ReadColumn(shapefile* Shape, i32 FieldIdx)
 {
-    shp_header* Header = (shp_header*)Feat->Shape->ShpFilePtr;
-    if (Header->Type != ShpType_Point
-        && Header->Type != ShpType_PointM
-        && Header->Type != ShpType_PointZM)
+    shp_column Result = {0};
+    if (FieldIdx < 0 || FieldIdx >= Shape->NumFields || Shape->NumFeatures <= 0)
     {
-        return false;
+        return Result;
     }
     
-    shp_record* ShpRecord = (shp_record*)Feat->ShpRecord;
-    shp_null* Content = (shp_null*)&ShpRecord[1];
-    void* EndOfFile = NULL;
+    target_fd Field = _GetFDByIdx(Shape->DbfFilePtr, FieldIdx);
+    shp_field_type Type = _GetColumnType(Field.FD);
+    usz ValueSize = (Type == ShpField_String) ? sizeof(char*) + sizeof(usz) : sizeof(isz);
+    Result.Mem = GetMemory(ValueSize * Shape->NumFeatures, 0, MEM_READ|MEM_WRITE);
+    if (!Result.Mem.Base)
+    {
+        return Result;
+    }
     
-    switch (Header->Type)
+    Result.FieldIdx = FieldIdx;
+    Result.Type = Type;
+    switch (Type)
     {
-        case ShpType_Point:
+        case ShpField_String:
         {
-            shp_point* Point = (shp_point*)Content;
-            Point->Type = Header->Type;
-            Point->Point = Vertex;
-            EndOfFile = Point + 1;
-            
-            Header->BBox.MMin = 0;
-            Header->BBox.MMax = 0;
-            Header->BBox.ZMin = 0;
-            Header->BBox.ZMax = 0;
+            Result.String = (char**)Result.Mem.Base;
+            Result.StringSize = (usz*)(Result.String + Shape->NumFeatures);
         } break;
         
-        case ShpType_PointM:
+        case ShpField_Real: Result.Real = (f64*)Result.Mem.Base; break;
+        default: Result.Integer = (isz*)Result.Mem.Base;
+    }
+    
+    dbf_header* Header = (dbf_header*)Shape->DbfFilePtr;
+    u8* Record = Shape->DbfFilePtr + Header->HeaderSize;
+    for (i32 Idx = 0; Idx < Shape->NumFeatures; Idx++, Record += Header->RecordSize)
+    {
+        _DecodeColumnValue(&Result, Field, Record, Idx);
+    }
+    
+    return Result;
+}
+
+external void
+FreeColumn(shp_column* Column)
+{
+    if (Column->Mem.Base)
+    {
+        FreeMemory(&Column->Mem);
+    }
+    buffer ColumnBuffer = Buffer(Column, sizeof(shp_column), sizeof(shp_column));
+    ClearMemory(&ColumnBuffer);
+}
+
+struct shp_batch_job
+{
+    shapefile* Shape;
+    shp_batch* Batch;
+    target_fd* Fields;
+    bool Decode; // OBS: First pass only counts parts and points.
+};
+
+internal RANGE_PROC(_BatchJob)
+{
+    shp_batch_job* Job = (shp_batch_job*)Arg;
+    shp_batch* Batch = Job->Batch;
+    
+    for (i32 Idx = (i32)Begin; Idx < (i32)End; Idx++)
+    {
+        shp_feature Feat = GetFeature(Job->Shape, Batch->FirstFeature + Idx);
+        if (!Job->Decode)
+        {
+            Batch->FeatPart[Idx+1] = Feat.NumParts;
+            Batch->FeatPoint[Idx+1] = Feat.NumPoints;
+            continue;
+        }
+        
+        i32 PointIdx = Batch->FeatPoint[Idx];
+        for (i32 PartIdx = 0; PartIdx < Feat.NumParts; PartIdx++)
+        {
+            shp_part Part = GetGeometry(Feat, PartIdx);
+            Batch->PartPoint[Batch->FeatPart[Idx] + PartIdx] = PointIdx;
+            
+            usz Size = sizeof(f64) * Part.NumPoints;
+            CopyData(Batch->XY + PointIdx, 2 * Size, Part.XY, 2 * Size);
+            if (Batch->Z && Part.Z) CopyData(Batch->Z + PointIdx, Size, Part.Z, Size);
+            if (Batch->M && Part.M) CopyData(Batch->M + PointIdx, Size, Part.M, Size);
+            PointIdx += Part.NumPoints;
+        }
+        
+        for (i32 ColIdx = 0; ColIdx < Batch->NumColumns; ColIdx++)
+        {
+            _DecodeColumnValue(&Batch->Columns[ColIdx], Job->Fields[ColIdx], Feat.DbfRecord, Idx);
+        }
+    }
+}
+
+internal void
+_RunBatchJobs(thread_pool* Pool, shapefile* Shape, shp_batch* Batch, target_fd* Fields, bool Decode)
+{
+    shp_batch_job Job = { Shape, Batch, Fields, Decode };
+    
+    // OBS: Feature sizes vary a lot, so the batch is split in small chunks that the
+    // pool balances between workers; without a pool it all runs here.
+    if (Pool) ParallelFor(Pool, 0, Batch->NumFeatures, 0, _BatchJob, &Job);
+    else _BatchJob(0, Batch->NumFeatures, &Job);
+}
+
+external shp_batch
+ReadFeatureBatch(shapefile* Shape, i32 FirstIdx, i32 NumFeatures, i32* FieldIdx, i32 NumColumns,
+                 thread_pool* Pool)
+{
+    shp_batch Result = {0};
+    if (FirstIdx < 0 || NumFeatures <= 0 || FirstIdx + NumFeatures > Shape->NumFeatures
+        || NumColumns < 0)
+    {
+        return Result;
+    }
+    for (i32 ColIdx = 0; ColIdx < NumColumns; ColIdx++)
+    {
+        if (FieldIdx[ColIdx] < 0 || FieldIdx[ColIdx] >= Shape->NumFields) return Result;
+    }
+    // First pass: offset table with the parts and points of each feature.
+    // OBS: The field descriptors of the columns are kept after the table.
+    usz TableSize = 2 * sizeof(i32) * (NumFeatures+1);
+    Result.Mem[0] = GetMemory(TableSize + sizeof(target_fd) * NumColumns, 0, MEM_READ|MEM_WRITE);
+    if (!Result.Mem[0].Base)
+    {
+        return Result;
+    }
+    Result.FirstFeature = FirstIdx;
+    Result.NumFeatures = NumFeatures;
+    Result.FeatPart = (i32*)Result.Mem[0].Base;
+    Result.FeatPoint = Result.FeatPart + (NumFeatures+1);
+    
+    _RunBatchJobs(Pool, Shape, &Result, NULL, false);
+    
+    for (i32 Idx = 0; Idx < NumFeatures; Idx++)
+    {
+        Result.FeatPart[Idx+1] += Result.FeatPart[Idx];
+        Result.FeatPoint[Idx+1] += Result.FeatPoint[Idx];
+    }
+    Result.NumParts = Result.FeatPart[NumFeatures];
+    Result.NumPoints = Result.FeatPoint[NumFeatures];
+    
+    // Second pass: decode into the final arrays.
+    bool HasZ = false, HasM = false;
+    switch (Shape->Type)
+    {
+        case ShpType_PointZM:
+        case ShpType_MultiPointZM:
+        case ShpType_PolylineZM:
+        case ShpType_PolygonZM:
+        case ShpType_MultiPatch: HasZ = true;
+        case ShpType_PointM:
+        case ShpType_MultiPointM:
+        case ShpType_PolylineM:
+        case ShpType_PolygonM: HasM = true; break;
+        default: break;
+    }
+    
+    target_fd* Fields = (target_fd*)(Result.Mem[0].Base + TableSize);
+    usz ColumnsSize = 0;
+    for (i32 ColIdx = 0; ColIdx < NumColumns; ColIdx++)
+    {
+        Fields[ColIdx] = _GetFDByIdx(Shape->DbfFilePtr, FieldIdx[ColIdx]);
+        // OBS: Same rule as the layout below, String columns also keep their sizes.
+        bool IsString = (_GetColumnType(Fields[ColIdx].FD) == ShpField_String);
+        ColumnsSize += (IsString) ? 2 * sizeof(usz) : sizeof(usz);
+    }
+    
+    usz Size = (sizeof(i32) * (Result.NumParts+1)
+                + sizeof(v2) * Result.NumPoints
+                + ((HasZ) ? sizeof(f64) * Result.NumPoints : 0)
+                + ((HasM) ? sizeof(f64) * Result.NumPoints : 0)
+                + sizeof(shp_column) * NumColumns
+                + ColumnsSize * NumFeatures);
+    Result.Mem[1] = GetMemory(Size, 0, MEM_READ|MEM_WRITE);
+    if (!Result.Mem[1].Base)
+    {
+        FreeFeatureBatch(&Result);
+        return Result;
+    }
+    
+    // OBS: 8-byte arrays go first, so that all of them stay aligned.
+    u8* Ptr = Result.Mem[1].Base;
+    Result.XY = (v2*)Ptr;
+    Ptr += sizeof(v2) * Result.NumPoints;
+    if (HasZ) { Result.Z = (f64*)Ptr; Ptr += sizeof(f64) * Result.NumPoints; }
+    if (HasM) { Result.M = (f64*)Ptr; Ptr += sizeof(f64) * Result.NumPoints; }
+    
+    Result.NumColumns = NumColumns;
+    Result.Columns = (shp_column*)Ptr;
+    Ptr += sizeof(shp_column) * NumColumns;
+    for (i32 ColIdx = 0; ColIdx < NumColumns; ColIdx++)
+    {
+        shp_column* Col = &Result.Columns[ColIdx];
+        Col->FieldIdx = FieldIdx[ColIdx];
+        Col->Type = _GetColumnType(Fields[ColIdx].FD);
+        switch (Col->Type)
+        {
+            case ShpField_String:
+            {
+                Col->String = (char**)Ptr;
+                Ptr += sizeof(char*) * NumFeatures;
+                Col->StringSize = (usz*)Ptr;
+            } break;
+            
+            case ShpField_Real: Col->Real = (f64*)Ptr; break;
+            default: Col->Integer = (isz*)Ptr;
+        }
+        Ptr += sizeof(usz) * NumFeatures;
+    }
+    
+    Result.PartPoint = (i32*)Ptr;
+    Result.PartPoint[Result.NumParts] = Result.NumPoints;
+    _RunBatchJobs(Pool, Shape, &Result, Fields, true);
+    
+    return Result;
+}
+
+external void
+FreeFeatureBatch(shp_batch* Batch)
+{
+    if (Batch->Mem[0].Base) FreeMemory(&Batch->Mem[0]);
+    if (Batch->Mem[1].Base) FreeMemory(&Batch->Mem[1]);
+    buffer BatchBuffer = Buffer(Batch, sizeof(shp_batch), sizeof(shp_batch));
+    ClearMemory(&BatchBuffer);
+}
+
+
+//=================================
+// Write data functions
+//=================================
+
+internal void
+_SetDbfRecordToNull(u8* RecordPtr, dbf_header* Header, usz NumFields)
+{
+    // TODO: Write function.
+    // - Numeric and Float types get set to ***
+    // - Char type gets set to 0x20
+    // - Date type gets set to 00000000
+    // - Logical type (?)
+    
+    string Record = String(RecordPtr+1, 0, Header->RecordSize, EC_ASCII);
+    dbf_fd* FD = (dbf_fd*)&Header[1];
+    for (usz Count = 0; Count < NumFields; Count++)
+    {
+        mb_char SetChar;
+        switch (FD->Type)
+        {
+            case DbfField_Date: SetChar = '0'; break;
+            case DbfField_Float:
+            case DbfField_Numeric: SetChar = '*'; break;
+            default: SetChar = ' '; break;
+        }
+        AppendCharToStringNTimes(SetChar, FD->FieldLen, &Record);
+        FD++;
+    }
+    RecordPtr[0] = 0x20;
+}
+
+external shp_feature
+AddFeature(shapefile* Shape, i32 NumParts, i32 NumPoints)
+{
+    Shape->LastFeatIdx++;
+    Shape->NumFeatures++;
+    
+    shp_record* NextShp = (shp_record*)(Shape->ShpFilePtr + Shape->ShpFileSize);
+    NextShp->RecordNumber = FlipEndian32(Shape->LastFeatIdx);
+    
+    shx_record* NextShx = (shx_record*)(Shape->ShxFilePtr + Shape->ShxFileSize);
+    NextShx->DataOffset = FlipEndian32(Shape->ShpFileSize / 2);
+    shx_header* ShxHeader = (shx_header*)Shape->ShxFilePtr;
+    
+    Shape->ShpFileSize += sizeof(shp_record) + sizeof(shp_null);
+    Shape->ShxFileSize += sizeof(shx_record);
+    ShxHeader->FileLength = FlipEndian32(Shape->ShxFileSize / 2);
+    
+    u8* NextDbf = Shape->DbfFilePtr + Shape->DbfFileSize - 1;
+    dbf_header* DbfHeader = (dbf_header*)Shape->DbfFilePtr;
+    DbfHeader->NumRecords++;
+    _SetDbfRecordToNull(NextDbf, DbfHeader, Shape->NumFields);
+    Shape->DbfFileSize += DbfHeader->RecordSize;
+    u8* EndOfRecord = NextDbf + DbfHeader->RecordSize;
+    EndOfRecord[0] = 0x1a;
+    
+    shp_feature Result = { Shape, NumParts, NumPoints, (u8*)NextShp, (u8*)NextShx, NextDbf };
+    return Result;
+}
+
+external bool
+AddPoint(shp_feature* Feat, v2 Vertex, f64 Z, f64 M = DBL_MIN)
+{
+    shp_header* Header = (shp_header*)Feat->Shape->ShpFilePtr;
+    if (Header->Type != ShpType_Point
+        && Header->Type != ShpType_PointM
+        && Header->Type != ShpType_PointZM)
+    {
+        return false;
+    }
+    
+    shp_record* ShpRecord = (shp_record*)Feat->ShpRecord;
+    shp_null* Content = (shp_null*)&ShpRecord[1];
+    void* EndOfFile = NULL;
+    
+    switch (Header->Type)
+    {
+        case ShpType_Point:
+        {
+            shp_point* Point = (shp_point*)Content;
+            Point->Type = Header->Type;
+            Point->Point = Vertex;
+            EndOfFile = Point + 1;
+            
+            Header->BBox.MMin = 0;
+            Header->BBox.MMax = 0;
+            Header->BBox.ZMin = 0;
+            Header->BBox.ZMax = 0;
+        } break;
+        
+        case ShpType_PointM:
         {
             shp_point_m* Point = (shp_point_m*)Content;
             Point->Type = Header->Type;
@@ -955,7 +1469,7 @@ AddPoint(shp_feature* Feat, v2 Vertex, f64 Z, f64 M = DBL_MIN)
         return false;
     }
     
-    Feat->Shape->ShpFileSize = (i32)FileSize;
+    Feat->Shape->ShpFileSize = FileSize;
     isz ContentLength = ((isz)EndOfFile - (isz)Content) / 2;
     ShpRecord->ContentLength = FlipEndian32(ContentLength);
     Header->FileLength = FlipEndian32(FileLength);
@@ -1073,7 +1587,7 @@ AddPoints(shp_feature* Feat, i32 NumPoints, v2* Vertex, f64* Z, f64* M, i32 Offs
         return false;
     }
     
-    Feat->Shape->ShpFileSize = (i32)FileSize;
+    Feat->Shape->ShpFileSize = FileSize;
     isz ContentLength = ((isz)EndOfFile - (isz)MultiPoint) / 2;
     ShpRecord->ContentLength = FlipEndian32(ContentLength);
     Header->FileLength = FlipEndian32(FileLength);
@@ -1169,7 +1683,7 @@ AddLinestring(shp_feature* Feat, i32 NumPoints, v2* Vertex, f64* Z, f64* M, i32
         return false;
     }
     
-    Feat->Shape->ShpFileSize = (i32)FileSize;
+    Feat->Shape->ShpFileSize = FileSize;
     isz ContentLength = ((isz)EndOfFile - (isz)Polyline) / 2;
     ShpRecord->ContentLength = FlipEndian32(ContentLength);
     Header->FileLength = FlipEndian32(FileLength);
@@ -1294,7 +1808,7 @@ AddRing(shp_feature* Feat, shp_ring_type RingType, i32 NumPoints, v2* Vertex, f6
         return false;
     }
     
-    Feat->Shape->ShpFileSize = (i32)FileSize;
+    Feat->Shape->ShpFileSize = FileSize;
     isz ContentLength = ((isz)EndOfFile - (isz)Polygon) / 2;
     ShpRecord->ContentLength = FlipEndian32(ContentLength);
     Header->FileLength = FlipEndian32(FileLength);
@@ -1317,6 +1831,92 @@ AddRing(shp_feature* Feat, shp_ring_type RingType, i32 NumPoints, v2* Vertex, f6
     return true;
 }
 
+external bool
+AddPolygon(shp_feature* Feat, i32 NumRings, shp_ring* Rings, bbox2 BBox)
+{
+    shp_header* Header = (shp_header*)Feat->Shape->ShpFilePtr;
+    shp_record* ShpRecord = (shp_record*)Feat->ShpRecord;
+    shp_multipart* Polygon = (shp_multipart*)&ShpRecord[1];
+    if (Header->Type != ShpType_Polygon
+        || NumRings != Feat->NumParts
+        || Polygon->NumParts > 0)
+    {
+        return false;
+    }
+    
+    // OBS: The record is laid out for exactly [Feat->NumParts] and [Feat->NumPoints],
+    // so rings that don't fill it would leave a record with gaps.
+    i32 TotalPoints = 0;
+    for (i32 RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        if (Rings[RingIdx].NumPoints < 0
+            || Rings[RingIdx].NumPoints > (Feat->NumPoints - TotalPoints))
+        {
+            return false;
+        }
+        TotalPoints += Rings[RingIdx].NumPoints;
+    }
+    if (TotalPoints != Feat->NumPoints)
+    {
+        return false;
+    }
+    
+    i32* Parts = (i32*)&Polygon[1];
+    v2* Points = (v2*)(Parts + Feat->NumParts);
+    i32 NumPoints = 0;
+    for (i32 RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        shp_ring* Ring = &Rings[RingIdx];
+        Parts[RingIdx] = NumPoints;
+        v2* WritePtr = Points + NumPoints;
+        if (!Ring->Reverse)
+        {
+            CopyData(WritePtr, sizeof(v2) * Ring->NumPoints,
+                     Ring->Vertices, sizeof(v2) * Ring->NumPoints);
+        }
+        else
+        {
+            v2* ReadPtr = Ring->Vertices + Ring->NumPoints;
+            for (i32 Count = 0; Count < Ring->NumPoints; Count++)
+            {
+                *WritePtr++ = *--ReadPtr;
+            }
+        }
+        NumPoints += Ring->NumPoints;
+    }
+    
+    void* EndOfFile = Points + NumPoints;
+    usz FileSize = (usz)EndOfFile - (usz)Header;
+    usz FileLength = FileSize / 2;
+    if (FileLength > I32_MAX)
+    {
+        return false;
+    }
+    
+    Feat->Shape->ShpFileSize = FileSize;
+    isz ContentLength = ((isz)EndOfFile - (isz)Polygon) / 2;
+    ShpRecord->ContentLength = FlipEndian32(ContentLength);
+    Header->FileLength = FlipEndian32(FileLength);
+    
+    shx_record* ShxRecord = (shx_record*)Feat->ShxRecord;
+    ShxRecord->ContentLength = ShpRecord->ContentLength;
+    
+    Polygon->Type = Header->Type;
+    Polygon->BBox = { BBox.Min.X, BBox.Min.Y, BBox.Max.X, BBox.Max.Y };
+    Polygon->NumParts = NumRings;
+    Polygon->NumPoints = NumPoints;
+    
+    Header->BBox.XMin = Min(Header->BBox.XMin, BBox.Min.X);
+    Header->BBox.YMin = Min(Header->BBox.YMin, BBox.Min.Y);
+    Header->BBox.XMax = Max(Header->BBox.XMax, BBox.Max.X);
+    Header->BBox.YMax = Max(Header->BBox.YMax, BBox.Max.Y);
+    
+    shx_header* ShxHeader = (shx_header*)Feat->Shape->ShxFilePtr;
+    ShxHeader->BBox = Header->BBox;
+    
+    return true;
+}
+
 external bool
 AddPatch(shp_feature* Feat, shp_patch_type Type, i32 NumPoints, v2* Vertex, f64* Z, f64* M, i32 Offset)
 {
@@ -1387,7 +1987,7 @@ AddPatch(shp_feature* Feat, shp_patch_type Type, i32 NumPoints, v2* Vertex, f64*
         return false;
     }
     
-    Feat->Shape->ShpFileSize = (i32)FileSize;
+    Feat->Shape->ShpFileSize = FileSize;
     isz ContentLength = ((isz)EndOfFile - (isz)Multipatch) / 2;
     ShpRecord->ContentLength = FlipEndian32(ContentLength);
     Header->FileLength = FlipEndian32(FileLength);
@@ -1417,7 +2017,7 @@ AddAttrString(shp_feature* Feat, char* String, usz StringSize, i32 FieldIdx)
     if (Field.FD->Type == DbfField_Char)
     {
         u8* WritePtr = Feat->DbfRecord + 1 + Field.Offset;
-        if (StringSize == -1) StringSize = strlen(String);
+        if (StringSize == (usz)-1) StringSize = strlen(String);
         return CopyData(WritePtr, Field.FD->FieldLen, String, StringSize);
     }
     return false;
@@ -1522,3 +2122,1176 @@ AddAttrDate(shp_feature* Feat, usz Year, usz Month, usz Day, i32 FieldIdx)
     }
     return false;
 }
+
+//=================================
+// Spatial index functions
+//=================================
+
+#define SHP_INDEX_MAGIC 0x58525448 // "HTRX" in LE.
+#define SHP_INDEX_VERSION 2
+
+struct shp_index_header
+{
+    u32 Magic;
+    u16 Version;
+    u16 NodeSize;
+    u64 ShpFileSize;
+    i32 NumFeatures;
+    i32 NumNodes;
+    i32 NumLevels;
+    i32 LevelEnd[SHP_INDEX_MAX_LEVELS];
+};
+
+internal bbox2
+_GetRecordBBox(u8* Record)
+{
+    bbox2 Result = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+    shp_null* Content = (shp_null*)&((shp_record*)Record)[1];
+    switch (Content->Type)
+    {
+        case ShpType_Null: break;
+        
+        case ShpType_Point:
+        case ShpType_PointM:
+        case ShpType_PointZM:
+        {
+            v2 Point = ((shp_point*)Content)->Point;
+            Result = BBox2(Point, Point);
+        } break;
+        
+        default:
+        {
+            // OBS: Multipoint and multipart records share the same bbox position.
+            shp_bbox2 Box = ((shp_multipart*)Content)->BBox;
+            Result = BBox2(Box.XMin, Box.YMin, Box.XMax, Box.YMax);
+        }
+    }
+    return Result;
+}
+
+internal u32
+_HilbertIdx(u32 X, u32 Y)
+{
+    // OBS: X and Y in a 2^16 x 2^16 grid.
+    u32 Result = 0;
+    for (u32 S = 1 << 15; S > 0; S >>= 1)
+    {
+        u32 RX = (X & S) > 0;
+        u32 RY = (Y & S) > 0;
+        Result += S * S * ((3 * RX) ^ RY);
+        if (RY == 0)
+        {
+            if (RX == 1)
+            {
+                X = 0xffff - X;
+                Y = 0xffff - Y;
+            }
+            u32 Temp = X; X = Y; Y = Temp;
+        }
+    }
+    return Result;
+}
+
+internal void
+_SortByKey(u32* Keys, i32* Ids, u32* TempKeys, i32* TempIds, i32 Count)
+{
+    // OBS: LSD radix sort, 8 bits at a time; after 4 passes data is back in [Keys].
+    for (u32 Shift = 0; Shift < 32; Shift += 8)
+    {
+        i32 Offsets[256] = {0};
+        for (i32 Idx = 0; Idx < Count; Idx++) Offsets[(Keys[Idx] >> Shift) & 0xff]++;
+        for (i32 Idx = 0, Sum = 0; Idx < 256; Idx++)
+        {
+            i32 Num = Offsets[Idx];
+            Offsets[Idx] = Sum;
+            Sum += Num;
+        }
+        for (i32 Idx = 0; Idx < Count; Idx++)
+        {
+            i32 Dst = Offsets[(Keys[Idx] >> Shift) & 0xff]++;
+            TempKeys[Dst] = Keys[Idx];
+            TempIds[Dst] = Ids[Idx];
+        }
+        u32* SwapKeys = Keys; Keys = TempKeys; TempKeys = SwapKeys;
+        i32* SwapIds = Ids; Ids = TempIds; TempIds = SwapIds;
+    }
+}
+
+internal void
+_SetIndexPointers(shp_index* Index)
+{
+    shp_index_header* Header = (shp_index_header*)Index->Mem.Base;
+    Index->NumFeatures = Header->NumFeatures;
+    Index->NumNodes = Header->NumNodes;
+    Index->NumLevels = Header->NumLevels;
+    Index->LevelEnd = Header->LevelEnd;
+    Index->Boxes = (bbox2*)&Header[1];
+    Index->Indices = (i32*)(Index->Boxes + Header->NumNodes);
+}
+
+external shp_index
+BuildShpIndex(shapefile* Shape)
+{
+    shp_index Result = {0};
+    if (Shape->NumFeatures <= 0)
+    {
+        return Result;
+    }
+    
+    i32 LevelEnd[SHP_INDEX_MAX_LEVELS] = {0};
+    i32 NumLevels = 1;
+    i32 NumNodes = LevelEnd[0] = Shape->NumFeatures;
+    for (i32 Count = NumNodes; Count > 1 && NumLevels < SHP_INDEX_MAX_LEVELS; NumLevels++)
+    {
+        Count = (Count + SHP_INDEX_NODE_SIZE - 1) / SHP_INDEX_NODE_SIZE;
+        NumNodes += Count;
+        LevelEnd[NumLevels] = NumNodes;
+    }
+    
+    usz IndexSize = sizeof(shp_index_header) + ((sizeof(bbox2) + sizeof(i32)) * NumNodes);
+    usz SortSize = 2 * (sizeof(u32) + sizeof(i32)) * Shape->NumFeatures;
+    buffer SortMem = GetMemory(SortSize, 0, MEM_READ|MEM_WRITE);
+    Result.Mem = GetMemory(IndexSize, 0, MEM_READ|MEM_WRITE);
+    if (!SortMem.Base || !Result.Mem.Base)
+    {
+        if (SortMem.Base) FreeMemory(&SortMem);
+        if (Result.Mem.Base) FreeMemory(&Result.Mem);
+        return Result;
+    }
+    Result.Mem.WriteCur = IndexSize;
+    
+    shp_index_header* Header = (shp_index_header*)Result.Mem.Base;
+    Header->Magic = SHP_INDEX_MAGIC;
+    Header->Version = SHP_INDEX_VERSION;
+    Header->NodeSize = SHP_INDEX_NODE_SIZE;
+    Header->NumFeatures = Shape->NumFeatures;
+    Header->NumNodes = NumNodes;
+    Header->NumLevels = NumLevels;
+    Header->ShpFileSize = Shape->ShpFileSize;
+    CopyData(Header->LevelEnd, sizeof(LevelEnd), LevelEnd, sizeof(LevelEnd));
+    _SetIndexPointers(&Result);
+    
+    // OBS: Leaves hold the unsorted feature bboxes until the Hilbert keys are computed.
+    bbox2* FeatBoxes = Result.Boxes;
+    bbox2 Extent = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+    for (i32 Idx = 0; Idx < Shape->NumFeatures; Idx++)
+    {
+        FeatBoxes[Idx] = _GetRecordBBox(GetFeature(Shape, Idx).ShpRecord);
+        if (FeatBoxes[Idx].Min.X <= FeatBoxes[Idx].Max.X)
+        {
+            Extent = Merge(Extent, FeatBoxes[Idx]);
+        }
+    }
+    
+    u32* Keys = (u32*)SortMem.Base;
+    u32* TempKeys = Keys + Shape->NumFeatures;
+    i32* Ids = (i32*)(TempKeys + Shape->NumFeatures);
+    i32* TempIds = Ids + Shape->NumFeatures;
+    f64 ScaleX = (Extent.Max.X > Extent.Min.X) ? 0xffff / (Extent.Max.X - Extent.Min.X) : 0;
+    f64 ScaleY = (Extent.Max.Y > Extent.Min.Y) ? 0xffff / (Extent.Max.Y - Extent.Min.Y) : 0;
+    for (i32 Idx = 0; Idx < Shape->NumFeatures; Idx++)
+    {
+        bbox2 Box = FeatBoxes[Idx];
+        Ids[Idx] = Idx;
+        if (Box.Min.X > Box.Max.X)
+        {
+            Keys[Idx] = U32_MAX; // OBS: Null shapes go last, and never match a query.
+            continue;
+        }
+        u32 X = (u32)(ScaleX * (0.5 * (Box.Min.X + Box.Max.X) - Extent.Min.X));
+        u32 Y = (u32)(ScaleY * (0.5 * (Box.Min.Y + Box.Max.Y) - Extent.Min.Y));
+        Keys[Idx] = _HilbertIdx(Min(X, 0xffff), Min(Y, 0xffff));
+    }
+    _SortByKey(Keys, Ids, TempKeys, TempIds, Shape->NumFeatures);
+    
+    for (i32 Idx = 0; Idx < Shape->NumFeatures; Idx++)
+    {
+        Result.Indices[Idx] = Ids[Idx];
+    }
+    for (i32 Idx = 0; Idx < Shape->NumFeatures; Idx++)
+    {
+        Result.Boxes[Idx] = _GetRecordBBox(GetFeature(Shape, Ids[Idx]).ShpRecord);
+    }
+    FreeMemory(&SortMem);
+    
+    for (i32 Level = 1, Child = 0; Level < NumLevels; Level++)
+    {
+        for (i32 Node = LevelEnd[Level-1]; Node < LevelEnd[Level]; Node++)
+        {
+            i32 ChildEnd = Min(Child + SHP_INDEX_NODE_SIZE, LevelEnd[Level-1]);
+            bbox2 Box = Result.Boxes[Child];
+            for (i32 Idx = Child+1; Idx < ChildEnd; Idx++)
+            {
+                Box = Merge(Box, Result.Boxes[Idx]);
+            }
+            Result.Boxes[Node] = Box;
+            Result.Indices[Node] = Child;
+            Child = ChildEnd;
+        }
+    }
+    
+    return Result;
+}
+
+external bool
+SaveShpIndex(shp_index* Index, shapefile* Shape, void* IndexFilePath)
+{
+    if (!Index->Mem.Base || Index->NumFeatures != Shape->NumFeatures)
+    {
+        return false;
+    }
+    
+    file File = CreateNewFile(IndexFilePath, WRITE_SOLO|FORCE_CREATE);
+    if (File == INVALID_FILE)
+    {
+        return false;
+    }
+    
+    // OBS: Mapped indices may come from an older [.shp] size; header is refreshed here.
+    shp_index_header Header = *(shp_index_header*)Index->Mem.Base;
+    Header.ShpFileSize = Shape->ShpFileSize;
+    
+    usz BodySize = Index->Mem.WriteCur - sizeof(shp_index_header);
+    bool Result = (WriteToFile(File, Buffer(&Header, sizeof(Header), sizeof(Header)), 0)
+                   && WriteToFile(File, Buffer(Index->Boxes, BodySize, BodySize), sizeof(Header)));
+    CloseFileHandle(File);
+    
+    return Result;
+}
+
+internal bool
+_ValidIndexLevels(shp_index_header* Header)
+{
+    // OBS: The levels come from a file, and QueryShpIndex() trusts them as array bounds.
+    // Each level must end past the previous one and within the nodes, and inner nodes
+    // must point to a child inside the level below.
+    if (Header->NumFeatures <= 0 || Header->LevelEnd[0] != Header->NumFeatures)
+    {
+        return false;
+    }
+    for (i32 Level = 1; Level < Header->NumLevels; Level++)
+    {
+        if (Header->LevelEnd[Level] <= Header->LevelEnd[Level-1]
+            || Header->LevelEnd[Level] > Header->NumNodes)
+        {
+            return false;
+        }
+    }
+    
+    i32* Indices = (i32*)((bbox2*)&Header[1] + Header->NumNodes);
+    for (i32 Level = 1; Level < Header->NumLevels; Level++)
+    {
+        i32 ChildFirst = (Level > 1) ? Header->LevelEnd[Level-2] : 0;
+        for (i32 Node = Header->LevelEnd[Level-1]; Node < Header->LevelEnd[Level]; Node++)
+        {
+            if (Indices[Node] < ChildFirst || Indices[Node] >= Header->LevelEnd[Level-1])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+external shp_index
+OpenShpIndex(shapefile* Shape, void* IndexFilePath)
+{
+    shp_index Result = {0};
+    
+    file File = OpenFileHandle(IndexFilePath, READ_SHARE);
+    if (File == INVALID_FILE)
+    {
+        return Result;
+    }
+    buffer Mem = MapFileToMemory(File, MEM_READ);
+    CloseFileHandle(File);
+    
+    shp_index_header* Header = (shp_index_header*)Mem.Base;
+    if (Mem.Base && Mem.WriteCur >= sizeof(shp_index_header)
+        && Header->Magic == SHP_INDEX_MAGIC
+        && Header->Version == SHP_INDEX_VERSION
+        && Header->NodeSize == SHP_INDEX_NODE_SIZE
+        && Header->NumFeatures == Shape->NumFeatures
+        && Header->ShpFileSize == Shape->ShpFileSize
+        && Header->NumLevels > 0 && Header->NumLevels <= SHP_INDEX_MAX_LEVELS
+        && Header->LevelEnd[Header->NumLevels-1] == Header->NumNodes
+        && Mem.WriteCur == sizeof(shp_index_header) + ((sizeof(bbox2) + sizeof(i32)) * Header->NumNodes)
+        && _ValidIndexLevels(Header))
+    {
+        Result.Mem = Mem;
+        Result.Mapped = true;
+        _SetIndexPointers(&Result);
+    }
+    else if (Mem.Base)
+    {
+        UnmapFileFromMemory(&Mem);
+    }
+    
+    return Result;
+}
+
+external i32
+QueryShpIndex(shp_index* Index, bbox2 Box, i32* Dst, i32 DstCount)
+{
+    i32 Result = 0;
+    if (Index->NumNodes <= 0)
+    {
+        return Result;
+    }
+    
+    // OBS: Each entry is the first node of a group of siblings, and their level. Depth
+    // first, so at most one group per child of each level is waiting.
+    struct { i32 First, Level; } Stack[SHP_INDEX_MAX_LEVELS * SHP_INDEX_NODE_SIZE];
+    i32 StackCount = 0;
+    Stack[StackCount].First = Index->NumNodes - 1;
+    Stack[StackCount++].Level = Index->NumLevels - 1;
+    
+    while (StackCount > 0)
+    {
+        StackCount--;
+        i32 First = Stack[StackCount].First;
+        i32 Level = Stack[StackCount].Level;
+        i32 End = Min(First + SHP_INDEX_NODE_SIZE, Index->LevelEnd[Level]);
+        for (i32 Node = First; Node < End; Node++)
+        {
+            if (!Intersects(Index->Boxes[Node], Box))
+            {
+                continue;
+            }
+            
+            if (Level == 0)
+            {
+                if (Dst && Result < DstCount) Dst[Result] = Index->Indices[Node];
+                Result++;
+            }
+            else
+            {
+                Stack[StackCount].First = Index->Indices[Node];
+                Stack[StackCount++].Level = Level - 1;
+            }
+        }
+    }
+    
+    return Result;
+}
+
+external void
+CloseShpIndex(shp_index* Index)
+{
+    if (Index->Mapped)
+    {
+        UnmapFileFromMemory(&Index->Mem);
+    }
+    else if (Index->Mem.Base)
+    {
+        FreeMemory(&Index->Mem);
+    }
+    buffer IndexBuffer = Buffer(Index, sizeof(shp_index), sizeof(shp_index));
+    ClearMemory(&IndexBuffer);
+}
+
+//=================================
+// Streaming write functions
+//=================================
+
+internal usz
+_MaxRecordSize(i32 NumParts, i32 NumPoints)
+{
+    // OBS: Upper bound for any shape type, as if Z and M blocks and multipatch part
+    // types were all present.
+    usz Result = (sizeof(shp_record) + sizeof(shp_multipart) + sizeof(shp_point_zm)
+                  + sizeof(shp_z_block) + sizeof(shp_m_block)
+                  + ((usz)NumParts * 2 * sizeof(i32))
+                  + ((usz)NumPoints * (sizeof(v2) + 2 * sizeof(f64))));
+    return Result;
+}
+
+internal bool
+_WriterWrite(shp_writer* Writer, i32 FileIdx, void* Src, usz Size, usz Pos)
+{
+    if (Size == 0)
+    {
+        return true;
+    }
+    
+    if (Writer->Async)
+    {
+        // OBS: Files opened with ASYNC_FILE can't be mixed with regular writes. The write
+        // takes the slot of the current window, and only waits if that slot is still busy.
+        i32 Current = Writer->CurrentWindow;
+        async* Io = &Writer->Io[Current][FileIdx];
+        usz Pending = Writer->PendingSize[Current][FileIdx];
+        Writer->PendingSize[Current][FileIdx] = 0;
+        if (Pending > 0 && WaitOnIoCompletion(Writer->Files[FileIdx], Io, true) != Pending)
+        {
+            return false;
+        }
+        if (!WriteFileAsync(Writer->Files[FileIdx], Src, Size, Pos, Io))
+        {
+            return false;
+        }
+        Writer->PendingSize[Current][FileIdx] = Size;
+        return true;
+    }
+    return WriteToFile(Writer->Files[FileIdx], Buffer(Src, Size, Size), Pos);
+}
+
+internal void
+_WaitWindow(shp_writer* Writer, i32 WindowIdx)
+{
+    for (i32 FileIdx = 0; FileIdx < 3; FileIdx++)
+    {
+        usz Size = Writer->PendingSize[WindowIdx][FileIdx];
+        if (Size > 0
+            && WaitOnIoCompletion(Writer->Files[FileIdx], &Writer->Io[WindowIdx][FileIdx], true) != Size)
+        {
+            Writer->Failed = true;
+        }
+        Writer->PendingSize[WindowIdx][FileIdx] = 0;
+    }
+}
+
+internal void
+_SetWindow(shp_writer* Writer, i32 WindowIdx)
+{
+    shapefile* Shape = &Writer->Shape;
+    u8* Base = Writer->Windows[WindowIdx].Base;
+    u8* Shp = Base;
+    u8* Shx = Base + Writer->WindowSize;
+    u8* Dbf = Base + 2 * Writer->WindowSize;
+    
+    if (Shp != Shape->ShpFilePtr)
+    {
+        usz DbfHeaderSize = ((dbf_header*)Shape->DbfFilePtr)->HeaderSize;
+        CopyData(Shp, SHAPEFILE_HEADER_SIZE, Shape->ShpFilePtr, SHAPEFILE_HEADER_SIZE);
+        CopyData(Shx, SHAPEFILE_HEADER_SIZE, Shape->ShxFilePtr, SHAPEFILE_HEADER_SIZE);
+        CopyData(Dbf, DbfHeaderSize, Shape->DbfFilePtr, DbfHeaderSize);
+    }
+    
+    Shape->ShpFilePtr = Shp;
+    Shape->ShxFilePtr = Shx;
+    Shape->DbfFilePtr = Dbf;
+    Writer->CurrentWindow = WindowIdx;
+}
+
+internal void
+_FlushWriter(shp_writer* Writer)
+{
+    shapefile* Shape = &Writer->Shape;
+    usz DbfHeaderSize = ((dbf_header*)Shape->DbfFilePtr)->HeaderSize;
+    
+    usz Size[3];
+    Size[0] = Shape->ShpFileSize - SHAPEFILE_HEADER_SIZE;
+    Size[1] = Shape->ShxFileSize - SHAPEFILE_HEADER_SIZE;
+    Size[2] = Shape->DbfFileSize - DbfHeaderSize - 1; // OBS: Minus end-of-file marker.
+    if (Size[1] == 0 || Writer->Failed)
+    {
+        return;
+    }
+    
+    if ((SHAPEFILE_HEADER_SIZE + Writer->ShpFlushed + Size[0]) / 2 > I32_MAX)
+    {
+        Writer->Failed = true;
+        return;
+    }
+    
+    // OBS: SHX offsets were written relative to the window, so they are moved to where
+    // the window lands in the file.
+    shx_record* ShxRecord = (shx_record*)(Shape->ShxFilePtr + SHAPEFILE_HEADER_SIZE);
+    for (usz Idx = 0; Idx < Size[1] / sizeof(shx_record); Idx++)
+    {
+        _AddInBE(&ShxRecord[Idx].DataOffset, (i32)(Writer->ShpFlushed / 2));
+    }
+    
+    u8* Src[3] = {
+        Shape->ShpFilePtr + SHAPEFILE_HEADER_SIZE,
+        Shape->ShxFilePtr + SHAPEFILE_HEADER_SIZE,
+        Shape->DbfFilePtr + DbfHeaderSize
+    };
+    usz Pos[3] = {
+        SHAPEFILE_HEADER_SIZE + Writer->ShpFlushed,
+        SHAPEFILE_HEADER_SIZE + Writer->ShxFlushed,
+        DbfHeaderSize + Writer->DbfFlushed
+    };
+    
+    if (Writer->Async)
+    {
+        // OBS: The three writes go to the kernel in a single submission.
+        i32 Current = Writer->CurrentWindow;
+        BeginIoBatch();
+        for (i32 FileIdx = 0; FileIdx < 3; FileIdx++)
+        {
+            if (Size[FileIdx] == 0) continue;
+            if (WriteFileAsync(Writer->Files[FileIdx], Src[FileIdx], Size[FileIdx], Pos[FileIdx],
+                               &Writer->Io[Current][FileIdx]))
+            {
+                Writer->PendingSize[Current][FileIdx] = Size[FileIdx];
+            }
+            else
+            {
+                Writer->Failed = true;
+            }
+        }
+        if (!SubmitIoBatch()) Writer->Failed = true;
+        
+        // OBS: Next features are built on the other window while this one is written.
+        i32 Next = Current ^ 1;
+        _WaitWindow(Writer, Next);
+        _SetWindow(Writer, Next);
+    }
+    else
+    {
+        for (i32 FileIdx = 0; FileIdx < 3; FileIdx++)
+        {
+            if (!_WriterWrite(Writer, FileIdx, Src[FileIdx], Size[FileIdx], Pos[FileIdx]))
+            {
+                Writer->Failed = true;
+            }
+        }
+    }
+    
+    Writer->ShpFlushed += Size[0];
+    Writer->ShxFlushed += Size[1];
+    Writer->DbfFlushed += Size[2];
+    
+    Shape->ShpFileSize = SHAPEFILE_HEADER_SIZE;
+    Shape->ShxFileSize = SHAPEFILE_HEADER_SIZE;
+    Shape->DbfFileSize = DbfHeaderSize + 1;
+    Shape->DbfFilePtr[DbfHeaderSize] = 0x1a;
+}
+
+internal void
+_FlushShp(shp_writer* Writer)
+{
+    shapefile* Shape = &Writer->Shape;
+    usz Size = Shape->ShpFileSize - SHAPEFILE_HEADER_SIZE;
+    if (Size == 0)
+    {
+        return;
+    }
+    
+    if ((SHAPEFILE_HEADER_SIZE + Writer->ShpFlushed + Size) / 2 > I32_MAX)
+    {
+        Writer->Failed = true;
+    }
+    
+    u8* Src = Shape->ShpFilePtr + SHAPEFILE_HEADER_SIZE;
+    usz Pos = SHAPEFILE_HEADER_SIZE + Writer->ShpFlushed;
+    if (!Writer->Failed && Writer->Async)
+    {
+        i32 Current = Writer->CurrentWindow;
+        if (WriteFileAsync(Writer->Files[0], Src, Size, Pos, &Writer->Io[Current][0]))
+        {
+            Writer->PendingSize[Current][0] = Size;
+        }
+        else
+        {
+            Writer->Failed = true;
+        }
+        
+        // OBS: Unlike _FlushWriter(), the SHX and DBF records still waiting in the window
+        // move along with the headers.
+        i32 Next = Current ^ 1;
+        _WaitWindow(Writer, Next);
+        u8* NextBase = Writer->Windows[Next].Base;
+        CopyData(NextBase + Writer->WindowSize, Shape->ShxFileSize, Shape->ShxFilePtr, Shape->ShxFileSize);
+        CopyData(NextBase + 2 * Writer->WindowSize, Shape->DbfFileSize, Shape->DbfFilePtr, Shape->DbfFileSize);
+        _SetWindow(Writer, Next);
+    }
+    else if (!Writer->Failed && !_WriterWrite(Writer, 0, Src, Size, Pos))
+    {
+        Writer->Failed = true;
+    }
+    
+    // OBS: SHX offsets still in the window are relative to it, and _FlushWriter() adds
+    // [.ShpFlushed] to them, so they are moved back by the bytes flushed here.
+    Writer->ShpFlushed += Size;
+    shx_record* ShxRecord = (shx_record*)(Shape->ShxFilePtr + SHAPEFILE_HEADER_SIZE);
+    usz NumShx = (Shape->ShxFileSize - SHAPEFILE_HEADER_SIZE) / sizeof(shx_record);
+    for (usz Idx = 0; Idx < NumShx; Idx++)
+    {
+        _AddInBE(&ShxRecord[Idx].DataOffset, -(i32)(Size / 2));
+    }
+    Shape->ShpFileSize = SHAPEFILE_HEADER_SIZE;
+}
+
+internal bool
+_StreamShp(shp_writer* Writer, void* Src, usz Size)
+{
+    shapefile* Shape = &Writer->Shape;
+    u8* ReadPtr = (u8*)Src;
+    while (Size > 0 && !Writer->Failed)
+    {
+        if (Shape->ShpFileSize == Writer->WindowSize)
+        {
+            _FlushShp(Writer);
+        }
+        
+        usz Chunk = Min(Size, Writer->WindowSize - Shape->ShpFileSize);
+        CopyData(Shape->ShpFilePtr + Shape->ShpFileSize, Chunk, ReadPtr, Chunk);
+        Shape->ShpFileSize += Chunk;
+        ReadPtr += Chunk;
+        Size -= Chunk;
+    }
+    return !Writer->Failed;
+}
+
+internal void
+_ReleaseSpill(shp_writer* Writer)
+{
+    if (!Writer->Spill.Base)
+    {
+        return;
+    }
+    
+    // OBS: An async flush may still be reading the record from the spill buffer.
+    _WaitWindow(Writer, 0);
+    _WaitWindow(Writer, 1);
+    
+    shapefile* Shape = &Writer->Shape;
+    u8* Shp = Writer->Windows[Writer->CurrentWindow].Base;
+    if (Shape->ShpFilePtr != Shp)
+    {
+        CopyData(Shp, SHAPEFILE_HEADER_SIZE, Shape->ShpFilePtr, SHAPEFILE_HEADER_SIZE);
+        Shape->ShpFilePtr = Shp;
+    }
+    Shape->ShpFileSize = SHAPEFILE_HEADER_SIZE;
+    FreeMemory(&Writer->Spill);
+}
+
+internal bool
+_GrowWindows(shp_writer* Writer, usz WindowSize)
+{
+    _WaitWindow(Writer, 0);
+    _WaitWindow(Writer, 1);
+    
+    i32 NumWindows = (Writer->Async) ? 2 : 1;
+    buffer NewWindows[2] = {0};
+    for (i32 Idx = 0; Idx < NumWindows; Idx++)
+    {
+        NewWindows[Idx] = GetMemory(3 * WindowSize, 0, MEM_READ|MEM_WRITE);
+        if (!NewWindows[Idx].Base)
+        {
+            if (Idx > 0) FreeMemory(&NewWindows[0]);
+            return false;
+        }
+    }
+    
+    buffer OldWindows[2] = { Writer->Windows[0], Writer->Windows[1] };
+    Writer->Windows[0] = NewWindows[0];
+    Writer->Windows[1] = NewWindows[1];
+    Writer->WindowSize = WindowSize;
+    _SetWindow(Writer, Writer->CurrentWindow);
+    Writer->Shape.DbfFilePtr[Writer->Shape.DbfFileSize - 1] = 0x1a;
+    
+    if (Writer->Async)
+    {
+        UnregisterIoBuffers(OldWindows, 2);
+        RegisterIoBuffers(Writer->Windows, 2);
+    }
+    for (i32 Idx = 0; Idx < NumWindows; Idx++)
+    {
+        FreeMemory(&OldWindows[Idx]);
+    }
+    return true;
+}
+
+internal path
+_ShardPath(void* ShpPathStr, i32 ShardIdx, char* Dst)
+{
+    path ShpPath = Path(ShpPathStr);
+    ShpPath.WriteCur = StringLen(ShpPath, LEN_CSTRING);
+    
+    path Result = Path(Dst);
+    AppendDataToPath(ShpPath.Base, ShpPath.WriteCur, &Result);
+    if (ShardIdx > 0)
+    {
+        // OBS: Without an extension the suffix is appended, as a shard path must never
+        // be the path of the first shard (CloseShpWriter() removes stale shards).
+        usz ExtIdx = CharInString('.', Result, RETURN_IDX_FIND|SEARCH_REVERSE);
+        usz SlashIdx = CharInString('/', Result, RETURN_IDX_FIND|SEARCH_REVERSE);
+        usz BackslashIdx = CharInString('\\', Result, RETURN_IDX_FIND|SEARCH_REVERSE);
+        if (ExtIdx != INVALID_IDX
+            && (SlashIdx == INVALID_IDX || ExtIdx > SlashIdx)
+            && (BackslashIdx == INVALID_IDX || ExtIdx > BackslashIdx))
+        {
+            Result.WriteCur = ExtIdx;
+        }
+        AppendCharToString('_', &Result);
+        AppendIntToString(ShardIdx, &Result);
+        AppendStringToString(StringLit(".shp"), &Result);
+    }
+    
+    return Result;
+}
+
+internal bool
+_EndShard(shp_writer* Writer)
+{
+    _FlushWriter(Writer);
+    _ReleaseSpill(Writer);
+    _WaitWindow(Writer, 0);
+    _WaitWindow(Writer, 1);
+    
+    shapefile* Shape = &Writer->Shape;
+    shp_header* ShpHeader = (shp_header*)Shape->ShpFilePtr;
+    shx_header* ShxHeader = (shx_header*)Shape->ShxFilePtr;
+    usz DbfHeaderSize = ((dbf_header*)Shape->DbfFilePtr)->HeaderSize;
+    
+    if (!Writer->Failed)
+    {
+        ShpHeader->FileLength = FlipEndian32((i32)((SHAPEFILE_HEADER_SIZE + Writer->ShpFlushed) / 2));
+        ShxHeader->FileLength = FlipEndian32((i32)((SHAPEFILE_HEADER_SIZE + Writer->ShxFlushed) / 2));
+        
+        // OBS: After the last flush, the DBF end-of-file marker sits right after its header.
+        bool Written = (_WriterWrite(Writer, 0, ShpHeader, SHAPEFILE_HEADER_SIZE, 0)
+                        && _WriterWrite(Writer, 1, ShxHeader, SHAPEFILE_HEADER_SIZE, 0)
+                        && _WriterWrite(Writer, 2, Shape->DbfFilePtr, DbfHeaderSize, 0)
+                        && _WriterWrite(Writer, 2, Shape->DbfFilePtr + DbfHeaderSize, 1,
+                                        DbfHeaderSize + Writer->DbfFlushed));
+        
+        _WaitWindow(Writer, 0);
+        _WaitWindow(Writer, 1);
+        Writer->Failed = (Writer->Failed || !Written);
+    }
+    
+    for (i32 Idx = 0; Idx < 3; Idx++)
+    {
+        if (Writer->Files[Idx] != INVALID_FILE) CloseFileHandle(Writer->Files[Idx]);
+        Writer->Files[Idx] = INVALID_FILE;
+    }
+    
+    return !Writer->Failed;
+}
+
+internal bool
+_StartShard(shp_writer* Writer)
+{
+    char ShardPathBuf[MAX_PATH_SIZE] = {0};
+    _ShardPath(Writer->ShpPath, Writer->NumShards, ShardPathBuf);
+    
+    i32 Flags = WRITE_SOLO|FORCE_CREATE|((Writer->Async) ? ASYNC_FILE : 0);
+    if (!_OpenShpFiles(ShardPathBuf, Writer->Files, Flags, true))
+    {
+        return false;
+    }
+    if (Writer->Files[0] == INVALID_FILE
+        || Writer->Files[1] == INVALID_FILE
+        || Writer->Files[2] == INVALID_FILE)
+    {
+        for (i32 Idx = 0; Idx < 3; Idx++)
+        {
+            if (Writer->Files[Idx] != INVALID_FILE) CloseFileHandle(Writer->Files[Idx]);
+            Writer->Files[Idx] = INVALID_FILE;
+        }
+        return false;
+    }
+    Writer->NumShards++;
+    
+    // OBS: The window holds only the headers after _EndShard(), which keep the fields
+    // but must drop the counts and bounding box of the previous shard.
+    shapefile* Shape = &Writer->Shape;
+    _InitShpHeader((shp_header*)Shape->ShpFilePtr, Shape->Type);
+    CopyData(Shape->ShxFilePtr, SHAPEFILE_HEADER_SIZE, Shape->ShpFilePtr, SHAPEFILE_HEADER_SIZE);
+    ((dbf_header*)Shape->DbfFilePtr)->NumRecords = 0;
+    Shape->NumFeatures = 0;
+    Shape->LastFeatIdx = 0;
+    
+    Writer->ShpFlushed = 0;
+    Writer->ShxFlushed = 0;
+    Writer->DbfFlushed = 0;
+    
+    return true;
+}
+
+external shp_writer
+OpenShpWriter(void* ShpPathStr, shp_type Type, usz WindowSize, bool Async)
+{
+    shp_writer Result = {0};
+    
+    WindowSize = Max(WindowSize, SHP_WRITER_MIN_WINDOW);
+    i32 Flags = WRITE_SOLO|FORCE_CREATE|((Async) ? ASYNC_FILE : 0);
+    if (!_OpenShpFiles(ShpPathStr, Result.Files, Flags, true))
+    {
+        return Result;
+    }
+    
+    i32 NumWindows = (Async) ? 2 : 1;
+    bool Opened = (Result.Files[0] != INVALID_FILE
+                   && Result.Files[1] != INVALID_FILE
+                   && Result.Files[2] != INVALID_FILE);
+    for (i32 Idx = 0; Opened && Idx < NumWindows; Idx++)
+    {
+        Result.Windows[Idx] = GetMemory(3 * WindowSize, 0, MEM_READ|MEM_WRITE);
+        Opened = (Result.Windows[Idx].Base != NULL);
+    }
+    
+    if (!Opened)
+    {
+        for (i32 Idx = 0; Idx < 3; Idx++)
+        {
+            if (Result.Files[Idx] != INVALID_FILE) CloseFileHandle(Result.Files[Idx]);
+        }
+        if (Result.Windows[0].Base) FreeMemory(&Result.Windows[0]);
+        if (Result.Windows[1].Base) FreeMemory(&Result.Windows[1]);
+        
+        shp_writer Empty = {0};
+        return Empty;
+    }
+    
+    u8* Base = Result.Windows[0].Base;
+    Result.Shape = _InitShapefile(Base, Base + WindowSize, Base + 2 * WindowSize, Type);
+    Result.WindowSize = WindowSize;
+    Result.Async = Async;
+    Result.MaxShardSize = SHP_WRITER_MAX_SHARD;
+    Result.NumShards = 1;
+    _ShardPath(ShpPathStr, 0, Result.ShpPath);
+    
+    // OBS: Windows are the only memory ever written from, so they are registered for
+    // async IO once (best effort, and replacing other buffers of the thread, if any).
+    if (Async) RegisterIoBuffers(Result.Windows, 2);
+    
+    return Result;
+}
+
+internal void
+_FitShard(shp_writer* Writer, usz ShpNeeded, usz DbfNeeded)
+{
+    shapefile* Shape = &Writer->Shape;
+    if (!Writer->Failed
+        && (Writer->ShpFlushed + Shape->ShpFileSize + ShpNeeded > Writer->MaxShardSize
+            || Writer->ShxFlushed + Shape->ShxFileSize + sizeof(shx_record) > Writer->MaxShardSize
+            || Writer->DbfFlushed + Shape->DbfFileSize + DbfNeeded > Writer->MaxShardSize))
+    {
+        // OBS: A feature that doesn't fit even in an empty shard can't be written at all.
+        if (Shape->NumFeatures == 0
+            || !_EndShard(Writer)
+            || !_StartShard(Writer))
+        {
+            Writer->Failed = true;
+        }
+    }
+}
+
+internal void
+_FitWindow(shp_writer* Writer, usz ShpNeeded, usz DbfNeeded)
+{
+    shapefile* Shape = &Writer->Shape;
+    if (Writer->Spill.Base
+        || ShpNeeded > Writer->WindowSize - Shape->ShpFileSize
+        || sizeof(shx_record) > Writer->WindowSize - Shape->ShxFileSize
+        || DbfNeeded > Writer->WindowSize - Shape->DbfFileSize)
+    {
+        _FlushWriter(Writer);
+        _ReleaseSpill(Writer);
+        
+        // OBS: Only the DBF side grows the windows, bounded by the record size of the
+        // fields. Oversized geometry goes to the spill buffer or is streamed instead.
+        if (Shape->DbfFileSize + DbfNeeded > Writer->WindowSize)
+        {
+            usz WindowSize = Align(Shape->DbfFileSize + DbfNeeded, SHP_WRITER_MIN_WINDOW);
+            if (!_GrowWindows(Writer, WindowSize))
+            {
+                Writer->Failed = true;
+            }
+        }
+    }
+}
+
+external shp_feature
+AddStreamFeature(shp_writer* Writer, i32 NumParts, i32 NumPoints)
+{
+    shp_feature Result = {0};
+    shapefile* Shape = &Writer->Shape;
+    
+    usz ShpNeeded = _MaxRecordSize(NumParts, NumPoints);
+    usz DbfNeeded = ((dbf_header*)Shape->DbfFilePtr)->RecordSize + 1;
+    _FitShard(Writer, ShpNeeded, DbfNeeded);
+    _FitWindow(Writer, ShpNeeded, DbfNeeded);
+    
+    if (!Writer->Failed && ShpNeeded > Writer->WindowSize - Shape->ShpFileSize)
+    {
+        // OBS: The record can't fit in the window even after a flush, so it is built on a
+        // buffer of its own, flushed and released along with the next window.
+        Writer->Spill = GetMemory(SHAPEFILE_HEADER_SIZE + ShpNeeded, 0, MEM_READ|MEM_WRITE);
+        if (Writer->Spill.Base)
+        {
+            CopyData(Writer->Spill.Base, SHAPEFILE_HEADER_SIZE, Shape->ShpFilePtr, SHAPEFILE_HEADER_SIZE);
+            Shape->ShpFilePtr = Writer->Spill.Base;
+        }
+        else
+        {
+            Writer->Failed = true;
+        }
+    }
+    
+    if (!Writer->Failed)
+    {
+        // OBS: Window memory is reused after flushes, and the Add...() functions expect
+        // a zeroed record to write on. A new spill buffer is zeroed already.
+        if (!Writer->Spill.Base)
+        {
+            buffer Record = Buffer(Shape->ShpFilePtr + Shape->ShpFileSize, 0, ShpNeeded);
+            ClearMemory(&Record);
+        }
+        buffer Index = Buffer(Shape->ShxFilePtr + Shape->ShxFileSize, 0, sizeof(shx_record));
+        ClearMemory(&Index);
+        
+        Result = AddFeature(Shape, NumParts, NumPoints);
+    }
+    
+    return Result;
+}
+
+external shp_feature
+AddStreamPolygon(shp_writer* Writer, i32 NumRings, shp_ring* Rings, bbox2 BBox)
+{
+    shp_feature Result = {0};
+    shapefile* Shape = &Writer->Shape;
+    shp_header* Header = (shp_header*)Shape->ShpFilePtr;
+    
+    usz NumPoints = 0;
+    for (i32 RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        NumPoints += Rings[RingIdx].NumPoints;
+    }
+    usz RecordSize = (sizeof(shp_record) + sizeof(shp_multipart)
+                      + (usz)NumRings * sizeof(i32) + NumPoints * sizeof(v2));
+    if (Header->Type != ShpType_Polygon
+        || NumPoints > I32_MAX
+        || RecordSize / 2 > I32_MAX)
+    {
+        return Result;
+    }
+    
+    if (_MaxRecordSize(NumRings, (i32)NumPoints) <= Writer->WindowSize - SHAPEFILE_HEADER_SIZE)
+    {
+        Result = AddStreamFeature(Writer, NumRings, (i32)NumPoints);
+        if (Result.Shape && !AddPolygon(&Result, NumRings, Rings, BBox))
+        {
+            shp_feature Empty = {0};
+            Result = Empty;
+        }
+        return Result;
+    }
+    
+    // OBS: The window is emptied first, so the record starts right after the header and
+    // its SHX and DBF records stay in the window while the geometry is streamed.
+    usz DbfNeeded = ((dbf_header*)Shape->DbfFilePtr)->RecordSize + 1;
+    _FitShard(Writer, RecordSize, DbfNeeded);
+    _FlushWriter(Writer);
+    _ReleaseSpill(Writer);
+    _FitWindow(Writer, sizeof(shp_record), DbfNeeded);
+    if (Writer->Failed)
+    {
+        return Result;
+    }
+    
+    buffer Index = Buffer(Shape->ShxFilePtr + Shape->ShxFileSize, 0, sizeof(shx_record));
+    ClearMemory(&Index);
+    Result = AddFeature(Shape, NumRings, (i32)NumPoints);
+    Shape->ShpFileSize = SHAPEFILE_HEADER_SIZE;
+    
+    shp_record* ShpRecord = (shp_record*)Result.ShpRecord;
+    shx_record* ShxRecord = (shx_record*)Result.ShxRecord;
+    ShpRecord->ContentLength = FlipEndian32((i32)((RecordSize - sizeof(shp_record)) / 2));
+    ShxRecord->ContentLength = ShpRecord->ContentLength;
+    Shape->ShpFileSize += sizeof(shp_record);
+    
+    shp_multipart Polygon = {
+        ShpType_Polygon, { BBox.Min.X, BBox.Min.Y, BBox.Max.X, BBox.Max.Y }, NumRings, (i32)NumPoints
+    };
+    _StreamShp(Writer, &Polygon, sizeof(shp_multipart));
+    
+    i32 PartStart = 0;
+    for (i32 RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        _StreamShp(Writer, &PartStart, sizeof(i32));
+        PartStart += Rings[RingIdx].NumPoints;
+    }
+    
+    for (i32 RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        shp_ring* Ring = &Rings[RingIdx];
+        if (!Ring->Reverse)
+        {
+            _StreamShp(Writer, Ring->Vertices, sizeof(v2) * Ring->NumPoints);
+            continue;
+        }
+        
+        v2 Reversed[256];
+        i32 MaxCopy = 256;
+        v2* ReadPtr = Ring->Vertices + Ring->NumPoints;
+        for (i32 Count = 0; Count < Ring->NumPoints; Count += MaxCopy)
+        {
+            i32 NumCopy = Min(Ring->NumPoints - Count, MaxCopy);
+            for (i32 Idx = 0; Idx < NumCopy; Idx++)
+            {
+                Reversed[Idx] = *--ReadPtr;
+            }
+            _StreamShp(Writer, Reversed, sizeof(v2) * NumCopy);
+        }
+    }
+    
+    Header = (shp_header*)Shape->ShpFilePtr;
+    Header->BBox.XMin = Min(Header->BBox.XMin, BBox.Min.X);
+    Header->BBox.YMin = Min(Header->BBox.YMin, BBox.Min.Y);
+    Header->BBox.XMax = Max(Header->BBox.XMax, BBox.Max.X);
+    Header->BBox.YMax = Max(Header->BBox.YMax, BBox.Max.Y);
+    ((shx_header*)Shape->ShxFilePtr)->BBox = Header->BBox;
+    
+    if (Writer->Failed)
+    {
+        shp_feature Empty = {0};
+        return Empty;
+    }
+    
+    // OBS: The record may have been flushed already, so only the DBF side is valid.
+    Result.ShpRecord = NULL;
+    Result.ShxRecord = (u8*)Shape->ShxFilePtr + Shape->ShxFileSize - sizeof(shx_record);
+    Result.DbfRecord = Shape->DbfFilePtr + Shape->DbfFileSize - 1 - ((dbf_header*)Shape->DbfFilePtr)->RecordSize;
+    return Result;
+}
+
+external bool
+CloseShpWriter(shp_writer* Writer)
+{
+    if (!Writer->Shape.ShpFilePtr)
+    {
+        return false;
+    }
+    
+    bool Result = _EndShard(Writer);
+    if (Writer->Async) UnregisterIoBuffers(Writer->Windows, 2);
+    if (Writer->Windows[0].Base) FreeMemory(&Writer->Windows[0]);
+    if (Writer->Windows[1].Base) FreeMemory(&Writer->Windows[1]);
+    
+    // OBS: A shard left over from a bigger previous output would be read as part of this
+    // one by OpenShpDataset(), so the chain is cut right after the last shard.
+    char StalePathBuf[MAX_PATH_SIZE] = {0};
+    path StalePath = _ShardPath(Writer->ShpPath, Writer->NumShards, StalePathBuf);
+    if (IsExistingPath(StalePathBuf))
+    {
+        RemoveFile(StalePathBuf);
+        usz ExtIdx = CharInString('.', StalePath, RETURN_IDX_AFTER|SEARCH_REVERSE);
+        StalePath.WriteCur = ExtIdx;
+        AppendStringToString(StringLit("shx"), &StalePath);
+        RemoveFile(StalePathBuf);
+        StalePath.WriteCur = ExtIdx;
+        AppendStringToString(StringLit("dbf"), &StalePath);
+        RemoveFile(StalePathBuf);
+    }
+    
+    buffer WriterBuffer = Buffer(Writer, sizeof(shp_writer), sizeof(shp_writer));
+    ClearMemory(&WriterBuffer);
+    
+    return Result;
+}
+
+//=================================
+// Sharded dataset functions
+//=================================
+
+internal bool
+_SameShardSchema(shapefile* A, shapefile* B)
+{
+    // OBS: Shards come from the same writer, so their field descriptors match byte by byte.
+    dbf_header* HeaderA = (dbf_header*)A->DbfFilePtr;
+    dbf_header* HeaderB = (dbf_header*)B->DbfFilePtr;
+    if (A->Type != B->Type
+        || A->NumFields != B->NumFields
+        || HeaderA->HeaderSize != HeaderB->HeaderSize
+        || HeaderA->RecordSize != HeaderB->RecordSize)
+    {
+        return false;
+    }
+    
+    usz FieldsSize = sizeof(dbf_fd) * A->NumFields;
+    buffer FieldsA = Buffer((u8*)&HeaderA[1], FieldsSize, FieldsSize);
+    buffer FieldsB = Buffer((u8*)&HeaderB[1], FieldsSize, FieldsSize);
+    return EqualBuffers(FieldsA, FieldsB);
+}
+
+external shp_dataset
+OpenShpDataset(void* ShpPathStr)
+{
+    shp_dataset Result = {0};
+    
+    i32 NumShards = 0;
+    for (;;)
+    {
+        char ShardPathBuf[MAX_PATH_SIZE] = {0};
+        _ShardPath(ShpPathStr, NumShards, ShardPathBuf);
+        if (!IsExistingPath(ShardPathBuf)) break;
+        NumShards++;
+    }
+    if (NumShards == 0)
+    {
+        return Result;
+    }
+    
+    usz MemSize = (NumShards * sizeof(shapefile)) + ((NumShards + 1) * sizeof(isz));
+    Result.Mem = GetMemory(MemSize, 0, MEM_READ|MEM_WRITE);
+    if (!Result.Mem.Base)
+    {
+        return Result;
+    }
+    Result.Shards = (shapefile*)Result.Mem.Base;
+    Result.FirstFeature = (isz*)&Result.Shards[NumShards];
+    
+    for (i32 Idx = 0; Idx < NumShards; Idx++)
+    {
+        char ShardPathBuf[MAX_PATH_SIZE] = {0};
+        _ShardPath(ShpPathStr, Idx, ShardPathBuf);
+        shapefile Shard = OpenAndMapShp(ShardPathBuf);
+        if (!Shard.ShpFilePtr || (Idx > 0 && !_SameShardSchema(&Result.Shards[0], &Shard)))
+        {
+            if (Shard.ShpFilePtr) CloseShp(&Shard);
+            CloseShpDataset(&Result);
+            return Result;
+        }
+        
+        Result.Shards[Idx] = Shard;
+        Result.FirstFeature[Idx] = Result.NumFeatures;
+        Result.NumFeatures += Shard.NumFeatures;
+        Result.NumShards++;
+    }
+    Result.FirstFeature[NumShards] = Result.NumFeatures;
+    
+    return Result;
+}
+
+external shp_feature
+GetDatasetFeature(shp_dataset* Dataset, isz TargetIdx)
+{
+    shp_feature Result = {0};
+    if (TargetIdx < 0 || TargetIdx >= Dataset->NumFeatures)
+    {
+        return Result;
+    }
+    
+    // Last shard whose first feature is not after the target.
+    i32 Lo = 0, Hi = Dataset->NumShards - 1;
+    while (Lo < Hi)
+    {
+        i32 Mid = (Lo + Hi + 1) / 2;
+        if (Dataset->FirstFeature[Mid] <= TargetIdx) Lo = Mid;
+        else Hi = Mid - 1;
+    }
+    
+    Result = GetFeature(&Dataset->Shards[Lo], (i32)(TargetIdx - Dataset->FirstFeature[Lo]));
+    return Result;
+}
+
+external void
+CloseShpDataset(shp_dataset* Dataset)
+{
+    for (i32 Idx = 0; Idx < Dataset->NumShards; Idx++)
+    {
+        CloseShp(&Dataset->Shards[Idx]);
+    }
+    if (Dataset->Mem.Base) FreeMemory(&Dataset->Mem);
+    
+    buffer DatasetBuffer = Buffer(Dataset, sizeof(shp_dataset), sizeof(shp_dataset));
+    ClearMemory(&DatasetBuffer);
+}
@@ -10,7 +10,8 @@
 //
 // Reading:
 //   1. Load entire content of SHP, SHX and DBF files to memory.
-//   2. Call ImportShp() to create parsed shapefile object.
+//   2. Call ImportShp() to create parsed shapefile object (or skip
+//      step 1 and call OpenAndImportShp() or OpenAndMapShp()).
 //   3. Iterate through NumFeatures with GetFeature().
 //   4. Read feature data with GetGeometry(), GetFieldByIdx/Name().
 //
@@ -25,6 +26,15 @@
 //      field created above (if not, geom/field is NULL).
 //   6. Repeat from step 4 for each feature in the shapefile.
 //   7. After finished adding features, save buffers to disk.
+//
+// Streaming write:
+//   1. Call OpenShpWriter() with the output path, instead of steps 1-2
+//      above; no buffer sizes need to be known in advance.
+//   2. Same as steps 3-6 above, on [.Shape] of the writer, but adding
+//      features with AddStreamFeature() instead of AddFeature().
+//   3. Call CloseShpWriter() to flush and finalize the files.
+//   4. Output that outgrows the 2GB limit of the format is split into
+//      several shapefiles, read back as one with OpenShpDataset().
 //=========================================================================
 #define GEOTYPES_SHP_H
 
@@ -95,9 +105,9 @@ struct shapefile
     u8* ShpFilePtr;
     u8* ShxFilePtr;
     u8* DbfFilePtr;
-    i32 ShxFileSize;
-    i32 ShpFileSize;
-    i32 DbfFileSize;
+    usz ShxFileSize;
+    usz ShpFileSize;
+    usz DbfFileSize;
     
     shp_type Type;
     i32 NumFeatures;
@@ -105,6 +115,7 @@ struct shapefile
     i32 LastFeatIdx;
     
     bool InternalAlloc;
+    buffer Mapping[3]; // File views from OpenAndMapShp(), in [.shp], [.shx], [.dbf] order.
 };
 
 struct shp_feature
@@ -117,6 +128,13 @@ struct shp_feature
     u8* DbfRecord;
 };
 
+struct shp_ring
+{
+    v2* Vertices;
+    i32 NumPoints;
+    bool Reverse; // Write [Vertices] back to front.
+};
+
 struct shp_part
 {
     i32 NumPoints;
@@ -141,6 +159,85 @@ struct shp_field
     struct { u16 Year, Month, Day; } Date;
 };
 
+struct shp_column
+{
+    i32 FieldIdx;
+    shp_field_type Type;
+    isz* Integer;     // Integer, Boolean (0 or 1) and Date (as YYYYMMDD) fields.
+    f64* Real;
+    char** String;    // OBS: Points into the DBF file, not zero-terminated.
+    usz* StringSize;
+    
+    buffer Mem;       // OBS: Only set for columns from ReadColumn().
+};
+
+struct shp_batch
+{
+    i32 FirstFeature;
+    i32 NumFeatures;
+    i32 NumParts;
+    i32 NumPoints;
+    
+    i32* FeatPart;    // [NumFeatures+1] idx of the first part of each feature.
+    i32* FeatPoint;   // [NumFeatures+1] idx of the first vertex of each feature.
+    i32* PartPoint;   // [NumParts+1] idx of the first vertex of each part.
+    v2* XY;           // [NumPoints] vertices of all features, contiguous.
+    f64* Z;           // [NumPoints] if shape type has Z, NULL otherwise.
+    f64* M;           // [NumPoints] if shape type has M, NULL otherwise.
+    
+    i32 NumColumns;
+    shp_column* Columns;
+    
+    buffer Mem[2];
+};
+
+struct shp_index
+{
+    i32 NumFeatures;
+    i32 NumNodes;
+    i32 NumLevels;
+    i32* LevelEnd;    // [NumLevels] idx one past the last node of each level.
+    bbox2* Boxes;     // [NumNodes] leaves (Hilbert-sorted features) first, root last.
+    i32* Indices;     // [NumNodes] feature idx for leaves, first child for others.
+    
+    buffer Mem;
+    bool Mapped;
+};
+
+struct shp_writer
+{
+    shapefile Shape; // OBS: Window over the not yet flushed part of the files.
+    file Files[3];
+    
+    buffer Windows[2];
+    usz WindowSize; // Capacity of each file inside a window.
+    i32 CurrentWindow;
+    
+    usz ShpFlushed; // Bytes already handed to disk, not counting the headers.
+    usz ShxFlushed;
+    usz DbfFlushed;
+    
+    bool Async;
+    usz PendingSize[2][3]; // Bytes in flight per window and file, when [Async].
+    async Io[2][3];
+    bool Failed;
+    
+    buffer Spill; // Record too big for the window, built apart until the next flush.
+    
+    usz MaxShardSize; // Largest any of the three files of a shard may grow to.
+    i32 NumShards;    // Shards created so far, including the one being written.
+    char ShpPath[MAX_PATH_SIZE]; // Path of the first shard, the others are derived from it.
+};
+
+struct shp_dataset
+{
+    shapefile* Shards;
+    isz* FirstFeature; // Dataset index of the first feature of each shard, plus the total.
+    i32 NumShards;
+    isz NumFeatures;
+    buffer Mem;
+};
+
 //=================================
 // Creation functions
 //=================================
@@ -189,10 +286,18 @@ external shapefile OpenAndImportShp(void* ShpFilePath);
  |  corresponding [.shx] and [.dbf] files must also be present in the same folder.
  |--- Return: parsed shapefile object if successful, empty object if not. */
 
+external shapefile OpenAndMapShp(void* ShpFilePath);
+
+/* Same as OpenAndImportShp(), but memory-maps the [.shp], [.shx] and [.dbf] files
+ |  instead of reading them, so opening is near-instant and only the pages of features
+ |  actually accessed are loaded from disk. Views are copy-on-write: edits are never
+ |  written back to the files. User must call CloseShp() later to unmap them.
+ |--- Return: parsed shapefile object if successful, empty object if not. */
+
 external void CloseShp(shapefile* Shape);
 
-/* Frees memory from shapefile object (if it was created with OpenAndImportShp()), and
-|  zeroes out its memory.
+/* Frees memory from shapefile object (if it was created with OpenAndImportShp() or
+|  OpenAndMapShp()), and zeroes out its memory.
  |--- Return: nothing. */
 
 external shp_feature GetFeature(shapefile* Shape, i32 TargetIdx);
@@ -215,6 +320,45 @@ external shp_field GetFieldByName(shp_feature Feat, char* TargetName);
 /* Gets the field from Feat by its name. TargetName must be a zero-terminated ASCII string.
 |--- Return: shp_field object if found, empty object if name not found. */
 
+external i32 GetFieldIdx(shapefile* Shape, char* TargetName);
+
+/* Finds the index of a field by its name. TargetName must be a zero-terminated ASCII
+ |  string. Resolve names once with this, and then use GetFieldByIdx() or ReadColumn().
+ |--- Return: field index if found, -1 if not. */
+
+external shp_column ReadColumn(shapefile* Shape, i32 FieldIdx);
+
+/* Decodes field [FieldIdx] of every feature in [Shape] into one typed array: [.Integer]
+ |  for Integer, Boolean and Date (as YYYYMMDD), [.Real] for Real, and [.String] plus
+ |  [.StringSize] for String (pointing into the DBF, trailing blanks trimmed). Numbers
+ |  are parsed with SIMD where available. Null numbers are ISZ_MAX or DBL_MAX, same as
+ |  in GetFieldByIdx(). Must be freed with FreeColumn().
+ |--- Return: column object if successful, empty object if not. */
+
+external void FreeColumn(shp_column* Column);
+
+/* Frees memory of a column created with ReadColumn(), and zeroes it out.
+ |--- Return: nothing. */
+
+external shp_batch ReadFeatureBatch(shapefile* Shape, i32 FirstIdx, i32 NumFeatures,
+                                    i32* FieldIdx, i32 NumColumns, thread_pool* Pool);
+
+/* Decodes [NumFeatures] features starting at [FirstIdx] into the structure-of-arrays
+ |  layout of shp_batch, splitting the work between the workers of [Pool] and the calling
+ |  thread (only the calling one if NULL). The pool is owned by the caller, so one pool
+ |  can serve every batch read from a shapefile, instead of one per call.
+ |  Parts of feature N are FeatPart[N] to FeatPart[N+1] (exclusive), and the vertices
+ |  of part P are XY[PartPoint[P]] to XY[PartPoint[P+1]]. The fields listed in
+ |  [FieldIdx] are decoded into one column each. Multipatch part types are not kept.
+ |  [Shape] must stay open while the batch is used, as String columns point into it.
+ |  Memory is owned by the batch, and must be freed with FreeFeatureBatch().
+ |--- Return: batch object if successful, empty object if not. */
+
+external void FreeFeatureBatch(shp_batch* Batch);
+
+/* Frees memory of a batch created with ReadFeatureBatch(), and zeroes it out.
+ |--- Return: nothing. */
+
 
 //=================================
 // Write data functions
@@ -258,6 +402,16 @@ external bool AddRing(shp_feature* Feat, shp_ring_type Type, i32 NumPoints, v2*
  |  AddPoints().
 |--- Return: true if successful, false otherwise. */
 
+external bool AddPolygon(shp_feature* Feat, i32 NumRings, shp_ring* Rings, bbox2 BBox);
+
+/* Bulk alternative to AddRing() for ShpType_Polygon features whose bounding box and
+|  ring orientation are already known, e.g. polygons traced from a raster. Writes all
+ |  [NumRings] rings of [Rings] straight into the record in a single call, copying each
+ |  ring as a block (reversed when its [.Reverse] is set), without the per-vertex bbox
+ |  and orientation checks of AddRing(). [BBox] must enclose every vertex. [Feat] must
+ |  be a new feature created for exactly [NumRings] parts and all of their vertices.
+|--- Return: true if successful, false otherwise. */
+
 external bool AddPatch(shp_feature* Feat, shp_patch_type Type, i32 NumPoints, v2* Vertex, f64* Z, f64* M, i32 Offset);
 
 /* Adds a patch of [NumPoints] vertices for ShpType_Multipatch geometries. Call this
@@ -277,6 +431,123 @@ external bool AddAttrDate(shp_feature* Feat, usz Year, usz Month, usz Day, i32 F
 |--- Return: true if successful, false otherwise. */
 
 
+
+//=================================
+// Spatial index functions
+//=================================
+
+#define SHP_INDEX_NODE_SIZE 16
+#define SHP_INDEX_MAX_LEVELS 16
+
+external shp_index BuildShpIndex(shapefile* Shape);
+
+/* Builds a packed Hilbert R-tree over the bboxes of all features in [Shape]. Features
+ |  are sorted by the Hilbert value of their bbox centers, and grouped bottom-up in
+ |  nodes of SHP_INDEX_NODE_SIZE children. Must be freed with CloseShpIndex().
+ |--- Return: index object if successful, empty object if not. */
+
+external bool SaveShpIndex(shp_index* Index, shapefile* Shape, void* IndexFilePath);
+
+/* Saves [Index] of [Shape] to a sidecar file at [IndexFilePath] (OS unicode encoding),
+ |  so later runs can skip building it. The sidecar is specific to this library, and not
+ |  compatible with [.qix] or [.sbn] files.
+ |--- Return: true if successful, false if not. */
+
+external shp_index OpenShpIndex(shapefile* Shape, void* IndexFilePath);
+
+/* Memory-maps an index saved with SaveShpIndex(). The sidecar is rejected if it does
+ |  not match the feature count and [.shp] size of [Shape], so a stale index is never
+ |  used. Must be freed with CloseShpIndex().
+ |--- Return: index object if successful, empty object if not. */
+
+external i32 QueryShpIndex(shp_index* Index, bbox2 Box, i32* Dst, i32 DstCount);
+
+/* Finds all features whose bbox intersects [Box], writing up to [DstCount] feature
+ |  indices to [Dst] (in tree order, not sorted). [Dst] can be NULL to only count them.
+ |--- Return: total number of features found, which may be more than [DstCount]. */
+
+external void CloseShpIndex(shp_index* Index);
+
+/* Frees or unmaps memory from [Index], and zeroes it out.
+ |--- Return: nothing. */
+
+//=================================
+// Streaming write functions
+//=================================
+
+#define SHP_WRITER_MIN_WINDOW 65536
+#define SHP_WRITER_MAX_SHARD  I32_MAX // OBS: shapefile sizes and SHX offsets are i32.
+
+external shp_writer OpenShpWriter(void* ShpFilePath, shp_type Type, usz WindowSize, bool Async);
+
+/* Creates [.shp], [.shx] and [.dbf] files at [ShpFilePath] (OS unicode encoding), and
+ |  returns a writer that streams features into them through bounded memory windows of
+ |  [WindowSize] bytes per file (at least SHP_WRITER_MIN_WINDOW). Completed features are
+ |  flushed to disk whenever the window fills up, so the whole output never has to be
+ |  held in memory. If [Async] is set, windows are double-buffered and flushed with
+ |  WriteFileAsync() while the next features are being built.
+ |  Fields are created by calling CreateField() on [Writer->Shape], before the first
+ |  call to AddStreamFeature().
+ |--- Return: writer object if successful, empty object (NULL [.Shape.ShpFilePtr]) if not. */
+
+external shp_feature AddStreamFeature(shp_writer* Writer, i32 NumParts, i32 NumPoints);
+
+/* Same as AddFeature(), but for a streaming writer. The previous feature is considered
+ |  complete, and may be flushed to disk. Returned feature is filled in with the regular
+ |  AddRing(), AddAttr...() etc. functions, and is only valid until the next call to
+ |  AddStreamFeature() or CloseShpWriter(). Windows keep their size: a feature whose
+ |  geometry doesn't fit in one is built on a buffer of its own, sized for just that
+ |  record and released once it's flushed.
+ |--- Return: new feature if successful, empty feature (NULL [.Shape]) if not. */
+
+external shp_feature AddStreamPolygon(shp_writer* Writer, i32 NumRings, shp_ring* Rings, bbox2 BBox);
+
+/* Streaming version of AddStreamFeature() followed by AddPolygon(), for ShpType_Polygon
+ |  writers. When the record doesn't fit in the window, it is written through it in
+ |  window-sized pieces, so memory stays bounded by [WindowSize] whatever the number of
+ |  vertices. The returned feature has no [.ShpRecord], and may only be used with the
+ |  AddAttr...() functions, until the next call to a streaming function.
+ |--- Return: new feature if successful, empty feature (NULL [.Shape]) if not. */
+
+external bool CloseShpWriter(shp_writer* Writer);
+
+/* Flushes remaining features, patches the file headers with the final file lengths,
+ |  bounding box and record count, closes the files, frees the windows and zeroes out
+ |  [Writer].
+ |--- Return: true if every write succeeded, false if not. */
+
+//=================================
+// Sharded dataset functions
+//=================================
+
+// A streaming writer never lets any of its files grow past [.MaxShardSize] bytes
+// (SHP_WRITER_MAX_SHARD by default, can be lowered after OpenShpWriter()). When the
+// next feature would not fit, the current files are finished as a complete shapefile
+// and writing continues on a new shard next to it, named with a numeric suffix:
+//   out.shp -> out_1.shp -> out_2.shp ...
+// Features are never split across shards, so a single feature that can't fit in an
+// empty shard fails the writer. Shards share the type and fields of the first one.
+
+external shp_dataset OpenShpDataset(void* ShpFilePath);
+
+/* Opens every shard written from [ShpFilePath] (the path of the first one, in the OS
+ |  unicode encoding) with OpenAndMapShp(), presenting them as one dataset of
+ |  [.NumFeatures] features. Shards are looked up by suffix until the first missing one,
+ |  and must all have the shape type and DBF fields of the first one.
+ |  Must be freed with CloseShpDataset().
+ |--- Return: dataset object if successful, empty object if not. */
+
+external shp_feature GetDatasetFeature(shp_dataset* Dataset, isz TargetIdx);
+
+/* Same as GetFeature(), over the whole dataset. TargetIdx goes from 0 to
+ |  ([Dataset->NumFeatures] - 1). The feature's [.Shape] is the shard that holds it.
+ |--- Return: shp_feature object, empty (NULL [.Shape]) if out of range. */
+
+external void CloseShpDataset(shp_dataset* Dataset);
+
+/* Closes every shard of a dataset opened with OpenShpDataset(), and zeroes it out.
+ |--- Return: nothing. */
+
 #if !defined(GEOTYPES_STATIC_LINKING)
 #include "geotypes-shp.cpp"
 #endif
@@ -0,0 +1,507 @@
+//==========================================================================
+// tinybase-platform-common.c
+//
+// Parts of tinybase-platform that don't depend on the OS, built on top of
+// the primitives implemented in the platform-specific files.
+//==========================================================================
+
+//========================================
+// Memory
+//========================================
+
+external grow_arena
+ReserveGrowArena(usz MaxSize, int Flags)
+{
+    grow_arena Result = {0};
+    buffer Range = ReserveMemory(MaxSize);
+    if (Range.Base)
+    {
+        Result.Base = Range.Base;
+        Result.Reserved = Range.Size;
+        Result.Flags = (Flags) ? Flags : MEM_WRITE;
+    }
+    return Result;
+}
+
+external bool
+CommitGrowArena(grow_arena* Arena, usz Size)
+{
+    usz Needed = Arena->WriteCur + Size;
+    if (Needed <= Arena->Size)
+    {
+        return true;
+    }
+    if (Size > Arena->Reserved - Arena->WriteCur)
+    {
+        return false;
+    }
+    
+    // OBS: Commits at least double of what is committed, to keep system calls few.
+    usz NewSize = Max(Needed, 2 * Arena->Size);
+    NewSize = Align(NewSize, gSysInfo.PageSize);
+    NewSize = Min(NewSize, Arena->Reserved);
+    if (!CommitMemory(Arena->Base + Arena->Size, NewSize - Arena->Size, Arena->Flags))
+    {
+        return false;
+    }
+    Arena->Size = NewSize;
+    return true;
+}
+
+external void*
+PushIntoGrowArena(grow_arena* Arena, usz Size)
+{
+    void* Result = NULL;
+    if (CommitGrowArena(Arena, Size))
+    {
+        Result = Arena->Base + Arena->WriteCur;
+        Arena->WriteCur += Size;
+    }
+    return Result;
+}
+
+external void
+FreeGrowArena(grow_arena* Arena)
+{
+    if (Arena->Base)
+    {
+        buffer Range = Buffer(Arena->Base, 0, Arena->Reserved);
+        FreeMemory(&Range);
+    }
+    memset(Arena, 0, sizeof(grow_arena));
+}
+
+//========================================
+// Thread pool
+//========================================
+
+typedef struct pool_worker
+{
+    thread_pool* Pool;
+    i32 Idx;
+} pool_worker;
+
+global thread_local pool_worker* gCurrentWorker = NULL;
+
+internal i32
+_CurrentQueue(thread_pool* Pool)
+{
+    i32 Result = (gCurrentWorker && gCurrentWorker->Pool == Pool) ? gCurrentWorker->Idx : -1;
+    return Result;
+}
+
+internal bool
+_RunPoolTask(thread_pool* Pool, i32 Home)
+{
+    pool_task Task = {0};
+    for (i32 Count = 0; Count < Pool->NumWorkers && !Task.Proc; Count++)
+    {
+        // OBS: A worker takes the newest task of its own queue, still hot in cache, and
+        // steals the oldest ones of the others, which are usually the biggest.
+        i32 Idx = (Home + Count) % Pool->NumWorkers;
+        pool_queue* Queue = &Pool->Queues[Idx];
+        LockOnMutex(&Queue->Lock);
+        if (Queue->Top != Queue->Bottom)
+        {
+            if (Count == 0) Task = Queue->Tasks[--Queue->Bottom % POOL_QUEUE_SIZE];
+            else Task = Queue->Tasks[Queue->Top++ % POOL_QUEUE_SIZE];
+        }
+        UnlockMutex(&Queue->Lock);
+    }
+    
+    if (!Task.Proc)
+    {
+        return false;
+    }
+    
+    Task.Proc(Task.Arg);
+    if (Task.Group) AtomicAdd(&Task.Group->Count, (usz)-1);
+    return true;
+}
+
+internal THREAD_PROC(_PoolWorker)
+{
+    pool_worker* Worker = (pool_worker*)Arg;
+    thread_pool* Pool = Worker->Pool;
+    gCurrentWorker = Worker;
+    
+    for (;;)
+    {
+        WaitOnSemaphore(&Pool->WorkSignal);
+        if (AtomicAdd(&Pool->Stop, 0)) break;
+        while (_RunPoolTask(Pool, Worker->Idx)) {}
+    }
+    
+    return 0;
+}
+
+external thread_pool*
+InitThreadPool(i32 NumWorkers)
+{
+    if (NumWorkers <= 0) NumWorkers = (i32)gSysInfo.NumThreads;
+    NumWorkers = Max(NumWorkers, 1);
+    
+    usz MemSize = (sizeof(thread_pool)
+                   + NumWorkers * (sizeof(pool_queue) + sizeof(thread) + sizeof(pool_worker)));
+    buffer Mem = GetMemory(MemSize, 0, MEM_WRITE);
+    if (!Mem.Base)
+    {
+        return NULL;
+    }
+    
+    thread_pool* Pool = (thread_pool*)Mem.Base;
+    Pool->Mem = Mem;
+    Pool->NumWorkers = NumWorkers;
+    Pool->Queues = (pool_queue*)&Pool[1];
+    Pool->Threads = (thread*)&Pool->Queues[NumWorkers];
+    pool_worker* Workers = (pool_worker*)&Pool->Threads[NumWorkers];
+    Pool->WorkSignal = InitSemaphore(0);
+    
+    for (i32 Idx = 0; Idx < NumWorkers; Idx++)
+    {
+        Pool->Queues[Idx].Lock = InitMutex();
+        Workers[Idx].Pool = Pool;
+        Workers[Idx].Idx = Idx;
+    }
+    
+    // OBS: Tasks are also run by the threads waiting on them, so the pool still makes
+    // progress if some workers couldn't be created.
+    for (i32 Idx = 0; Idx < NumWorkers; Idx++)
+    {
+        Pool->Threads[Idx] = InitThread(_PoolWorker, &Workers[Idx], true);
+    }
+    
+    return Pool;
+}
+
+external void
+SubmitTask(thread_pool* Pool, task_proc Proc, void* Arg, wait_group* Group)
+{
+    if (Group) AtomicAdd(&Group->Count, 1);
+    
+    // OBS: Workers queue their own subtasks locally, other threads spread them around.
+    i32 Idx = _CurrentQueue(Pool);
+    if (Idx < 0) Idx = (i32)(AtomicAdd(&Pool->NextQueue, 1) % Pool->NumWorkers);
+    
+    pool_queue* Queue = &Pool->Queues[Idx];
+    bool Queued = false;
+    LockOnMutex(&Queue->Lock);
+    if (Queue->Bottom - Queue->Top < POOL_QUEUE_SIZE)
+    {
+        pool_task Task = { Proc, Arg, Group };
+        Queue->Tasks[Queue->Bottom++ % POOL_QUEUE_SIZE] = Task;
+        Queued = true;
+    }
+    UnlockMutex(&Queue->Lock);
+    
+    if (Queued)
+    {
+        IncreaseSemaphore(&Pool->WorkSignal);
+    }
+    else // Queue is full, the task is run right away instead.
+    {
+        Proc(Arg);
+        if (Group) AtomicAdd(&Group->Count, (usz)-1);
+    }
+}
+
+external void
+WaitForGroup(thread_pool* Pool, wait_group* Group)
+{
+    i32 Home = Max(_CurrentQueue(Pool), 0);
+    while (AtomicAdd(&Group->Count, 0) > 0)
+    {
+        if (!_RunPoolTask(Pool, Home)) YieldThread();
+    }
+}
+
+typedef struct parallel_for
+{
+    range_proc Proc;
+    void* Arg;
+    isz Begin;
+    isz End;
+    isz Grain;
+    volatile usz NextChunk;
+} parallel_for;
+
+internal TASK_PROC(_ParallelForTask)
+{
+    parallel_for* For = (parallel_for*)Arg;
+    for (;;)
+    {
+        isz ChunkBegin = For->Begin + (isz)AtomicAdd(&For->NextChunk, 1) * For->Grain;
+        if (ChunkBegin >= For->End) break;
+        For->Proc(ChunkBegin, Min(ChunkBegin + For->Grain, For->End), For->Arg);
+    }
+}
+
+external void
+ParallelFor(thread_pool* Pool, isz Begin, isz End, isz Grain, range_proc Proc, void* Arg)
+{
+    if (End <= Begin)
+    {
+        return;
+    }
+    
+    isz Count = End - Begin;
+    if (Grain <= 0) Grain = Max(Count / (Pool->NumWorkers * 8), 1);
+    isz NumChunks = (Count + Grain - 1) / Grain;
+    
+    // OBS: Chunks are handed out from a shared counter, so every task keeps taking
+    // the next one until the range is done, and uneven chunks balance themselves.
+    parallel_for For = { Proc, Arg, Begin, End, Grain, 0 };
+    wait_group Group = {0};
+    isz NumTasks = Min(NumChunks, (isz)Pool->NumWorkers);
+    for (isz Idx = 0; Idx < NumTasks; Idx++)
+    {
+        SubmitTask(Pool, _ParallelForTask, &For, &Group);
+    }
+    WaitForGroup(Pool, &Group);
+}
+
+external void
+CloseThreadPool(thread_pool* Pool)
+{
+    AtomicAdd(&Pool->Stop, 1);
+    for (i32 Idx = 0; Idx < Pool->NumWorkers; Idx++)
+    {
+        IncreaseSemaphore(&Pool->WorkSignal);
+    }
+    for (i32 Idx = 0; Idx < Pool->NumWorkers; Idx++)
+    {
+        if (Pool->Threads[Idx].Handle) WaitOnThread(&Pool->Threads[Idx]);
+        CloseMutex(&Pool->Queues[Idx].Lock);
+    }
+    CloseSemaphore(&Pool->WorkSignal);
+    
+    buffer Mem = Pool->Mem;
+    FreeMemory(&Mem);
+}
+
+//========================================
+// Queues
+//========================================
+
+internal usz
+_QueueCapacity(usz Capacity)
+{
+    usz Result = 2;
+    while (Result < Capacity) Result <<= 1;
+    return Result;
+}
+
+external spsc_queue
+InitSpscQueue(usz Capacity)
+{
+    spsc_queue Result = {0};
+    Capacity = _QueueCapacity(Capacity);
+    
+    Result.Mem = GetMemory(sizeof(void*) * Capacity, 0, MEM_WRITE);
+    if (Result.Mem.Base)
+    {
+        Result.Slots = (void**)Result.Mem.Base;
+        Result.Mask = Capacity-1;
+    }
+    
+    return Result;
+}
+
+external bool
+SpscPush(spsc_queue* Queue, void* Item)
+{
+    usz Tail = Queue->Tail;
+    
+    // OBS: The other side's index is only reloaded when the cached one says the queue
+    // is full, so the cache line of the consumer isn't pulled on every push.
+    if (Tail - Queue->CachedHead > Queue->Mask)
+    {
+        Queue->CachedHead = AtomicLoad(&Queue->Head);
+        if (Tail - Queue->CachedHead > Queue->Mask) return false;
+    }
+    
+    Queue->Slots[Tail & Queue->Mask] = Item;
+    AtomicStore(&Queue->Tail, Tail+1);
+    return true;
+}
+
+external bool
+SpscPop(spsc_queue* Queue, void** Item)
+{
+    usz Head = Queue->Head;
+    if (Head == Queue->CachedTail)
+    {
+        Queue->CachedTail = AtomicLoad(&Queue->Tail);
+        if (Head == Queue->CachedTail) return false;
+    }
+    
+    *Item = Queue->Slots[Head & Queue->Mask];
+    AtomicStore(&Queue->Head, Head+1);
+    return true;
+}
+
+external void
+CloseSpscQueue(spsc_queue* Queue)
+{
+    if (Queue->Mem.Base) FreeMemory(&Queue->Mem);
+    buffer QueueBuffer = Buffer(Queue, sizeof(spsc_queue), sizeof(spsc_queue));
+    ClearMemory(&QueueBuffer);
+}
+
+external mpmc_queue
+InitMpmcQueue(usz Capacity)
+{
+    mpmc_queue Result = {0};
+    Capacity = _QueueCapacity(Capacity);
+    
+    Result.Mem = GetMemory(sizeof(mpmc_cell) * Capacity, 0, MEM_WRITE);
+    if (Result.Mem.Base)
+    {
+        Result.Cells = (mpmc_cell*)Result.Mem.Base;
+        Result.Mask = Capacity-1;
+        for (usz Idx = 0; Idx < Capacity; Idx++) Result.Cells[Idx].Sequence = Idx;
+    }
+    
+    return Result;
+}
+
+// OBS: Each cell keeps a sequence number telling which lap of the ring it's ready for:
+// equal to the position when it can be pushed into, and position+1 when it can be
+// popped. Threads claim positions with a CAS on Tail / Head, and the sequence is only
+// moved forward once the item is in place, so no thread ever waits on another.
+
+external bool
+MpmcPush(mpmc_queue* Queue, void* Item)
+{
+    usz Pos = AtomicLoad(&Queue->Tail);
+    mpmc_cell* Cell = NULL;
+    for (;;)
+    {
+        Cell = &Queue->Cells[Pos & Queue->Mask];
+        isz Diff = (isz)AtomicLoad(&Cell->Sequence) - (isz)Pos;
+        if (Diff == 0)
+        {
+            if (AtomicCompareExchange(&Queue->Tail, &Pos, Pos+1)) break;
+        }
+        else if (Diff < 0) return false; // Cell still holds the item of the last lap.
+        else Pos = AtomicLoad(&Queue->Tail);
+    }
+    
+    Cell->Item = Item;
+    AtomicStore(&Cell->Sequence, Pos+1);
+    return true;
+}
+
+external bool
+MpmcPop(mpmc_queue* Queue, void** Item)
+{
+    usz Pos = AtomicLoad(&Queue->Head);
+    mpmc_cell* Cell = NULL;
+    for (;;)
+    {
+        Cell = &Queue->Cells[Pos & Queue->Mask];
+        isz Diff = (isz)AtomicLoad(&Cell->Sequence) - (isz)(Pos+1);
+        if (Diff == 0)
+        {
+            if (AtomicCompareExchange(&Queue->Head, &Pos, Pos+1)) break;
+        }
+        else if (Diff < 0) return false; // Cell not pushed into yet.
+        else Pos = AtomicLoad(&Queue->Head);
+    }
+    
+    *Item = Cell->Item;
+    AtomicStore(&Cell->Sequence, Pos + Queue->Mask + 1);
+    return true;
+}
+
+external void
+CloseMpmcQueue(mpmc_queue* Queue)
+{
+    if (Queue->Mem.Base) FreeMemory(&Queue->Mem);
+    buffer QueueBuffer = Buffer(Queue, sizeof(mpmc_queue), sizeof(mpmc_queue));
+    ClearMemory(&QueueBuffer);
+}
+
+external blocking_queue
+InitBlockingQueue(usz Capacity, bool Shared)
+{
+    blocking_queue Result = {0};
+    Result.Shared = Shared;
+    if (Shared) Result.Mpmc = InitMpmcQueue(Capacity);
+    else Result.Spsc = InitSpscQueue(Capacity);
+    
+    if (!Result.Mpmc.Mem.Base && !Result.Spsc.Mem.Base)
+    {
+        return Result;
+    }
+    
+    Result.NotFull = InitSemaphore(0);
+    Result.NotEmpty = InitSemaphore(0);
+    return Result;
+}
+
+internal bool
+_TryQueueOp(blocking_queue* Queue, void** Item, bool Push)
+{
+    bool Result = false;
+    if (Queue->Shared) Result = (Push) ? MpmcPush(&Queue->Mpmc, *Item) : MpmcPop(&Queue->Mpmc, Item);
+    else Result = (Push) ? SpscPush(&Queue->Spsc, *Item) : SpscPop(&Queue->Spsc, Item);
+    return Result;
+}
+
+internal void
+_BlockingQueueOp(blocking_queue* Queue, void** Item, bool Push)
+{
+    volatile usz* Waiters = (Push) ? &Queue->PushWaiters : &Queue->PopWaiters;
+    semaphore* Signal = (Push) ? &Queue->NotFull : &Queue->NotEmpty;
+    
+    for (i32 Spin = 0; !_TryQueueOp(Queue, Item, Push); Spin++)
+    {
+        // OBS: Spinning is pointless if the other side can't run at the same time.
+        if (Spin < QUEUE_SPIN_COUNT && gSysInfo.NumThreads > 1)
+        {
+            if (Spin % 64 == 63) YieldThread();
+            else CpuRelax();
+            continue;
+        }
+        
+        // OBS: The waiter registers itself before the last retry, and the other side
+        // checks for waiters after its own operation, so a wake-up can't be missed.
+        // Extra wake-ups only cost another round of retries.
+        AtomicAdd(Waiters, 1);
+        bool Done = _TryQueueOp(Queue, Item, Push);
+        if (!Done) WaitOnSemaphore(Signal);
+        AtomicAdd(Waiters, (usz)-1);
+        if (Done) break;
+        Spin = 0;
+    }
+    
+    volatile usz* OtherWaiters = (Push) ? &Queue->PopWaiters : &Queue->PushWaiters;
+    if (AtomicAdd(OtherWaiters, 0))
+    {
+        IncreaseSemaphore((Push) ? &Queue->NotEmpty : &Queue->NotFull);
+    }
+}
+
+external void
+PushBlocking(blocking_queue* Queue, void* Item)
+{
+    _BlockingQueueOp(Queue, &Item, true);
+}
+
+external void*
+PopBlocking(blocking_queue* Queue)
+{
+    void* Result = NULL;
+    _BlockingQueueOp(Queue, &Result, false);
+    return Result;
+}
+
+external void
+CloseBlockingQueue(blocking_queue* Queue)
+{
+    if (Queue->Shared) CloseMpmcQueue(&Queue->Mpmc);
+    else CloseSpscQueue(&Queue->Spsc);
+    CloseSemaphore(&Queue->NotFull);
+    CloseSemaphore(&Queue->NotEmpty);
+}
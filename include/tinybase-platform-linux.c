@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/fs.h>
+#include <linux/io_uring.h>
 #include <linux/version.h>
 #include <pthread.h>
 #include <sched.h>
@@ -21,6 +22,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/sysinfo.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <time.h>
@@ -52,6 +54,52 @@ LoadSystemInfo(void)
     gSysInfo.OSVersion[0] = 'L';
     usz VerSize = sizeof(gSysInfo.OSVersion);
     CopyData(gSysInfo.OSVersion+1, VerSize-1, OSInfo.release, 4);
+    
+    FILE* MemInfo = fopen("/proc/meminfo", "r");
+    if (MemInfo)
+    {
+        char Line[256];
+        unsigned long HugeKb = 0;
+        while (fgets(Line, sizeof(Line), MemInfo))
+        {
+            if (sscanf(Line, "Hugepagesize: %lu kB", &HugeKb) == 1) break;
+        }
+        gSysInfo.HugePageSize = HugeKb * 1024;
+        fclose(MemInfo);
+    }
+    
+    gSysInfo.NumNodes = 1;
+    char NodePath[64];
+    for (int Node = 1; ; Node++)
+    {
+        snprintf(NodePath, sizeof(NodePath), "/sys/devices/system/node/node%d", Node);
+        if (access(NodePath, F_OK) != 0) break;
+        gSysInfo.NumNodes++;
+    }
+    
+    // OBS: io_uring may be missing, or disabled by sysctl or seccomp, so it's probed.
+    // IORING_OP_READ and IORING_OP_WRITE came after the ring itself (5.6 vs 5.1), so
+    // the opcodes are checked too; kernels without them keep using POSIX aio.
+    struct io_uring_params Params = {0};
+    int RingFd = (int)syscall(__NR_io_uring_setup, 1, &Params);
+    if (RingFd >= 0)
+    {
+        u8 ProbeMem[sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op)] = {0};
+        struct io_uring_probe* Probe = (struct io_uring_probe*)ProbeMem;
+        u8 Ops[] = { IORING_OP_READ, IORING_OP_WRITE,
+                     IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED };
+        
+        bool Supported = ((Params.features & IORING_FEAT_SINGLE_MMAP)
+                          && syscall(__NR_io_uring_register, RingFd, IORING_REGISTER_PROBE,
+                                     Probe, 256) == 0);
+        for (usz Idx = 0; Supported && Idx < ArrayCount(Ops); Idx++)
+        {
+            Supported = (Ops[Idx] < Probe->ops_len
+                         && (Probe->ops[Ops[Idx]].flags & IO_URING_OP_SUPPORTED));
+        }
+        gSysInfo.IoRing = Supported;
+        close(RingFd);
+    }
 }
 
 //========================================
@@ -65,8 +113,8 @@ ClearMemory(buffer* Mem)
     Mem->WriteCur = 0;
 }
 
-external buffer
-GetMemory(usz Size, void* Address, int Flags)
+internal buffer
+_GetMemory(usz Size, void* Address, int Flags)
 {
     buffer Result = {0};
     
@@ -75,16 +123,84 @@ GetMemory(usz Size, void* Address, int Flags)
     if (Flags & MEM_WRITE) Prot |= PROT_READ | PROT_WRITE;
     if (Flags & MEM_EXEC) Prot |= PROT_EXEC;
     if (Flags & MEM_GUARD) Prot = PROT_NONE;
-    void* Ptr = mmap(Address, Size, Prot, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+    
+    // OBS: Huge pages are only worth it (and only granted) for blocks of at least one.
+    bool Huge = ((Flags & MEM_HUGEPAGE)
+                 && gSysInfo.HugePageSize > 0
+                 && Size >= gSysInfo.HugePageSize);
+    void* Ptr = MAP_FAILED;
+    if (Huge)
+    {
+        AtomicAdd(&gMemStats.HugeRequested, Size);
+        usz HugeSize = Align(Size, gSysInfo.HugePageSize);
+        Ptr = mmap(Address, HugeSize, Prot, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (Ptr != MAP_FAILED)
+        {
+            AtomicAdd(&gMemStats.HugeReserved, HugeSize);
+            Result.Base = (u8*)Ptr;
+            Result.Size = HugeSize;
+            return Result;
+        }
+    }
+    
+    Ptr = mmap(Address, Size, Prot, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
     if (Ptr != MAP_FAILED)
     {
         Result.Base = (u8*)Ptr;
         Result.Size = (gSysInfo.PageSize) ? Align(Size, gSysInfo.PageSize) : Size;
+        
+        if (Huge && madvise(Ptr, Result.Size, MADV_HUGEPAGE) == 0)
+        {
+            AtomicAdd(&gMemStats.HugeMarked, Result.Size);
+        }
     }
     
     return Result;
 }
 
+external buffer
+GetMemory(usz Size, void* Address, int Flags)
+{
+    return _GetMemory(Size, Address, Flags);
+}
+
+external buffer
+GetMemoryOnNode(usz Size, i32 Node, int Flags)
+{
+    buffer Result = _GetMemory(Size, 0, Flags);
+    if (Result.Base)
+    {
+        AtomicAdd(&gMemStats.NodeRequested, Result.Size);
+        
+        // OBS: Pages are only placed when first touched, so binding right after the
+        // mapping places all of them.
+        if (Node == NODE_LOCAL) Node = GetCurrentNode();
+        unsigned long NodeMask[16] = {0}; // MPOL_BIND mask for up to 1024 nodes.
+        usz MaskBits = sizeof(NodeMask) * 8;
+        if (Node >= 0 && (usz)Node < MaskBits)
+        {
+            NodeMask[Node / (sizeof(unsigned long) * 8)] |= 1UL << (Node % (sizeof(unsigned long) * 8));
+            if (syscall(SYS_mbind, Result.Base, Result.Size, 2 /*MPOL_BIND*/,
+                        NodeMask, MaskBits + 1, 0) == 0)
+            {
+                AtomicAdd(&gMemStats.NodeBound, Result.Size);
+            }
+        }
+    }
+    return Result;
+}
+
+external i32
+GetCurrentNode(void)
+{
+    unsigned int Cpu = 0, Node = 0;
+    if (syscall(SYS_getcpu, &Cpu, &Node, 0) != 0)
+    {
+        return 0;
+    }
+    return (i32)Node;
+}
+
 external void
 FreeMemory(buffer* Mem)
 {
@@ -92,6 +208,40 @@ FreeMemory(buffer* Mem)
     memset(Mem, 0, sizeof(buffer));
 }
 
+external buffer
+ReserveMemory(usz Size)
+{
+    buffer Result = {0};
+    void* Ptr = mmap(0, Size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (Ptr != MAP_FAILED)
+    {
+        Result.Base = (u8*)Ptr;
+        Result.Size = (gSysInfo.PageSize) ? Align(Size, gSysInfo.PageSize) : Size;
+    }
+    return Result;
+}
+
+external bool
+CommitMemory(void* Address, usz Size, int Flags)
+{
+    int Prot = 0;
+    if (Flags & MEM_READ) Prot |= PROT_READ;
+    if (Flags & MEM_WRITE) Prot |= PROT_READ | PROT_WRITE;
+    if (Flags & MEM_EXEC) Prot |= PROT_EXEC;
+    if (Flags & MEM_GUARD) Prot = PROT_NONE;
+    
+    bool Result = (mprotect(Address, Size, Prot) == 0);
+    if (Result && (Flags & MEM_HUGEPAGE))
+    {
+        AtomicAdd(&gMemStats.HugeRequested, Size);
+        if (madvise(Address, Size, MADV_HUGEPAGE) == 0)
+        {
+            AtomicAdd(&gMemStats.HugeMarked, Size);
+        }
+    }
+    return Result;
+}
+
 external buffer
 GetMemoryFromHeap(usz Size)
 {
@@ -265,24 +415,36 @@ ReadEntireFile(file File)
     return Mem;
 }
 
-external bool
-ReadFileAsync(file File, buffer* Dst, usz AmountToRead, usz StartPos, async* Async)
+external buffer
+MapFileToMemory(file File, int Flags)
 {
-    if (AmountToRead <= (Dst->Size - Dst->WriteCur))
+    buffer Result = {0};
+    
+    usz FileSize = FileSizeOf(File);
+    if (FileSize > 0 && FileSize != USZ_MAX)
     {
-        struct aiocb* Context = (struct aiocb*)Async->Data;
-        Context->aio_fildes = (int)File;
-        Context->aio_buf = (void*)Dst->Base;
-        Context->aio_nbytes = AmountToRead;
-        Context->aio_offset = (off_t)StartPos;
-        
-        if (aio_read(Context) == 0)
+        int Prot = PROT_READ;
+        if (Flags & MEM_WRITE) Prot |= PROT_WRITE;
+        void* Ptr = mmap(0, FileSize, Prot, MAP_PRIVATE, (int)File, 0);
+        if (Ptr != MAP_FAILED)
         {
-            Dst->WriteCur += AmountToRead;
-            return true;
+            Result.Base = (u8*)Ptr;
+            Result.Size = FileSize;
+            Result.WriteCur = FileSize;
         }
     }
-    return false;
+    
+    return Result;
+}
+
+external void
+UnmapFileFromMemory(buffer* Mem)
+{
+    if (Mem->Base)
+    {
+        munmap(Mem->Base, Mem->Size);
+    }
+    memset(Mem, 0, sizeof(buffer));
 }
 
 external bool
@@ -308,41 +470,6 @@ WriteToFile(file File, buffer Content, usz StartPos)
     return Result;
 }
 
-external bool
-WriteFileAsync(file File, void* Src, usz AmountToWrite, usz StartPos, async* Async)
-{
-    struct aiocb* Context = (struct aiocb*)Async->Data;
-    Context->aio_fildes = (int)File;
-    Context->aio_buf = Src;
-    Context->aio_nbytes = AmountToWrite;
-    Context->aio_offset = (off_t)StartPos;
-    
-    bool Result = !aio_write(Context);
-    return Result;
-}
-
-external usz
-WaitOnIoCompletion(file File, async* Async, bool Block)
-{
-    struct aiocb* Context = (struct aiocb*)Async->Data;
-    struct timespec* WaitTime = 0;
-    if (!Block)
-    {
-        WaitTime = (struct timespec*)&Context[1];
-        WaitTime->tv_sec = 0;
-        WaitTime->tv_nsec = 0;
-    }
-    
-    const struct aiocb* const CtxList[1] = { Context };
-    if (aio_suspend(CtxList, 1, WaitTime) == 0)
-    {
-        usz BytesTransferred = aio_return(Context);
-        return BytesTransferred;
-    }
-    
-    return 0;
-}
-
 external usz
 FileLastWriteTime(file File)
 {
@@ -418,6 +545,538 @@ IsFileHidden(void* Filename)
     return Result;
 }
 
+//========================================
+// Async IO
+//========================================
+
+#define IO_RING_ENTRIES 256
+#define IO_RING_MAX_BUFFERS 16
+
+#define ASYNC_AIO  1
+#define ASYNC_RING 2
+
+struct io_ring;
+
+typedef struct linux_async
+{
+    struct aiocb Context;
+    struct timespec WaitTime;
+    volatile i32 Result;
+    volatile u16 Done;
+    u16 Backend;
+    struct io_ring* Ring; // Ring the IO was queued on, if [Backend] is ASYNC_RING.
+} linux_async;
+
+typedef struct io_ring
+{
+    i32 State; // 0 if not set up yet, 1 if ready, -1 if unavailable.
+    int Fd;
+    pthread_mutex_t Lock; // Held for any use of the ring, except sleeping on it.
+    pthread_cond_t Reaped; // Signaled by the thread sleeping on the ring after it reaps.
+    bool Sleeping;         // A thread is in the kernel waiting for completions.
+    u32* SqTail;
+    u32* SqMask;
+    u32* SqArray;
+    u32* CqHead;
+    u32* CqTail;
+    u32* CqMask;
+    struct io_uring_cqe* Cqes;
+    struct io_uring_sqe* Sqes;
+    u32 CqEntries;
+    u32 Pending;  // Queued, not submitted yet.
+    u32 InFlight; // Queued or submitted, not reaped yet.
+    bool Batching;
+    i32 NumBuffers;    // Buffers asked for by RegisterIoBuffers(), each with a count.
+    i32 NumRegistered; // Buffers registered with the kernel (all of them, or none).
+    buffer Buffers[IO_RING_MAX_BUFFERS];
+    u32 BufferRefs[IO_RING_MAX_BUFFERS];
+    buffer RingMem;
+    buffer SqeMem;
+} io_ring;
+
+global thread_local io_ring gIoRing = {0};
+global pthread_key_t gIoRingKey;
+global pthread_once_t gIoRingKeyOnce = PTHREAD_ONCE_INIT;
+global bool gIoRingKeyReady;
+
+internal void
+_ReapIoRing(io_ring* Ring)
+{
+    // OBS: While a thread sleeps on the ring, only it reaps; if its completion were taken
+    // before it got into the kernel, it could sleep waiting for one that never comes.
+    if (Ring->Sleeping)
+    {
+        return;
+    }
+    
+    u32 Head = *Ring->CqHead;
+    u32 Tail = __atomic_load_n(Ring->CqTail, __ATOMIC_ACQUIRE);
+    for (; Head != Tail; Head++)
+    {
+        struct io_uring_cqe* Cqe = &Ring->Cqes[Head & *Ring->CqMask];
+        linux_async* Async = (linux_async*)(usz)Cqe->user_data;
+        Async->Result = Cqe->res;
+        Async->Done = 1;
+        Ring->InFlight--;
+    }
+    __atomic_store_n(Ring->CqHead, Head, __ATOMIC_RELEASE);
+}
+
+internal bool
+_SubmitIoRing(io_ring* Ring)
+{
+    while (Ring->Pending > 0)
+    {
+        int Submitted = (int)syscall(__NR_io_uring_enter, Ring->Fd, Ring->Pending, 0, 0, NULL, 0);
+        if (Submitted < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        Ring->Pending -= (u32)Submitted;
+    }
+    return true;
+}
+
+internal bool
+_WaitIoRing(io_ring* Ring)
+{
+    // OBS: Called with [Ring->Lock] held, and returns with it held. The lock is released
+    // while sleeping in the kernel, so the owner of the ring can keep queueing IO. Only
+    // one thread sleeps at a time, the others wait for it to reap and check again.
+    if (Ring->Sleeping)
+    {
+        pthread_cond_wait(&Ring->Reaped, &Ring->Lock);
+        return true;
+    }
+    
+    Ring->Sleeping = true;
+    pthread_mutex_unlock(&Ring->Lock);
+    int Result = (int)syscall(__NR_io_uring_enter, Ring->Fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    bool Woken = (Result >= 0 || errno == EINTR);
+    pthread_mutex_lock(&Ring->Lock);
+    Ring->Sleeping = false;
+    _ReapIoRing(Ring);
+    pthread_cond_broadcast(&Ring->Reaped);
+    return Woken;
+}
+
+internal void
+_CloseIoRing(void* Arg)
+{
+    // OBS: Runs as the key destructor when the thread exits. IO still in flight is
+    // waited on first, so the kernel doesn't write into buffers the caller frees next.
+    io_ring* Ring = (io_ring*)Arg;
+    if (Ring->State > 0)
+    {
+        pthread_mutex_lock(&Ring->Lock);
+        while (Ring->InFlight > 0)
+        {
+            if (!_SubmitIoRing(Ring) || !_WaitIoRing(Ring)) break;
+            _ReapIoRing(Ring);
+        }
+        pthread_mutex_unlock(&Ring->Lock);
+        pthread_mutex_destroy(&Ring->Lock);
+        pthread_cond_destroy(&Ring->Reaped);
+    }
+    
+    if (Ring->SqeMem.Base) munmap(Ring->SqeMem.Base, Ring->SqeMem.Size);
+    if (Ring->RingMem.Base) munmap(Ring->RingMem.Base, Ring->RingMem.Size);
+    if (Ring->Fd >= 0) close(Ring->Fd);
+    memset(Ring, 0, sizeof(io_ring));
+}
+
+internal void
+_CreateIoRingKey(void)
+{
+    gIoRingKeyReady = (pthread_key_create(&gIoRingKey, _CloseIoRing) == 0);
+}
+
+internal io_ring*
+_GetIoRing(void)
+{
+    io_ring* Ring = &gIoRing;
+    if (Ring->State != 0)
+    {
+        return (Ring->State > 0) ? Ring : NULL;
+    }
+    
+    Ring->State = -1;
+    Ring->Fd = -1;
+    pthread_once(&gIoRingKeyOnce, _CreateIoRingKey);
+    if (!gSysInfo.IoRing || !gIoRingKeyReady)
+    {
+        return NULL;
+    }
+    
+    struct io_uring_params Params = {0};
+    Ring->Fd = (int)syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &Params);
+    if (Ring->Fd < 0)
+    {
+        return NULL;
+    }
+    
+    // OBS: With IORING_FEAT_SINGLE_MMAP (checked by LoadSystemInfo) both rings share
+    // one mapping, so only the larger of the two sizes is mapped.
+    usz SqSize = Params.sq_off.array + Params.sq_entries * sizeof(u32);
+    usz CqSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+    usz RingSize = Max(SqSize, CqSize);
+    usz SqeSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+    u8* RingPtr = (u8*)mmap(0, RingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                            Ring->Fd, IORING_OFF_SQ_RING);
+    if (RingPtr != MAP_FAILED) Ring->RingMem = Buffer(RingPtr, RingSize, RingSize);
+    u8* SqePtr = (u8*)mmap(0, SqeSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                           Ring->Fd, IORING_OFF_SQES);
+    if (SqePtr != MAP_FAILED) Ring->SqeMem = Buffer(SqePtr, SqeSize, SqeSize);
+    if (!Ring->RingMem.Base || !Ring->SqeMem.Base
+        || pthread_setspecific(gIoRingKey, Ring) != 0)
+    {
+        _CloseIoRing(Ring);
+        Ring->State = -1;
+        return NULL;
+    }
+    
+    Ring->SqTail = (u32*)(RingPtr + Params.sq_off.tail);
+    Ring->SqMask = (u32*)(RingPtr + Params.sq_off.ring_mask);
+    Ring->SqArray = (u32*)(RingPtr + Params.sq_off.array);
+    Ring->CqHead = (u32*)(RingPtr + Params.cq_off.head);
+    Ring->CqTail = (u32*)(RingPtr + Params.cq_off.tail);
+    Ring->CqMask = (u32*)(RingPtr + Params.cq_off.ring_mask);
+    Ring->Cqes = (struct io_uring_cqe*)(RingPtr + Params.cq_off.cqes);
+    Ring->Sqes = (struct io_uring_sqe*)SqePtr;
+    Ring->CqEntries = Params.cq_entries;
+    pthread_mutex_init(&Ring->Lock, NULL);
+    pthread_cond_init(&Ring->Reaped, NULL);
+    Ring->State = 1;
+    
+    return Ring;
+}
+
+internal bool
+_QueueIoRing(io_ring* Ring, u8 Op, file File, void* Ptr, usz Size, usz Pos, linux_async* Async)
+{
+    // OBS: Completions are only reaped while waiting, so the CQ ring can't be allowed to
+    // overflow; if it'd be full, this waits for some IO to finish first.
+    u32 SqEntries = *Ring->SqMask + 1;
+    while (Ring->InFlight >= Ring->CqEntries)
+    {
+        if (!_SubmitIoRing(Ring) || !_WaitIoRing(Ring)) return false;
+        _ReapIoRing(Ring);
+    }
+    if (Ring->Pending == SqEntries && !_SubmitIoRing(Ring))
+    {
+        return false;
+    }
+    
+    u32 Tail = *Ring->SqTail;
+    u32 Idx = Tail & *Ring->SqMask;
+    struct io_uring_sqe* Sqe = &Ring->Sqes[Idx];
+    memset(Sqe, 0, sizeof(struct io_uring_sqe));
+    Sqe->opcode = Op;
+    Sqe->fd = (int)File;
+    Sqe->addr = (usz)Ptr;
+    Sqe->len = (u32)Size;
+    Sqe->off = Pos;
+    Sqe->user_data = (usz)Async;
+    
+    for (i32 BufIdx = 0; BufIdx < Ring->NumRegistered; BufIdx++)
+    {
+        buffer* Buf = &Ring->Buffers[BufIdx];
+        if ((u8*)Ptr >= Buf->Base && (u8*)Ptr + Size <= Buf->Base + Buf->Size)
+        {
+            Sqe->opcode = (Op == IORING_OP_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            Sqe->buf_index = (u16)BufIdx;
+            break;
+        }
+    }
+    
+    Async->Backend = ASYNC_RING;
+    Async->Ring = Ring;
+    Async->Done = 0;
+    Ring->SqArray[Idx] = Idx;
+    __atomic_store_n(Ring->SqTail, Tail+1, __ATOMIC_RELEASE);
+    Ring->Pending++;
+    Ring->InFlight++;
+    
+    bool Result = (Ring->Batching) ? true : _SubmitIoRing(Ring);
+    if (!Result)
+    {
+        // OBS: Entries are submitted in order, so this one is still the last pending. It's
+        // taken back, or the kernel would later complete it into a stale [Async].
+        __atomic_store_n(Ring->SqTail, Tail, __ATOMIC_RELEASE);
+        Ring->Pending--;
+        Ring->InFlight--;
+        Async->Result = -1;
+        Async->Done = 1;
+    }
+    return Result;
+}
+
+internal bool
+_QueueIoRingLocked(io_ring* Ring, u8 Op, file File, void* Ptr, usz Size, usz Pos,
+                   linux_async* Async)
+{
+    pthread_mutex_lock(&Ring->Lock);
+    bool Result = _QueueIoRing(Ring, Op, File, Ptr, Size, Pos, Async);
+    pthread_mutex_unlock(&Ring->Lock);
+    return Result;
+}
+
+external void
+BeginIoBatch(void)
+{
+    io_ring* Ring = _GetIoRing();
+    if (Ring)
+    {
+        pthread_mutex_lock(&Ring->Lock);
+        Ring->Batching = true;
+        pthread_mutex_unlock(&Ring->Lock);
+    }
+}
+
+external bool
+SubmitIoBatch(void)
+{
+    io_ring* Ring = _GetIoRing();
+    bool Result = true;
+    if (Ring)
+    {
+        pthread_mutex_lock(&Ring->Lock);
+        Ring->Batching = false;
+        Result = _SubmitIoRing(Ring);
+        pthread_mutex_unlock(&Ring->Lock);
+    }
+    return Result;
+}
+
+internal bool
+_SyncIoBuffers(io_ring* Ring)
+{
+    // OBS: The kernel refuses to change buffers while IO using them is in flight, and
+    // the table can only be replaced whole (in-place updates need 5.13).
+    while (Ring->InFlight > 0)
+    {
+        if (!_SubmitIoRing(Ring) || !_WaitIoRing(Ring)) return false;
+        _ReapIoRing(Ring);
+    }
+    if (Ring->NumRegistered > 0)
+    {
+        syscall(__NR_io_uring_register, Ring->Fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        Ring->NumRegistered = 0;
+    }
+    if (Ring->NumBuffers == 0)
+    {
+        return true;
+    }
+    
+    struct iovec Vecs[IO_RING_MAX_BUFFERS];
+    for (i32 Idx = 0; Idx < Ring->NumBuffers; Idx++)
+    {
+        Vecs[Idx].iov_base = Ring->Buffers[Idx].Base;
+        Vecs[Idx].iov_len = Ring->Buffers[Idx].Size;
+    }
+    if (syscall(__NR_io_uring_register, Ring->Fd, IORING_REGISTER_BUFFERS,
+                Vecs, Ring->NumBuffers) != 0)
+    {
+        return false;
+    }
+    Ring->NumRegistered = Ring->NumBuffers;
+    return true;
+}
+
+internal i32
+_FindIoBuffer(io_ring* Ring, buffer* Buffer)
+{
+    for (i32 Idx = 0; Idx < Ring->NumBuffers; Idx++)
+    {
+        if (Ring->Buffers[Idx].Base == Buffer->Base && Ring->Buffers[Idx].Size == Buffer->Size)
+        {
+            return Idx;
+        }
+    }
+    return -1;
+}
+
+internal bool
+_RemoveIoBuffers(io_ring* Ring, buffer* Buffers, i32 Count)
+{
+    bool Changed = false;
+    for (i32 Idx = 0; Idx < Count; Idx++)
+    {
+        i32 Found = _FindIoBuffer(Ring, &Buffers[Idx]);
+        if (Found >= 0 && --Ring->BufferRefs[Found] == 0)
+        {
+            Ring->NumBuffers--;
+            Ring->Buffers[Found] = Ring->Buffers[Ring->NumBuffers];
+            Ring->BufferRefs[Found] = Ring->BufferRefs[Ring->NumBuffers];
+            Changed = true;
+        }
+    }
+    return Changed;
+}
+
+internal bool
+_AddIoBuffers(io_ring* Ring, buffer* Buffers, i32 Count)
+{
+    i32 NumNew = 0;
+    for (i32 Idx = 0; Idx < Count; Idx++)
+    {
+        if (_FindIoBuffer(Ring, &Buffers[Idx]) < 0) NumNew++;
+    }
+    if (Ring->NumBuffers + NumNew > IO_RING_MAX_BUFFERS)
+    {
+        return false;
+    }
+    
+    for (i32 Idx = 0; Idx < Count; Idx++)
+    {
+        i32 Found = _FindIoBuffer(Ring, &Buffers[Idx]);
+        if (Found < 0)
+        {
+            Found = Ring->NumBuffers++;
+            Ring->Buffers[Found] = Buffers[Idx];
+            Ring->BufferRefs[Found] = 0;
+        }
+        Ring->BufferRefs[Found]++;
+    }
+    if (NumNew > 0 && !_SyncIoBuffers(Ring))
+    {
+        // Leaves the ring with the buffers it had before.
+        _RemoveIoBuffers(Ring, Buffers, Count);
+        _SyncIoBuffers(Ring);
+        return false;
+    }
+    return true;
+}
+
+external bool
+RegisterIoBuffers(buffer* Buffers, i32 Count)
+{
+    io_ring* Ring = _GetIoRing();
+    bool Result = false;
+    if (Ring)
+    {
+        pthread_mutex_lock(&Ring->Lock);
+        Result = _AddIoBuffers(Ring, Buffers, Count);
+        pthread_mutex_unlock(&Ring->Lock);
+    }
+    return Result;
+}
+
+external void
+UnregisterIoBuffers(buffer* Buffers, i32 Count)
+{
+    io_ring* Ring = _GetIoRing();
+    if (Ring)
+    {
+        pthread_mutex_lock(&Ring->Lock);
+        if (_RemoveIoBuffers(Ring, Buffers, Count)) _SyncIoBuffers(Ring);
+        pthread_mutex_unlock(&Ring->Lock);
+    }
+}
+
+external bool
+ReadFileAsync(file File, buffer* Dst, usz AmountToRead, usz StartPos, async* Async)
+{
+    if (AmountToRead <= (Dst->Size - Dst->WriteCur))
+    {
+        linux_async* Context = (linux_async*)Async->Data;
+        io_ring* Ring = (AmountToRead <= U32_MAX) ? _GetIoRing() : NULL;
+        if (Ring)
+        {
+            if (_QueueIoRingLocked(Ring, IORING_OP_READ, File, Dst->Base, AmountToRead,
+                                   StartPos, Context))
+            {
+                Dst->WriteCur += AmountToRead;
+                return true;
+            }
+            return false;
+        }
+        
+        Context->Backend = ASYNC_AIO;
+        Context->Context.aio_fildes = (int)File;
+        Context->Context.aio_buf = (void*)Dst->Base;
+        Context->Context.aio_nbytes = AmountToRead;
+        Context->Context.aio_offset = (off_t)StartPos;
+        
+        if (aio_read(&Context->Context) == 0)
+        {
+            Dst->WriteCur += AmountToRead;
+            return true;
+        }
+    }
+    return false;
+}
+
+external bool
+WriteFileAsync(file File, void* Src, usz AmountToWrite, usz StartPos, async* Async)
+{
+    linux_async* Context = (linux_async*)Async->Data;
+    io_ring* Ring = (AmountToWrite <= U32_MAX) ? _GetIoRing() : NULL;
+    if (Ring)
+    {
+        bool Result = _QueueIoRingLocked(Ring, IORING_OP_WRITE, File, Src, AmountToWrite,
+                                         StartPos, Context);
+        return Result;
+    }
+    
+    Context->Backend = ASYNC_AIO;
+    Context->Context.aio_fildes = (int)File;
+    Context->Context.aio_buf = Src;
+    Context->Context.aio_nbytes = AmountToWrite;
+    Context->Context.aio_offset = (off_t)StartPos;
+    
+    bool Result = !aio_write(&Context->Context);
+    return Result;
+}
+
+external usz
+WaitOnIoCompletion(file File, async* Async, bool Block)
+{
+    linux_async* Context = (linux_async*)Async->Data;
+    if (Context->Backend == ASYNC_RING)
+    {
+        // OBS: Polling the completion ring needs no syscall, the kernel is only entered
+        // to sleep when blocking. The wait goes to the ring the IO was queued on, which
+        // may be another thread's; _WaitIoRing() lets go of its lock while sleeping.
+        io_ring* Ring = Context->Ring;
+        if (!Context->Done)
+        {
+            bool Failed = false;
+            pthread_mutex_lock(&Ring->Lock);
+            while (!Context->Done)
+            {
+                if (!_SubmitIoRing(Ring)) { Failed = true; break; }
+                _ReapIoRing(Ring);
+                if (Context->Done || !Block) break;
+                if (!_WaitIoRing(Ring)) { Failed = true; break; }
+            }
+            pthread_mutex_unlock(&Ring->Lock);
+            if (Failed) return 0;
+        }
+        
+        usz Result = (Context->Done && Context->Result > 0) ? (usz)Context->Result : 0;
+        return Result;
+    }
+    
+    struct timespec* WaitTime = 0;
+    if (!Block)
+    {
+        WaitTime = &Context->WaitTime;
+        WaitTime->tv_sec = 0;
+        WaitTime->tv_nsec = 0;
+    }
+    
+    const struct aiocb* const CtxList[1] = { &Context->Context };
+    if (aio_suspend(CtxList, 1, WaitTime) == 0)
+    {
+        usz BytesTransferred = aio_return(&Context->Context);
+        return BytesTransferred;
+    }
+    
+    return 0;
+}
+
 //========================================
 // Filesystem
 //========================================
@@ -873,6 +1532,12 @@ WaitOnThread(thread* Thread)
     return false;
 }
 
+external void
+YieldThread(void)
+{
+    sched_yield();
+}
+
 external bool
 KillThread(thread* Thread)
 {
@@ -943,5 +1608,5 @@ external bool
 WaitOnSemaphore(semaphore* Semaphore)
 {
     int Result = sem_wait((sem_t*)Semaphore->Handle);
-    return Result;
+    return (Result == 0);
 }
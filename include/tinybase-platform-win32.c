@@ -28,6 +28,12 @@ LoadSystemInfo(void)
     QueryPerformanceFrequency(&Freq);
     gSysInfo.TimingFreq = (f64)Freq.QuadPart;
     
+    // OBS: Large pages also need the "Lock pages in memory" privilege, without it
+    // allocations fall back to regular pages.
+    gSysInfo.HugePageSize = GetLargePageMinimum();
+    ULONG HighestNode = 0;
+    gSysInfo.NumNodes = (GetNumaHighestNodeNumber(&HighestNode)) ? HighestNode + 1 : 1;
+    
     usz VerSize = sizeof(gSysInfo.OSVersion);
     if (IsWindowsServer())
     {
@@ -62,8 +68,8 @@ ClearMemory(buffer* Mem)
     Mem->WriteCur = 0;
 }
 
-external buffer
-GetMemory(usz Size, void* Address, int Flags)
+internal buffer
+_GetMemory(usz Size, void* Address, int Flags, DWORD Node)
 {
     buffer Result = {0};
     
@@ -87,10 +93,25 @@ GetMemory(usz Size, void* Address, int Flags)
         Access = PAGE_READONLY;
     }
     
-    DWORD HugePages = ((Flags & MEM_HUGEPAGE) > 0) ? MEM_LARGE_PAGES : 0;
-    DWORD AllocType = MEM_RESERVE | MEM_COMMIT | HugePages;
+    HANDLE Process = GetCurrentProcess();
+    if ((Flags & MEM_HUGEPAGE)
+        && gSysInfo.HugePageSize > 0
+        && Size >= gSysInfo.HugePageSize)
+    {
+        AtomicAdd(&gMemStats.HugeRequested, Size);
+        usz HugeSize = Align(Size, gSysInfo.HugePageSize);
+        DWORD AllocType = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+        void* Ptr = VirtualAllocExNuma(Process, Address, HugeSize, AllocType, Access, Node);
+        if (Ptr)
+        {
+            AtomicAdd(&gMemStats.HugeReserved, HugeSize);
+            Result.Base = (u8*)Ptr;
+            Result.Size = HugeSize;
+            return Result;
+        }
+    }
     
-    void* Ptr = VirtualAlloc(Address, Size, AllocType, Access);
+    void* Ptr = VirtualAllocExNuma(Process, Address, Size, MEM_RESERVE | MEM_COMMIT, Access, Node);
     if (Ptr)
     {
         Result.Base = (u8*)Ptr;
@@ -99,6 +120,44 @@ GetMemory(usz Size, void* Address, int Flags)
     return Result;
 }
 
+external buffer
+GetMemory(usz Size, void* Address, int Flags)
+{
+    return _GetMemory(Size, Address, Flags, NUMA_NO_PREFERRED_NODE);
+}
+
+external buffer
+GetMemoryOnNode(usz Size, i32 Node, int Flags)
+{
+    if (Node == NODE_LOCAL) Node = GetCurrentNode();
+    
+    // OBS: Windows only takes the node as a preference, so a block is counted as bound
+    // when it was requested on an existing node.
+    buffer Result = _GetMemory(Size, 0, Flags, (DWORD)Node);
+    if (Result.Base)
+    {
+        AtomicAdd(&gMemStats.NodeRequested, Result.Size);
+        if (Node >= 0 && (usz)Node < gSysInfo.NumNodes)
+        {
+            AtomicAdd(&gMemStats.NodeBound, Result.Size);
+        }
+    }
+    return Result;
+}
+
+external i32
+GetCurrentNode(void)
+{
+    PROCESSOR_NUMBER Processor;
+    GetCurrentProcessorNumberEx(&Processor);
+    USHORT Node = 0;
+    if (!GetNumaProcessorNodeEx(&Processor, &Node))
+    {
+        return 0;
+    }
+    return (i32)Node;
+}
+
 external void
 FreeMemory(buffer* Mem)
 {
@@ -106,6 +165,32 @@ FreeMemory(buffer* Mem)
     memset(Mem, 0, sizeof(buffer));
 }
 
+external buffer
+ReserveMemory(usz Size)
+{
+    buffer Result = {0};
+    void* Ptr = VirtualAlloc(0, Size, MEM_RESERVE, PAGE_NOACCESS);
+    if (Ptr)
+    {
+        Result.Base = (u8*)Ptr;
+        Result.Size = (gSysInfo.PageSize) ? Align(Size, gSysInfo.PageSize) : Size;
+    }
+    return Result;
+}
+
+external bool
+CommitMemory(void* Address, usz Size, int Flags)
+{
+    DWORD Access = 0;
+    if (Flags & MEM_GUARD) Access = PAGE_NOACCESS;
+    else if (Flags & MEM_EXEC) Access = (Flags & MEM_WRITE) ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ;
+    else if (Flags & MEM_WRITE) Access = PAGE_READWRITE;
+    else Access = PAGE_READONLY;
+    
+    bool Result = (VirtualAlloc(Address, Size, MEM_COMMIT, Access) != NULL);
+    return Result;
+}
+
 external buffer
 GetMemoryFromHeap(usz SizeToAllocate)
 {
@@ -257,6 +342,44 @@ ReadEntireFile(file File)
     return Mem;
 }
 
+external buffer
+MapFileToMemory(file File, int Flags)
+{
+    buffer Result = {0};
+    
+    usz FileSize = FileSizeOf(File);
+    if (FileSize > 0 && FileSize != USZ_MAX)
+    {
+        DWORD Protect = (Flags & MEM_WRITE) ? PAGE_WRITECOPY : PAGE_READONLY;
+        DWORD Access = (Flags & MEM_WRITE) ? FILE_MAP_COPY : FILE_MAP_READ;
+        HANDLE Mapping = CreateFileMappingW((HANDLE)File, NULL, Protect, 0, 0, NULL);
+        if (Mapping)
+        {
+            void* Ptr = MapViewOfFile(Mapping, Access, 0, 0, 0);
+            if (Ptr)
+            {
+                Result.Base = (u8*)Ptr;
+                Result.Size = FileSize;
+                Result.WriteCur = FileSize;
+            }
+            // OBS: The view keeps its own reference to the mapping object.
+            CloseHandle(Mapping);
+        }
+    }
+    
+    return Result;
+}
+
+external void
+UnmapFileFromMemory(buffer* Mem)
+{
+    if (Mem->Base)
+    {
+        UnmapViewOfFile(Mem->Base);
+    }
+    memset(Mem, 0, sizeof(buffer));
+}
+
 external bool
 ReadFileAsync(file File, buffer* Dst, usz AmountToRead, usz StartPos, async* Async)
 {
@@ -355,6 +478,31 @@ WaitOnIoCompletion(file File, async* Async, bool Block)
     return BytesTransferred;
 }
 
+// OBS: Overlapped IO is always started right away, so batching has no effect here, and
+// there's no buffer registration without moving to IoRing/registered IO.
+
+external void
+BeginIoBatch(void)
+{
+}
+
+external bool
+SubmitIoBatch(void)
+{
+    return true;
+}
+
+external bool
+RegisterIoBuffers(buffer* Buffers, i32 Count)
+{
+    return false;
+}
+
+external void
+UnregisterIoBuffers(buffer* Buffers, i32 Count)
+{
+}
+
 external usz
 FileLastWriteTime(file File)
 {
@@ -834,6 +982,12 @@ WaitOnThread(thread* Thread)
     return false;
 }
 
+external void
+YieldThread(void)
+{
+    SwitchToThread();
+}
+
 external bool
 KillThread(thread* Thread)
 {
@@ -32,7 +32,7 @@ typedef u32 (*thread_proc)(void*);
 #elif defined(TT_LINUX)
 # define MAX_PATH_SIZE 4096
 # define INVALID_FILE USZ_MAX
-# define ASYNC_DATA_SIZE 184 // aiocb struct + timespec struct.
+# define ASYNC_DATA_SIZE 200 // aiocb struct + timespec struct + io_uring result.
 # define DYNAMIC_LIB_EXT ".so"
 # define MUTEX_SIZE 40 // Size of pthread_mutex_t
 # define SEMAPHORE_SIZE 32 // Size of sem_t
@@ -54,6 +54,9 @@ typedef struct sys_info
     isz AddressRange[2];
     f64 TimingFreq;
     char OSVersion[8];
+    usz HugePageSize; // 0 if the system has no huge pages.
+    usz NumNodes;     // NUMA nodes, 1 on non-NUMA systems.
+    bool IoRing;      // Async IO goes through io_uring (Linux only), can be turned off.
 } sys_info;
 global sys_info gSysInfo = {0};
 
@@ -72,7 +75,19 @@ external void LoadSystemInfo(void);
 #define MEM_GUARD    0x4  // Marks memory pages as untouchable (takes precedence over
 //                           others).
 #define MEM_EXEC     0x8  // Marks memory pages as executable.
-#define MEM_HUGEPAGE 0x10 // Reserves large memory pages, if the system supports.
+#define MEM_HUGEPAGE 0x10 // Backs memory with huge pages when possible (see gMemStats).
+
+#define NODE_LOCAL -1 // NUMA node of the calling thread.
+
+typedef struct mem_stats
+{
+    usz HugeRequested; // Bytes asked for with MEM_HUGEPAGE, at least a huge page long.
+    usz HugeReserved;  // Bytes obtained from the huge pages reserved in the system.
+    usz HugeMarked;    // Bytes marked for transparent huge pages, not all of them get one.
+    usz NodeRequested; // Bytes asked for with GetMemoryOnNode().
+    usz NodeBound;     // Bytes actually bound to the requested node.
+} mem_stats;
+global mem_stats gMemStats = {0};
 
 external buffer GetMemory(usz Size, _opt void* Address, _opt int AccessFlags);
 
@@ -80,8 +95,24 @@ external buffer GetMemory(usz Size, _opt void* Address, _opt int AccessFlags);
  |  guaranteed to be zeroed. A start [Address] can optionally be passed (system will
  |  choose random address if this is NULL). [AccessFlags] determines memory block
  |  behaviour; if none is passed, block is set to read-only.
+ |  With MEM_HUGEPAGE, blocks of at least [gSysInfo.HugePageSize] are rounded up to it
+ |  and taken from the reserved huge pages, or else from regular pages marked for
+ |  transparent huge pages (Linux only); [gMemStats] counts the bytes taken each way.
+ |  Such a block must be freed with the [.Size] returned here.
  |--- Return: buffer of allocated memory if successful, empty otherwise. */
 
+external buffer GetMemoryOnNode(usz Size, i32 Node, _opt int AccessFlags);
+
+/* Same as GetMemory(), but binds the block to NUMA [Node] (0 to gSysInfo.NumNodes - 1),
+ |  or to the node of the calling thread if NODE_LOCAL, so a thread working on it only
+ |  touches local memory. If the binding fails the block is still returned, unbound.
+ |--- Return: buffer of allocated memory if successful, empty otherwise. */
+
+external i32 GetCurrentNode(void);
+
+/* Gets the NUMA node of the processor the calling thread is running on.
+ |--- Return: node index, 0 if unknown. */
+
 external void ClearMemory(buffer* Mem);
 
 /* Clears entire buffer in [Mem] to zero.
@@ -102,6 +133,59 @@ external void FreeMemoryFromHeap(buffer* Mem);
 /* Frees memory chunk allocated with GetMemoryFromHeap().
  |--- Return: nothing. */
 
+external buffer ReserveMemory(usz Size);
+
+/* Reserves [Size] bytes of address space, rounded up to system page size, without
+ |  backing it with memory: pages can't be touched until committed with CommitMemory().
+ |  The whole range is released at once with FreeMemory().
+ |--- Return: buffer of reserved range if successful, empty otherwise. */
+
+external bool CommitMemory(void* Address, usz Size, int AccessFlags);
+
+/* Commits [Size] bytes starting at [Address], inside a range from ReserveMemory(),
+ |  with the same [AccessFlags] as GetMemory(). Committed pages are zeroed, and only
+ |  take physical memory when first touched. MEM_HUGEPAGE can only ask for transparent
+ |  huge pages here (Linux only), as reserved ones can't be committed piecemeal.
+ |--- Return: true if successful, false if not. */
+
+typedef struct grow_arena
+{
+    u8* Base;
+    usz WriteCur;
+    usz Size;     // Bytes committed so far.
+    usz Reserved; // Bytes of address space reserved, the arena never moves or grows past it.
+    int Flags;
+} grow_arena;
+
+#define PushGrowStruct(Arena, Type) (Type*)PushIntoGrowArena(Arena, sizeof(Type))
+#define PushGrowArray(Arena, Count, Type) (Type*)PushIntoGrowArena(Arena, (Count) * sizeof(Type))
+
+external grow_arena ReserveGrowArena(usz MaxSize, _opt int AccessFlags);
+
+/* Creates an arena that can grow up to [MaxSize] bytes, reserving the address range up
+ |  front and committing pages on demand as regions are pushed into it. Pointers into it
+ |  stay valid as it grows, and no data is ever copied. [AccessFlags] are the same as
+ |  in GetMemory() (MEM_WRITE if none is passed).
+ |--- Return: arena if successful, empty (NULL [.Base]) if not. */
+
+external void* PushIntoGrowArena(grow_arena* Arena, usz Size);
+
+/* Same as PushIntoArena(), but commits more pages when the region doesn't fit in the
+ |  ones committed so far.
+ |--- Return: pointer to the beginning of region if successful, NULL if [Arena] is
+ |  full or committing fails. */
+
+external bool CommitGrowArena(grow_arena* Arena, usz Size);
+
+/* Makes sure [Size] bytes past [Arena->WriteCur] are committed, so they can be written
+ |  to directly, advancing [.WriteCur] afterwards.
+ |--- Return: true if successful, false if they don't fit or committing fails. */
+
+external void FreeGrowArena(grow_arena* Arena);
+
+/* Releases the whole range of an arena from ReserveGrowArena(), and zeroes it out.
+ |--- Return: nothing. */
+
 
 //========================================
 // FileIO
@@ -149,6 +233,20 @@ external buffer ReadEntireFile(file File);
  |  copies entire file content to it.
 |--- Return: buffer with memory if successful, or empty buffer if not. */
 
+external buffer MapFileToMemory(file File, _opt int AccessFlags);
+
+/* Maps entire content of an open [File] handle into memory, without copying it. Pages
+ |  are only read from disk when first touched. [AccessFlags] takes MEM_READ for a
+ |  read-only view, or MEM_WRITE for a private copy-on-write view (writes are never
+ |  carried back to the file). File handle can be closed after mapping.
+ |--- Return: buffer with mapped file (.WriteCur set to file size) if successful, or
+ |  empty buffer if not. */
+
+external void UnmapFileFromMemory(buffer* Mem);
+
+/* Unmaps file view created with MapFileToMemory(), and zeroes out [Mem].
+ |--- Return: nothing. */
+
 external bool ReadFromFile(file File, buffer* Dst, usz AmountToRead, usz StartPos);
 
 /* Copies [AmountToRead] bytes from [File] at [StartPos] offset into [Dst] memory.
@@ -199,10 +297,37 @@ external usz WaitOnIoCompletion(file File, async* Async, bool Block);
 
 /* Waits until an async IO operation done on [File] completes. [Async] is a pointer to
  |  the same object used when start the IO. [Block] determines if the call waits
- |  indefinitely or returns immediately if it'd block.
+ |  indefinitely or returns immediately if it'd block. Can be called from any thread,
+ |  but with io_uring the thread that started the IO must not exit before this returns,
+ |  as the IO is queued on that thread's ring (closed at exit, after its IO is done).
 |--- Return: number of bytes transferred; 0 means an error if [Block], and a timeout
  |            if not. */
 
+external void BeginIoBatch(void);
+external bool SubmitIoBatch(void);
+
+/* Async IO started by the calling thread between these two calls is only queued, and
+ |  then handed to the kernel all at once by SubmitIoBatch(). Only has an effect with
+ |  io_uring; otherwise each IO starts right away, as usual.
+ |--- Return: nothing / true if all queued IO was submitted, false if not. */
+
+external bool RegisterIoBuffers(buffer* Buffers, i32 Count);
+
+/* Registers [Count] [Buffers] with the io_uring of the calling thread, next to the ones
+ |  already registered there. Async IO from that thread whose memory lies inside one of
+ |  them skips mapping the pages on every request. Registrations are counted, so a
+ |  buffer stays registered until each RegisterIoBuffers() of it is matched by an
+ |  UnregisterIoBuffers(), and users of the same thread don't undo each other's.
+ |  Buffers must stay allocated while registered.
+ |--- Return: true if registered, false if not (IO still works, just unregistered). */
+
+external void UnregisterIoBuffers(buffer* Buffers, i32 Count);
+
+/* Drops one registration of each of [Count] [Buffers] from the io_uring of the calling
+ |  thread, made before by RegisterIoBuffers(). Buffers that weren't registered are
+ |  skipped.
+ |--- Return: nothing. */
+
 external usz FileLastWriteTime(file File);
 
 /* Gets last time [File] was written to, in system units.
@@ -501,6 +626,11 @@ external bool WaitOnThread(thread* Thread);
  |  This also cleans up the thread, so no need to call CloseThread().
  |--- Return: true if successful, false if not. */
 
+external void YieldThread(void);
+
+/* Gives up the rest of the calling thread's time slice to other ready threads.
+ |--- Return: nothing. */
+
 external bool KillThread(thread* Thread);
 
 /* Forcefully terminates the running thread, and cleans up its resources. Calling this
@@ -568,12 +698,197 @@ external bool IncreaseSemaphore(semaphore* Semaphore);
 |--- Return: true if successful, false if not. */
 
 
+//========================================
+// Thread pool
+//========================================
+
+#define POOL_QUEUE_SIZE 4096 // Tasks each worker queue holds, must be a power of 2.
+
+#define TASK_PROC(Name) void Name(void* Arg)
+typedef void (*task_proc)(void*);
+
+#define RANGE_PROC(Name) void Name(isz Begin, isz End, void* Arg)
+typedef void (*range_proc)(isz, isz, void*);
+
+typedef struct wait_group
+{
+    volatile usz Count; // Tasks submitted with the group that haven't finished.
+} wait_group;
+
+typedef struct pool_task
+{
+    task_proc Proc;
+    void* Arg;
+    wait_group* Group;
+} pool_task;
+
+typedef struct pool_queue
+{
+    mutex Lock;
+    usz Top;    // Oldest task, where other workers steal from.
+    usz Bottom; // One past the newest task, where the owner pushes and pops.
+    pool_task Tasks[POOL_QUEUE_SIZE];
+} pool_queue;
+
+typedef struct thread_pool
+{
+    i32 NumWorkers;
+    thread* Threads;
+    pool_queue* Queues; // One per worker.
+    semaphore WorkSignal;
+    volatile usz NextQueue;
+    volatile usz Stop;
+    buffer Mem;
+} thread_pool;
+
+external thread_pool* InitThreadPool(i32 NumWorkers);
+
+/* Starts a work-stealing pool of [NumWorkers] threads (gSysInfo.NumThreads if 0). Each
+ |  worker has its own task queue, and steals from the others when it runs out. The
+ |  pool lives in memory of its own, and must be closed with CloseThreadPool().
+ |--- Return: pointer to the pool if successful, NULL if not. */
+
+external void SubmitTask(thread_pool* Pool, task_proc Proc, void* Arg, wait_group* Group);
+
+/* Queues [Proc] to be run with [Arg] by a worker. [Group] is optional, and counts the
+ |  task as pending until it finishes; a group over a single task works as its future,
+ |  with the result passed back through [Arg]. Tasks may submit and wait on tasks of
+ |  their own. If the queue is full, the task is run right away by the caller.
+ |--- Return: nothing. */
+
+external void WaitForGroup(thread_pool* Pool, wait_group* Group);
+
+/* Blocks until every task submitted with [Group] has finished, running pending tasks
+ |  of the pool in the meantime instead of sleeping. [Group] must start zeroed, and can
+ |  be reused once this returns.
+ |--- Return: nothing. */
+
+external void ParallelFor(thread_pool* Pool, isz Begin, isz End, isz Grain, range_proc Proc, void* Arg);
+
+/* Splits the range [Begin, End) in chunks of [Grain] indices (a few chunks per worker
+ |  if 0), and calls [Proc] once for each chunk, with the chunk range and [Arg], spread
+ |  over the workers and the calling thread. Chunks are handed out on demand, so ones
+ |  that take longer are balanced by the others. Returns when every chunk is done.
+ |--- Return: nothing. */
+
+external void CloseThreadPool(thread_pool* Pool);
+
+/* Stops the workers of [Pool] and frees it. Tasks still queued are not run, so wait
+ |  on them first.
+ |--- Return: nothing. */
+
+
+//========================================
+// Queues
+//========================================
+
+#define QUEUE_SPIN_COUNT 4096 // Retries of a blocking queue operation before sleeping.
+
+typedef struct spsc_queue
+{
+    void** Slots;
+    usz Mask;       // Capacity-1, capacity is a power of 2.
+    u8 Pad0[48];
+    volatile usz Head; // Next item to pop, only written by the consumer.
+    usz CachedTail;
+    u8 Pad1[48];
+    volatile usz Tail; // Next slot to push, only written by the producer.
+    usz CachedHead;
+    u8 Pad2[48];
+    buffer Mem;
+} spsc_queue;
+
+typedef struct mpmc_cell
+{
+    volatile usz Sequence;
+    void* Item;
+} mpmc_cell;
+
+typedef struct mpmc_queue
+{
+    mpmc_cell* Cells;
+    usz Mask;
+    u8 Pad0[48];
+    volatile usz Head;
+    u8 Pad1[56];
+    volatile usz Tail;
+    u8 Pad2[56];
+    buffer Mem;
+} mpmc_queue;
+
+external spsc_queue InitSpscQueue(usz Capacity);
+
+/* Inits a bounded lock-free queue of pointers, for one producer and one consumer
+ |  thread. [Capacity] is rounded up to a power of 2.
+ |--- Return: queue object, or empty object in failure. */
+
+external bool SpscPush(spsc_queue* Queue, void* Item);
+external bool SpscPop(spsc_queue* Queue, void** Item);
+
+/* Pushes [Item] to the back of [Queue] / pops the front of [Queue] into [Item]. Only
+ |  the producer may push and only the consumer may pop. Neither ever blocks.
+ |--- Return: true if successful, false if the queue was full / empty. */
+
+external void CloseSpscQueue(spsc_queue* Queue);
+
+/* Frees the memory of [Queue].
+ |--- Return: nothing. */
+
+external mpmc_queue InitMpmcQueue(usz Capacity);
+
+/* Inits a bounded lock-free queue of pointers, that any number of threads can push
+ |  to and pop from. [Capacity] is rounded up to a power of 2.
+ |--- Return: queue object, or empty object in failure. */
+
+external bool MpmcPush(mpmc_queue* Queue, void* Item);
+external bool MpmcPop(mpmc_queue* Queue, void** Item);
+
+/* Same as SpscPush() / SpscPop(), safe to call from any thread.
+ |--- Return: true if successful, false if the queue was full / empty. */
+
+external void CloseMpmcQueue(mpmc_queue* Queue);
+
+/* Frees the memory of [Queue].
+ |--- Return: nothing. */
+
+typedef struct blocking_queue
+{
+    spsc_queue Spsc;
+    mpmc_queue Mpmc;
+    bool Shared; // Uses the MPMC queue.
+    volatile usz PushWaiters;
+    volatile usz PopWaiters;
+    semaphore NotFull;
+    semaphore NotEmpty;
+} blocking_queue;
+
+external blocking_queue InitBlockingQueue(usz Capacity, bool Shared);
+
+/* Inits a bounded queue of pointers on top of a lock-free one, an MPMC queue if
+ |  [Shared], an SPSC queue if not. Full or empty queues are first retried for a while,
+ |  and only then put the caller to sleep, so steady pipelines never hit the kernel.
+ |--- Return: queue object, or empty object in failure. */
+
+external void PushBlocking(blocking_queue* Queue, void* Item);
+external void* PopBlocking(blocking_queue* Queue);
+
+/* Pushes [Item] to the back of [Queue] / pops its front, waiting for space / items.
+ |  A sentinel item (e.g. NULL) is the usual way of telling consumers to stop.
+ |--- Return: nothing / the item popped. */
+
+external void CloseBlockingQueue(blocking_queue* Queue);
+
+/* Frees the memory of [Queue]. No thread may be waiting on it.
+ |--- Return: nothing. */
+
+
 #if !defined(TT_STATIC_LINKING)
 # if defined(TT_WINDOWS)
 #  include "tinybase-platform-win32.c"
 # elif defined(TT_LINUX)
 #  include "tinybase-platform-linux.c"
 # endif //TT_WINDOWS
+# include "tinybase-platform-common.c"
 #endif //TT_STATIC_LINKING
 
 #endif //TINYBASE_PLATFORM_H
@@ -62,7 +62,7 @@ external string StringC(void* Base, encoding Enc);
 |  its size.
 |--- Return: string. */
 
-#define StringLit(S) String((S), sizeof(S)-1, 0, EC_ASCII)
+#define StringLit(S) String((void*)(S), sizeof(S)-1, 0, EC_ASCII)
 
 /* Creates a new string struct from a C string literal.
  |--- Return: string. */
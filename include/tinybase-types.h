@@ -205,6 +205,88 @@ GetFirstBitSet(u32 Mask)
     return Result;
 }
 
+internal inline i32
+GetLastBitSet(u32 Mask)
+{
+#if defined(TT_GCC) || defined(TT_CLANG)
+    i32 Result = 31 - __builtin_clz(Mask);
+#elif defined(TT_MSVC)
+    unsigned long Idx = 0;
+    _BitScanReverse(&Idx, Mask);
+    i32 Result = (i32)Idx;
+#else // Reserved for other compiler intrinsics.
+#endif
+    return Result;
+}
+
+internal inline usz
+AtomicAdd(volatile usz* Target, usz Value)
+{
+#if defined(TT_GCC) || defined(TT_CLANG)
+    usz Result = __atomic_fetch_add(Target, Value, __ATOMIC_SEQ_CST);
+#elif defined(TT_MSVC) && defined(TT_X64)
+    usz Result = (usz)_InterlockedExchangeAdd64((volatile __int64*)Target, (__int64)Value);
+#elif defined(TT_MSVC)
+    usz Result = (usz)_InterlockedExchangeAdd((volatile long*)Target, (long)Value);
+#else // Reserved for other compiler intrinsics.
+#endif
+    return Result; // Value before the addition.
+}
+
+internal inline usz
+AtomicLoad(volatile usz* Target)
+{
+#if defined(TT_GCC) || defined(TT_CLANG)
+    usz Result = __atomic_load_n(Target, __ATOMIC_ACQUIRE);
+#elif defined(TT_MSVC)
+    usz Result = *Target; // OBS: MSVC volatile reads already have acquire semantics.
+    _ReadWriteBarrier();
+#else // Reserved for other compiler intrinsics.
+#endif
+    return Result;
+}
+
+internal inline void
+AtomicStore(volatile usz* Target, usz Value)
+{
+#if defined(TT_GCC) || defined(TT_CLANG)
+    __atomic_store_n(Target, Value, __ATOMIC_RELEASE);
+#elif defined(TT_MSVC)
+    _ReadWriteBarrier();
+    *Target = Value; // OBS: MSVC volatile writes already have release semantics.
+#else // Reserved for other compiler intrinsics.
+#endif
+}
+
+internal inline bool
+AtomicCompareExchange(volatile usz* Target, usz* Expected, usz Desired)
+{
+#if defined(TT_GCC) || defined(TT_CLANG)
+    bool Result = __atomic_compare_exchange_n(Target, Expected, Desired, false,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#elif defined(TT_MSVC)
+# if defined(TT_X64)
+    usz Found = (usz)_InterlockedCompareExchange64((volatile __int64*)Target,
+                                                   (__int64)Desired, (__int64)*Expected);
+# else
+    usz Found = (usz)_InterlockedCompareExchange((volatile long*)Target,
+                                                 (long)Desired, (long)*Expected);
+# endif
+    bool Result = (Found == *Expected);
+    *Expected = Found;
+#else // Reserved for other compiler intrinsics.
+#endif
+    return Result; // If false, [Expected] gets the current value.
+}
+
+internal inline void
+CpuRelax(void)
+{
+#if defined(TT_X64)
+    _mm_pause();
+#endif
+}
+
 internal inline u32
 FlipBit(u32 Number, i32 BitIdx)
 {
@@ -1,7 +1,9 @@
 #include "gdal_utils.h"
 #include "ogr_api.h"
+#include "ogr_srs_api.h"
 #include "gdalwarper.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <time.h>
 
@@ -12,28 +14,383 @@ Clamp(int Target, int MinValue, int MaxValue)
     return Result;
 }
 
-internal int
+internal double
 CoordToPixel(double TargetCoord, double FirstCoord, double PixelSize)
 {
-    int Pixel = (int)((TargetCoord - FirstCoord) / PixelSize);
+    // Fractional, so callers choose how partially covered pixels are rounded.
+    double Pixel = (TargetCoord - FirstCoord) / PixelSize;
     return Pixel;
 }
 
+internal int
+ClampPixel(double Pixel, int MaxValue)
+{
+    int Result = (Pixel <= 0) ? 0 : (Pixel >= MaxValue) ? MaxValue : (int)Pixel;
+    return Result;
+}
+
+//
+// Reprojection
+//
+// Transformers between two SRS are expensive to create (PROJ has to look up and
+// instantiate the operation), so they are kept in a small cache keyed by the pair
+// of WKT strings, and reused across calls. The cache is kept per thread, as the
+// transformers can't be used from several threads at once. Single-threaded warps
+// wrap them in an approximate transformer, which only reprojects a few points per
+// scanline and interpolates the rest, reusing the same transformer for every
+// block of the output.
+//
+
+#define CUT_TRANSFORM_CACHE_SIZE 16
+#define CUT_TRANSFORM_MAX_ERROR 0.125 // In pixels, same as gdalwarp.
+
+struct cut_transform_cache
+{
+    u64 Hashes[CUT_TRANSFORM_CACHE_SIZE];
+    void* Transformers[CUT_TRANSFORM_CACHE_SIZE];
+    int Users[CUT_TRANSFORM_CACHE_SIZE];  // Cuts holding the transformer, never evicted.
+    int NextSlot;
+};
+
+global thread_local cut_transform_cache gTransformCache = {0};
+
+internal u64
+HashString(u64 Hash, const char* String)
+{
+    // FNV-1a.
+    for (; *String; String++)
+    {
+        Hash ^= (u8)*String;
+        Hash *= 0x100000001B3ULL;
+    }
+    return Hash;
+}
+
+internal void*
+AcquireCachedTransformer(const char* SrcWKT, const char* DstWKT)
+{
+    // Must be paired with ReleaseCachedTransformer(). If every slot is in use the
+    // transformer is not cached, and is destroyed when released.
+    
+    u64 Hash = HashString(0xCBF29CE484222325ULL, SrcWKT);
+    Hash = HashString(Hash ^ 0xFF, DstWKT);
+    
+    for (int Slot = 0; Slot < CUT_TRANSFORM_CACHE_SIZE; Slot++)
+    {
+        if (gTransformCache.Transformers[Slot] && gTransformCache.Hashes[Slot] == Hash)
+        {
+            gTransformCache.Users[Slot]++;
+            return gTransformCache.Transformers[Slot];
+        }
+    }
+    
+    void* Transformer = GDALCreateReprojectionTransformer(SrcWKT, DstWKT);
+    if (Transformer)
+    {
+        for (int Tries = 0; Tries < CUT_TRANSFORM_CACHE_SIZE; Tries++)
+        {
+            int Slot = gTransformCache.NextSlot;
+            gTransformCache.NextSlot = (Slot + 1) % CUT_TRANSFORM_CACHE_SIZE;
+            if (gTransformCache.Users[Slot] == 0)
+            {
+                if (gTransformCache.Transformers[Slot])
+                {
+                    GDALDestroyReprojectionTransformer(gTransformCache.Transformers[Slot]);
+                }
+                gTransformCache.Hashes[Slot] = Hash;
+                gTransformCache.Transformers[Slot] = Transformer;
+                gTransformCache.Users[Slot] = 1;
+                break;
+            }
+        }
+    }
+    
+    return Transformer;
+}
+
+internal void
+ReleaseCachedTransformer(void* Transformer)
+{
+    if (!Transformer) return;
+    
+    for (int Slot = 0; Slot < CUT_TRANSFORM_CACHE_SIZE; Slot++)
+    {
+        if (gTransformCache.Transformers[Slot] == Transformer)
+        {
+            gTransformCache.Users[Slot]--;
+            return;
+        }
+    }
+    GDALDestroyReprojectionTransformer(Transformer);
+}
+
+external void
+ClearCutTransformCache()
+{
+    for (int Slot = 0; Slot < CUT_TRANSFORM_CACHE_SIZE; Slot++)
+    {
+        if (gTransformCache.Transformers[Slot] && gTransformCache.Users[Slot] == 0)
+        {
+            GDALDestroyReprojectionTransformer(gTransformCache.Transformers[Slot]);
+            gTransformCache.Transformers[Slot] = NULL;
+        }
+    }
+}
+
+internal char*
+SRSToWKT(const char* SRS)
+{
+    // Accepts anything OSRSetFromUserInput() does (EPSG:XXXX, WKT, PROJ strings...).
+    // Returned string must be released with CPLFree().
+    
+    char* Result = NULL;
+    OGRSpatialReferenceH Ref = OSRNewSpatialReference(NULL);
+    if (OSRSetFromUserInput(Ref, SRS) == OGRERR_NONE)
+    {
+        OSRExportToWkt(Ref, &Result);
+    }
+    OSRDestroySpatialReference(Ref);
+    return Result;
+}
+
+internal bool
+IsSameSRS(const char* WKTA, const char* WKTB)
+{
+    if (!WKTA || !WKTB || !WKTA[0] || !WKTB[0] || strcmp(WKTA, WKTB) == 0)
+    {
+        return true;
+    }
+    
+    OGRSpatialReferenceH RefA = OSRNewSpatialReference(WKTA);
+    OGRSpatialReferenceH RefB = OSRNewSpatialReference(WKTB);
+    bool Result = OSRIsSame(RefA, RefB);
+    OSRDestroySpatialReference(RefA);
+    OSRDestroySpatialReference(RefB);
+    return Result;
+}
+
+internal void*
+GetReprojection(const char* SrcWKT, const char* DstWKT)
+{
+    // NULL when both SRS are the same, so callers can skip the reprojection.
+    // Otherwise it must be released with ReleaseCachedTransformer().
+    void* Result = NULL;
+    if (!IsSameSRS(SrcWKT, DstWKT))
+    {
+        Result = AcquireCachedTransformer(SrcWKT, DstWKT);
+    }
+    return Result;
+}
+
+struct cut_transformer
+{
+    double SrcAffine[6];
+    double SrcInvAffine[6];
+    double DstAffine[6];
+    double DstInvAffine[6];
+    void* Reprojection;  // From the cache, Src SRS -> Dst SRS. NULL if both are the same.
+};
+
+internal int
+CutTransform(void* TransformerArg, int DstToSrc, int NumPoints,
+             double* X, double* Y, double* Z, int* Success)
+{
+    // Pixel -> georeferenced -> reprojected -> pixel. Same contract as any other
+    // GDALTransformerFunc, so it can be wrapped by GDALCreateApproxTransformer().
+    
+    cut_transformer* Transformer = (cut_transformer*)TransformerArg;
+    double* FromAffine = (DstToSrc) ? Transformer->DstAffine : Transformer->SrcAffine;
+    double* ToAffine = (DstToSrc) ? Transformer->SrcInvAffine : Transformer->DstInvAffine;
+    
+    for (int Idx = 0; Idx < NumPoints; Idx++)
+    {
+        GDALApplyGeoTransform(FromAffine, X[Idx], Y[Idx], &X[Idx], &Y[Idx]);
+        Success[Idx] = TRUE;
+    }
+    if (Transformer->Reprojection)
+    {
+        GDALReprojectionTransform(Transformer->Reprojection, DstToSrc, NumPoints,
+                                  X, Y, Z, Success);
+    }
+    for (int Idx = 0; Idx < NumPoints; Idx++)
+    {
+        if (Success[Idx])
+        {
+            GDALApplyGeoTransform(ToAffine, X[Idx], Y[Idx], &X[Idx], &Y[Idx]);
+        }
+    }
+    
+    return TRUE;
+}
+
+internal void*
+SetWarpTransformer(GDALWarpOptions* WarpOptions, cut_transformer* Transformer,
+                   const char* DstWKT, cut_options* Options)
+{
+    // GDAL clones the transformer for each warp thread, which only works with its
+    // own ones, so multi-threaded warps get a GenImgProj transformer built from the
+    // source dataset, [DstWKT] and the output affine of [Transformer] (same mapping
+    // as CutTransform), as stats are warped without any output dataset. Otherwise
+    // the cached reprojection is used, as nothing else runs it concurrently.
+    // Returned transformer must be destroyed with GDALDestroyTransformer() after
+    // the warp, unless NULL.
+    
+    void* Result = NULL;
+    if (Options->NumThreads != 0)
+    {
+        char** TransformOptions = CSLSetNameValue(NULL, "DST_SRS", DstWKT);
+        Result = GDALCreateGenImgProjTransformer2(WarpOptions->hSrcDS, NULL, TransformOptions);
+        CSLDestroy(TransformOptions);
+        if (Result) GDALSetGenImgProjTransformerDstGeoTransform(Result, Transformer->DstAffine);
+        WarpOptions->pfnTransformer = GDALGenImgProjTransform;
+        if (Result && Transformer->Reprojection)
+        {
+            void* Exact = Result;
+            Result = GDALCreateApproxTransformer(GDALGenImgProjTransform, Exact,
+                                                 CUT_TRANSFORM_MAX_ERROR);
+            GDALApproxTransformerOwnsSubtransformer(Result, TRUE);
+            WarpOptions->pfnTransformer = GDALApproxTransform;
+        }
+        WarpOptions->pTransformerArg = Result;
+    }
+    else if (Transformer->Reprojection)
+    {
+        Result = GDALCreateApproxTransformer(CutTransform, Transformer,
+                                             CUT_TRANSFORM_MAX_ERROR);
+        WarpOptions->pTransformerArg = Result;
+        WarpOptions->pfnTransformer = GDALApproxTransform;
+    }
+    else
+    {
+        WarpOptions->pTransformerArg = Transformer;
+        WarpOptions->pfnTransformer = CutTransform;
+    }
+    
+    return Result;
+}
+
+internal void
+ReprojectRing(void* Reprojection, cut_ring* Ring, double* X, double* Y, double* Z)
+{
+    // [X], [Y] and [Z] must hold at least [Ring->NumPoints] values.
+    
+    int* Success = (int*)CPLMalloc(sizeof(int) * Max(Ring->NumPoints, 1));
+    for (int PointIdx = 0; PointIdx < Ring->NumPoints; PointIdx++)
+    {
+        X[PointIdx] = Ring->Vertices[PointIdx].X;
+        Y[PointIdx] = Ring->Vertices[PointIdx].Y;
+        Z[PointIdx] = 0;
+    }
+    if (Reprojection)
+    {
+        GDALReprojectionTransform(Reprojection, FALSE, Ring->NumPoints, X, Y, Z, Success);
+    }
+    CPLFree(Success);
+}
+
+internal bool
+IsPointInCutRing(v2 Point, cut_ring* Ring)
+{
+    // Even-odd rule on a ray to the right of [Point].
+    
+    bool Result = false;
+    for (int Idx = 0, PrevIdx = Ring->NumPoints - 1; Idx < Ring->NumPoints; PrevIdx = Idx++)
+    {
+        v2 A = Ring->Vertices[Idx];
+        v2 B = Ring->Vertices[PrevIdx];
+        if ((A.Y > Point.Y) != (B.Y > Point.Y)
+            && Point.X < A.X + ((Point.Y - A.Y) * (B.X - A.X) / (B.Y - A.Y)))
+        {
+            Result = !Result;
+        }
+    }
+    return Result;
+}
+
 internal OGRGeometryH
-XYGeomToPLGeom(v2* InGeom, int NumPoints, double* SrcAffine, int NumRows, int NumCols)
+CutRingToPLRing(cut_ring* InRing, double* SrcAffine, void* Reprojection)
 {
-    OGRGeometryH Ring = OGR_G_CreateGeometry(wkbLinearRing);
+    double* Coords = (double*)CPLMalloc(sizeof(double) * 3 * Max(InRing->NumPoints, 1));
+    double* X = Coords;
+    double* Y = Coords + InRing->NumPoints;
+    double* Z = Coords + (2 * InRing->NumPoints);
+    ReprojectRing(Reprojection, InRing, X, Y, Z);
     
-    for (int PointIdx = 0; PointIdx < NumPoints; PointIdx++)
+    OGRGeometryH Ring = OGR_G_CreateGeometry(wkbLinearRing);
+    for (int PointIdx = 0; PointIdx < InRing->NumPoints; PointIdx++)
     {
-        v2 Point = InGeom[PointIdx];
-        int XPixel = CoordToPixel(Point.X, SrcAffine[0], SrcAffine[1]);
-        int YPixel = CoordToPixel(Point.Y, SrcAffine[3], SrcAffine[5]);
+        double XPixel = CoordToPixel(X[PointIdx], SrcAffine[0], SrcAffine[1]);
+        double YPixel = CoordToPixel(Y[PointIdx], SrcAffine[3], SrcAffine[5]);
         OGR_G_AddPoint(Ring, XPixel, YPixel, 0);
     }
+    CPLFree(Coords);
+    
+    return Ring;
+}
+
+internal int
+FindOuterCutRing(cut_ring* Rings, int NumRings, cut_ring* Inner)
+{
+    // Innermost outer ring containing the first vertex of [Inner], -1 if none.
+    // OBS: An outer ring inside another (an island in a hole) is a tighter fit.
+    
+    int Result = -1;
+    if (Inner->NumPoints == 0)
+    {
+        return Result;
+    }
+    
+    v2 Test = Inner->Vertices[0];
+    for (int Idx = 0; Idx < NumRings; Idx++)
+    {
+        cut_ring* Outer = &Rings[Idx];
+        if (Outer->Type != 0
+            || Outer->NumPoints == 0
+            || !IsPointInCutRing(Test, Outer)) continue;
+        if (Result < 0 || IsPointInCutRing(Outer->Vertices[0], &Rings[Result]))
+        {
+            Result = Idx;
+        }
+    }
+    return Result;
+}
+
+internal OGRGeometryH
+XYGeomToPLGeom(cut_ring* InGeom, int NumRings, double* SrcAffine, void* Reprojection)
+{
+    // Each outer ring opens a new polygon in the multipolygon, and each inner ring is
+    // added to the innermost outer ring containing its first vertex, in any order.
+    // Inner rings outside every outer ring cut nothing, and are dropped. [Reprojection]
+    // takes the rings to the SRS of [SrcAffine], and can be NULL if they already are.
+    
+    OGRGeometryH OutGeom = OGR_G_CreateGeometry(wkbMultiPolygon);
+    OGRGeometryH* Polygons = (OGRGeometryH*)CPLCalloc(Max(NumRings, 1), sizeof(OGRGeometryH));
+    
+    for (int RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        cut_ring* InRing = &InGeom[RingIdx];
+        if (InRing->Type != 0) continue;
+        
+        Polygons[RingIdx] = OGR_G_CreateGeometry(wkbPolygon);
+        OGRGeometryH Ring = CutRingToPLRing(InRing, SrcAffine, Reprojection);
+        OGR_G_AddGeometryDirectly(Polygons[RingIdx], Ring);
+        OGR_G_AddGeometryDirectly(OutGeom, Polygons[RingIdx]);
+    }
+    
+    for (int RingIdx = 0; RingIdx < NumRings; RingIdx++)
+    {
+        cut_ring* InRing = &InGeom[RingIdx];
+        if (InRing->Type == 0) continue;
+        
+        int OuterIdx = FindOuterCutRing(InGeom, NumRings, InRing);
+        if (OuterIdx >= 0)
+        {
+            OGRGeometryH Ring = CutRingToPLRing(InRing, SrcAffine, Reprojection);
+            OGR_G_AddGeometryDirectly(Polygons[OuterIdx], Ring);
+        }
+    }
+    CPLFree(Polygons);
     
-    OGRGeometryH OutGeom = OGR_G_CreateGeometry(wkbPolygon);
-    OGR_G_AddGeometry(OutGeom, Ring);
     return OutGeom;
 }
 
@@ -46,134 +403,1741 @@ struct re_mosaic
     int NumBands;
     int XSize, YSize;
     const char* Proj;
+    GDALDatasetH FullDS;  // Full resolution mosaic, when [DS] is one of its overviews.
+    
+    // Sources opened for the VRT mosaic, and the warped VRTs of the ones whose SRS
+    // differs from the first source. Both are closed after the mosaic.
+    int NumSrcDS;
+    GDALDatasetH* SrcDS;
+    GDALDatasetH* WarpedDS;
 };
 
+internal void
+CloseMosaic(re_mosaic* Src)
+{
+    if (Src->DS) GDALClose(Src->DS);
+    if (Src->FullDS) GDALClose(Src->FullDS);
+    for (int Idx = 0; Idx < Src->NumSrcDS; Idx++)
+    {
+        if (Src->WarpedDS[Idx]) GDALClose(Src->WarpedDS[Idx]);
+        if (Src->SrcDS[Idx]) GDALClose(Src->SrcDS[Idx]);
+    }
+    CPLFree(Src->SrcDS);
+    CPLFree(Src->WarpedDS);
+    if (Src->VSIName[0]) VSIUnlink(Src->VSIName);
+    *Src = {0};
+}
+
+internal void
+ReadMosaicInfo(re_mosaic* Src)
+{
+    GDALGetGeoTransform(Src->DS, Src->Affine);
+    Src->MinX = Src->Affine[0];
+    Src->MaxX = Src->Affine[0] + (Src->Affine[1] * GDALGetRasterXSize(Src->DS));
+    Src->MinY = Src->Affine[3] + (Src->Affine[5] * GDALGetRasterYSize(Src->DS));
+    Src->MaxY = Src->Affine[3];
+    
+    Src->Proj = GDALGetProjectionRef(Src->DS);
+    Src->NumBands = GDALGetRasterCount(Src->DS);
+    Src->XSize = GDALGetRasterXSize(Src->DS);
+    Src->YSize = GDALGetRasterYSize(Src->DS);
+}
+
 internal re_mosaic
 LoadRastersFromList(char** SrcRasterList, int NumSrcRasters)
 {
+    // The mosaic takes the SRS of the first source. Sources in any other SRS are
+    // wrapped in a warped VRT before being added to the mosaic.
+    
     re_mosaic Src = {0};
     if (NumSrcRasters > 1)
     {
-        GDALBuildVRTOptionsForBinary* OptionsList = NULL;
-        GDALBuildVRTOptions* Options = GDALBuildVRTOptionsNew(SrcRasterList, OptionsList);
+        Src.NumSrcDS = NumSrcRasters;
+        Src.SrcDS = (GDALDatasetH*)CPLCalloc(NumSrcRasters, sizeof(GDALDatasetH));
+        Src.WarpedDS = (GDALDatasetH*)CPLCalloc(NumSrcRasters, sizeof(GDALDatasetH));
+        GDALDatasetH* MosaicDS = (GDALDatasetH*)CPLCalloc(NumSrcRasters,
+                                                           sizeof(GDALDatasetH));
+        
+        bool Loaded = true;
+        const char* MosaicWKT = NULL;
+        for (int Idx = 0; Idx < NumSrcRasters && Loaded; Idx++)
+        {
+            Src.SrcDS[Idx] = GDALOpen(SrcRasterList[Idx], GA_ReadOnly);
+            MosaicDS[Idx] = Src.SrcDS[Idx];
+            if (!Src.SrcDS[Idx])
+            {
+                Loaded = false;
+                break;
+            }
+            
+            const char* WKT = GDALGetProjectionRef(Src.SrcDS[Idx]);
+            if (Idx == 0)
+            {
+                MosaicWKT = WKT;
+            }
+            else if (!IsSameSRS(WKT, MosaicWKT))
+            {
+                Src.WarpedDS[Idx] = GDALAutoCreateWarpedVRT(Src.SrcDS[Idx], NULL, MosaicWKT,
+                                                            GRA_NearestNeighbour,
+                                                            CUT_TRANSFORM_MAX_ERROR, NULL);
+                MosaicDS[Idx] = Src.WarpedDS[Idx];
+                Loaded = (MosaicDS[Idx] != NULL);
+            }
+        }
         
-        time_t Now = time(0);
-        sprintf(Src.VSIName, "/vsimem/%d.vrt", (int)Now);
-        int Error = 0;
-        Src.DS = GDALBuildVRT(Src.VSIName, NumSrcRasters, NULL, SrcRasterList,
-                              Options, &Error);
-        GDALBuildVRTOptionsFree(Options);
+        if (Loaded)
+        {
+            GDALBuildVRTOptionsForBinary* OptionsList = NULL;
+            GDALBuildVRTOptions* Options = GDALBuildVRTOptionsNew(NULL, OptionsList);
+            
+            time_t Now = time(0);
+            sprintf(Src.VSIName, "/vsimem/%d.vrt", (int)Now);
+            int Error = 0;
+            Src.DS = GDALBuildVRT(Src.VSIName, NumSrcRasters, MosaicDS, NULL,
+                                  Options, &Error);
+            GDALBuildVRTOptionsFree(Options);
+        }
+        CPLFree(MosaicDS);
     }
     else
     {
         Src.DS = GDALOpen(SrcRasterList[0], GA_ReadOnly);
     }
     
-    GDALGetGeoTransform(Src.DS, Src.Affine);
-    Src.MinX = Src.Affine[0];
-    Src.MaxX = Src.Affine[0] + (Src.Affine[1] * GDALGetRasterXSize(Src.DS));
-    Src.MinY = Src.Affine[3] + (Src.Affine[5] * GDALGetRasterYSize(Src.DS));
-    Src.MaxY = Src.Affine[3];
-    
-    Src.Proj = GDALGetProjectionRef(Src.DS);
-    Src.NumBands = GDALGetRasterCount(Src.DS);
-    Src.XSize = GDALGetRasterXSize(Src.DS);
-    Src.YSize = GDALGetRasterYSize(Src.DS);
+    if (!Src.DS)
+    {
+        CloseMosaic(&Src);
+        return Src;
+    }
     
+    ReadMosaicInfo(&Src);
     return Src;
 }
 
-external GDALDatasetH
-RasterCut(char* DstRaster, char** SrcRasterList, int NumSrcRasters, v2* CutPolygon,
-          int NumPoints)
+internal GDALDatasetH
+OpenOverview(GDALDatasetH DS, double Scale)
 {
-    GDALDatasetH DstDS = 0;
+    // Coarsest overview that is still at least as fine as the output, which is
+    // [Scale] times coarser than [DS]. NULL when no overview fits.
+    
+    GDALRasterBandH Band = GDALGetRasterBand(DS, 1);
+    int NumOverviews = (Band && Scale > 1) ? GDALGetOverviewCount(Band) : 0;
+    int BestLevel = -1;
+    double BestFactor = 1;
+    for (int Level = 0; Level < NumOverviews; Level++)
+    {
+        GDALRasterBandH Overview = GDALGetOverview(Band, Level);
+        if (!Overview) continue;
+        
+        double Factor = (double)GDALGetRasterXSize(DS) / GDALGetRasterBandXSize(Overview);
+        if (Factor <= Scale && Factor > BestFactor)
+        {
+            BestFactor = Factor;
+            BestLevel = Level;
+        }
+    }
+    
+    // OBS: The level is opened again from the description of [DS] with OVERVIEW_LEVEL,
+    // so the VRT mosaic must be flushed for its file under /vsimem to be written. When
+    // it can't be opened again (e.g. anonymous warped sources), NULL is returned.
+    
+    GDALDatasetH Result = NULL;
+    if (BestLevel >= 0)
+    {
+        GDALFlushCache(DS);
+        char** OpenOptions = CSLSetNameValue(NULL, "OVERVIEW_LEVEL",
+                                             CPLSPrintf("%d", BestLevel));
+        Result = GDALOpenEx(GDALGetDescription(DS), GDAL_OF_RASTER | GDAL_OF_READONLY,
+                            NULL, OpenOptions, NULL);
+        CSLDestroy(OpenOptions);
+    }
+    return Result;
+}
+
+// Indexed by cut_compression, PrepareCut() rejects values past the end.
+global const char* CutCompressNames[] = { "LZW", "NONE", "DEFLATE", "ZSTD" };
+
+// Indexed by cut_resampling, PrepareCut() rejects values past the end.
+global GDALResampleAlg CutResampleAlgs[] = { GRA_NearestNeighbour, GRA_Average, GRA_Bilinear };
+
+internal char**
+BuildCreateOptions(cut_options* Options, bool IsCOG)
+{
+    char** CreateOptions = NULL;
+    
+    CreateOptions = CSLSetNameValue(CreateOptions, "COMPRESS",
+                                    CutCompressNames[Options->Compression]);
+    // OBS: LZW takes no level, and GTiff rejects ZLEVEL for anything but DEFLATE.
+    if (Options->Level > 0
+        && (Options->Compression == CutCompress_Deflate
+            || Options->Compression == CutCompress_ZSTD))
+    {
+        const char* LevelName = (IsCOG) ? "LEVEL"
+            : (Options->Compression == CutCompress_ZSTD) ? "ZSTD_LEVEL" : "ZLEVEL";
+        CreateOptions = CSLSetNameValue(CreateOptions, LevelName,
+                                        CPLSPrintf("%d", Options->Level));
+    }
+    if (Options->Predictor > 0)
+    {
+        // COG driver names the predictors instead of numbering them.
+        local const char* COGPredictors[] = { "NO", "NO", "STANDARD", "FLOATING_POINT" };
+        const char* Predictor = (IsCOG) ? COGPredictors[Min(Options->Predictor, 3)]
+            : CPLSPrintf("%d", Options->Predictor);
+        CreateOptions = CSLSetNameValue(CreateOptions, "PREDICTOR", Predictor);
+    }
+    if (Options->TileSize > 0)
+    {
+        const char* TileSize = CPLSPrintf("%d", Options->TileSize);
+        if (IsCOG)
+        {
+            CreateOptions = CSLSetNameValue(CreateOptions, "BLOCKSIZE", TileSize);
+        }
+        else
+        {
+            CreateOptions = CSLSetNameValue(CreateOptions, "TILED", "YES");
+            CreateOptions = CSLSetNameValue(CreateOptions, "BLOCKXSIZE", TileSize);
+            CreateOptions = CSLSetNameValue(CreateOptions, "BLOCKYSIZE", TileSize);
+        }
+    }
+    if (Options->NumThreads != 0)
+    {
+        const char* NumThreads = (Options->NumThreads < 0) ? "ALL_CPUS"
+            : CPLSPrintf("%d", Options->NumThreads);
+        CreateOptions = CSLSetNameValue(CreateOptions, "NUM_THREADS", NumThreads);
+    }
+    if (Options->BigTiff)
+    {
+        CreateOptions = CSLSetNameValue(CreateOptions, "BIGTIFF", "YES");
+    }
+    
+    return CreateOptions;
+}
+
+internal GDALDatasetH
+CreateOutputRaster(char* DstRaster, cut_options* Options, int XSize, int YSize,
+                   int NumBands, GDALDataType DType)
+{
+    // COG driver only supports copying from another dataset, so the raster is first
+    // assembled in memory, and later copied to disk with FinishOutputRaster().
+    
+    if (Options->CloudOptimized)
+    {
+        GDALDriverH MemDriver = GDALGetDriverByName("MEM");
+        GDALDatasetH Result = GDALCreate(MemDriver, "", XSize, YSize, NumBands, DType, NULL);
+        return Result;
+    }
+    
+    char* DriverName = (Options->Driver) ? Options->Driver : (char*)"GTiff";
+    GDALDriverH Driver = GDALGetDriverByName(DriverName);
+    if (!Driver)
+    {
+        return NULL;
+    }
+    
+    char** CreateOptions = NULL;
+    if (EQUAL(DriverName, "GTiff"))
+    {
+        CreateOptions = BuildCreateOptions(Options, false);
+    }
+    for (char** Opt = Options->CreateOptions; Opt && *Opt; Opt++)
+    {
+        CreateOptions = CSLAddString(CreateOptions, *Opt);
+    }
+    
+    GDALDatasetH Result = GDALCreate(Driver, DstRaster, XSize, YSize, NumBands, DType,
+                                     CreateOptions);
+    CSLDestroy(CreateOptions);
+    return Result;
+}
+
+internal GDALDatasetH
+FinishOutputRaster(char* DstRaster, cut_options* Options, GDALDatasetH DstDS)
+{
+    if (!Options->CloudOptimized)
+    {
+        return DstDS;
+    }
+    
+    GDALDatasetH Result = NULL;
+    GDALDriverH COGDriver = GDALGetDriverByName("COG");
+    if (COGDriver)
+    {
+        char** CreateOptions = BuildCreateOptions(Options, true);
+        // OBS: Overviews from CreateOverviewLevels() are already in [DstDS], so the
+        // driver copies them instead of computing its own.
+        GDALRasterBandH Band = GDALGetRasterBand(DstDS, 1);
+        if (Band && GDALGetOverviewCount(Band) > 0)
+        {
+            CreateOptions = CSLSetNameValue(CreateOptions, "OVERVIEWS", "FORCE_USE_EXISTING");
+        }
+        for (char** Opt = Options->CreateOptions; Opt && *Opt; Opt++)
+        {
+            CreateOptions = CSLAddString(CreateOptions, *Opt);
+        }
+        Result = GDALCreateCopy(COGDriver, DstRaster, DstDS, FALSE, CreateOptions, NULL, NULL);
+        CSLDestroy(CreateOptions);
+    }
+    GDALClose(DstDS);
     
+    return Result;
+}
+
+struct re_cut
+{
+    re_mosaic Src;
+    OGRGeometryH PLGeom;
+    GDALDataType DType;
+    int XSize, YSize;
+    int NumDstBands;              // Source bands, plus the alpha band with coverage.
+    double Scale;                 // Output pixel size over the grid pixel size.
+    double Affine[6];
+    char* DstWKT;
+    char* CutWKT;
+    cut_ring* CutRings;
+    int NumRings;
+    cut_transformer Transformer;  // Mosaic pixels -> output pixels.
+};
+
+internal void
+CloseCut(re_cut* Cut)
+{
+    if (Cut->PLGeom) OGR_G_DestroyGeometry(Cut->PLGeom);
+    CloseMosaic(&Cut->Src);
+    ReleaseCachedTransformer(Cut->Transformer.Reprojection);
+    CPLFree(Cut->DstWKT);
+    CPLFree(Cut->CutWKT);
+    *Cut = {0};
+}
+
+internal bool
+PrepareCut(re_cut* Cut, char** SrcRasterList, int NumSrcRasters, cut_ring* CutRings,
+           int NumRings, cut_options* Options)
+{
     // Must have already called GDALAllRegister().
     
+    if ((usz)Options->Compression >= ArrayCount(CutCompressNames)
+        || (usz)Options->Resampling >= ArrayCount(CutResampleAlgs))
+    {
+        return false;
+    }
+    
     re_mosaic Src = LoadRastersFromList(SrcRasterList, NumSrcRasters);
     if (!Src.DS)
     {
-        return DstDS;
+        return false;
+    }
+    Cut->Src = Src;
+    
+    Cut->CutRings = CutRings;
+    Cut->NumRings = NumRings;
+    
+    // Output and cut polygon SRS default to the one of the mosaic. Transformers
+    // between them come from the cache, and are released instead of destroyed.
+    
+    const char* MosaicWKT = Src.Proj;
+    Cut->DstWKT = (Options->DstSRS) ? SRSToWKT(Options->DstSRS) : CPLStrdup(MosaicWKT);
+    Cut->CutWKT = (Options->CutSRS) ? SRSToWKT(Options->CutSRS) : CPLStrdup(Cut->DstWKT);
+    if (!Cut->DstWKT || !Cut->CutWKT)
+    {
+        CloseCut(Cut);
+        return false;
+    }
+    
+    cut_transformer* Transformer = &Cut->Transformer;
+    Transformer->Reprojection = GetReprojection(MosaicWKT, Cut->DstWKT);
+    CopyData(Transformer->SrcAffine, sizeof(Transformer->SrcAffine),
+             Src.Affine, sizeof(Src.Affine));
+    GDALInvGeoTransform(Transformer->SrcAffine, Transformer->SrcInvAffine);
+    
+    // Grid the output is aligned to. In the mosaic SRS it is the grid of the mosaic,
+    // otherwise the grid GDAL suggests for warping the whole mosaic.
+    
+    double GridAffine[6];
+    int GridXSize = Src.XSize;
+    int GridYSize = Src.YSize;
+    CopyData(GridAffine, sizeof(GridAffine), Src.Affine, sizeof(Src.Affine));
+    if (Transformer->Reprojection)
+    {
+        double Identity[6] = { 0, 1, 0, 0, 0, 1 };
+        CopyData(Transformer->DstAffine, sizeof(Transformer->DstAffine),
+                 Identity, sizeof(Identity));
+        CopyData(Transformer->DstInvAffine, sizeof(Transformer->DstInvAffine),
+                 Identity, sizeof(Identity));
+        if (GDALSuggestedWarpOutput(Src.DS, CutTransform, Transformer, GridAffine,
+                                    &GridXSize, &GridYSize) != CE_None)
+        {
+            CloseCut(Cut);
+            return false;
+        }
     }
     
-    // Processes cut polygon
+    // Processes cut polygon. Holes are inside their outer rings, so only outer
+    // rings can extend the cut window.
     
-    int LeftPixel = INT_MAX, TopPixel = INT_MAX, RightPixel = INT_MIN, BottomPixel = INT_MIN;
-    for (int PointIdx = 0; PointIdx < NumPoints; PointIdx++)
+    void* CutToSrc = GetReprojection(Cut->CutWKT, MosaicWKT);
+    void* CutToDst = GetReprojection(Cut->CutWKT, Cut->DstWKT);
+    double Left = INFINITY, Top = INFINITY, Right = -INFINITY, Bottom = -INFINITY;
+    for (int RingIdx = 0; RingIdx < NumRings; RingIdx++)
     {
-        v2 Point = CutPolygon[PointIdx];
-        int XPixel = CoordToPixel(Point.X, Src.Affine[0], Src.Affine[1]);
-        int YPixel = CoordToPixel(Point.Y, Src.Affine[3], Src.Affine[5]);
+        cut_ring* Ring = &CutRings[RingIdx];
+        if (Ring->Type != 0) continue;
         
-        LeftPixel   = (XPixel < LeftPixel)   ? XPixel : LeftPixel;
-        RightPixel  = (XPixel > RightPixel)  ? XPixel : RightPixel;
-        TopPixel    = (YPixel < TopPixel)    ? YPixel : TopPixel;
-        BottomPixel = (YPixel > BottomPixel) ? YPixel : BottomPixel;
+        double* Coords = (double*)CPLMalloc(sizeof(double) * 3 * Max(Ring->NumPoints, 1));
+        double* X = Coords;
+        double* Y = Coords + Ring->NumPoints;
+        double* Z = Coords + (2 * Ring->NumPoints);
+        ReprojectRing(CutToDst, Ring, X, Y, Z);
+        
+        for (int PointIdx = 0; PointIdx < Ring->NumPoints; PointIdx++)
+        {
+            double XPixel = CoordToPixel(X[PointIdx], GridAffine[0], GridAffine[1]);
+            double YPixel = CoordToPixel(Y[PointIdx], GridAffine[3], GridAffine[5]);
+            
+            Left   = (XPixel < Left)   ? XPixel : Left;
+            Right  = (XPixel > Right)  ? XPixel : Right;
+            Top    = (YPixel < Top)    ? YPixel : Top;
+            Bottom = (YPixel > Bottom) ? YPixel : Bottom;
+        }
+        CPLFree(Coords);
     }
-    LeftPixel = Clamp(LeftPixel, 0, Src.XSize);
-    RightPixel = Clamp(RightPixel, 0, Src.XSize);
-    TopPixel = Clamp(TopPixel, 0, Src.YSize);
-    BottomPixel = Clamp(BottomPixel, 0, Src.YSize);
     
-    int DstXSize = RightPixel - LeftPixel;
-    int DstYSize = BottomPixel - TopPixel;
-    double MinX = Src.Affine[0] + (LeftPixel * Src.Affine[1]);
-    double MaxY = Src.Affine[3] + (TopPixel * Src.Affine[5]);
+    // Window includes every pixel the polygon touches, even partially. Edges within
+    // [Tolerance] of a pixel boundary sit on it, since coordinates aligned to the grid
+    // rarely come out exact after reprojection, and shouldn't pull in the next pixel.
+    double Tolerance = 1e-6;
+    int LeftPixel = ClampPixel(floor(Left + Tolerance), GridXSize);
+    int RightPixel = ClampPixel(ceil(Right - Tolerance), GridXSize);
+    int TopPixel = ClampPixel(floor(Top + Tolerance), GridYSize);
+    int BottomPixel = ClampPixel(ceil(Bottom - Tolerance), GridYSize);
+    
+    // Output pixels are [Scale] times the grid ones, keeping the window origin.
     
-    double DstAffine[6] = { MinX, Src.Affine[1], Src.Affine[2], MaxY, Src.Affine[4],
-        Src.Affine[5] };
-    OGRGeometryH PLGeom = XYGeomToPLGeom(CutPolygon, NumPoints, Src.Affine,
-                                         Src.XSize, Src.YSize);
+    int GridWindowXSize = Max(RightPixel - LeftPixel, 0);
+    int GridWindowYSize = Max(BottomPixel - TopPixel, 0);
+    if (GridWindowXSize == 0 || GridWindowYSize == 0)
+    {
+        // OBS: No outer rings, or none of them over the grid, leave nothing to cut.
+        ReleaseCachedTransformer(CutToSrc);
+        ReleaseCachedTransformer(CutToDst);
+        CloseCut(Cut);
+        return false;
+    }
+    double Scale = 1;
+    if (Options->OutXSize > 0 && GridWindowXSize > 0)
+    {
+        Scale = (double)GridWindowXSize / Options->OutXSize;
+    }
+    else if (Options->PixelSize > 0)
+    {
+        Scale = Options->PixelSize / Abs(GridAffine[1]);
+    }
     
-    // Creates output image
+    Cut->Scale = Scale;
+    Cut->XSize = (int)ceil((GridWindowXSize / Scale) - 1e-9);
+    Cut->YSize = (int)ceil((GridWindowYSize / Scale) - 1e-9);
+    Cut->Affine[0] = GridAffine[0] + (LeftPixel * GridAffine[1]);
+    Cut->Affine[1] = GridAffine[1] * Scale;
+    Cut->Affine[2] = GridAffine[2] * Scale;
+    Cut->Affine[3] = GridAffine[3] + (TopPixel * GridAffine[5]);
+    Cut->Affine[4] = GridAffine[4] * Scale;
+    Cut->Affine[5] = GridAffine[5] * Scale;
     
-    GDALDriverH Driver = GDALGetDriverByName("GTiff");
-    char** CreateOptions = NULL;
-    CreateOptions = CSLSetNameValue(CreateOptions, "COMPRESS", "LZW");
-    GDALRasterBandH Band = GDALGetRasterBand(Src.DS, 1);
-    GDALDataType DType = GDALGetRasterDataType(Band);
-    DstDS = GDALCreate(Driver, DstRaster, DstXSize, DstYSize, Src.NumBands,
-                       DType, CreateOptions);
-    CSLDestroy(CreateOptions);
+    // Coarser outputs are read from the closest overview of the mosaic, so the
+    // data read shrinks with the square of [Scale].
     
-    GDALSetProjection(DstDS, Src.Proj);
-    GDALSetGeoTransform(DstDS, DstAffine);
-    for (int BandIdx = 1; BandIdx <= Src.NumBands; BandIdx++)
+    GDALDatasetH OverviewDS = OpenOverview(Cut->Src.DS, Scale);
+    if (OverviewDS)
     {
-        GDALRasterBandH InBand = GDALGetRasterBand(Src.DS, BandIdx);
-        int HasNoData = NULL;
-        double NoData = GDALGetRasterNoDataValue(InBand, &HasNoData);
-        GDALRasterBandH OutBand = GDALGetRasterBand(DstDS, BandIdx);
-        GDALSetRasterNoDataValue(OutBand, NoData);
+        Cut->Src.FullDS = Cut->Src.DS;
+        Cut->Src.DS = OverviewDS;
+        ReadMosaicInfo(&Cut->Src);
+        Src = Cut->Src;
+        CopyData(Transformer->SrcAffine, sizeof(Transformer->SrcAffine),
+                 Src.Affine, sizeof(Src.Affine));
+        GDALInvGeoTransform(Transformer->SrcAffine, Transformer->SrcInvAffine);
     }
+    Cut->PLGeom = XYGeomToPLGeom(CutRings, NumRings, Src.Affine, CutToSrc);
+    ReleaseCachedTransformer(CutToSrc);
+    ReleaseCachedTransformer(CutToDst);
+    
+    CopyData(Transformer->DstAffine, sizeof(Transformer->DstAffine),
+             Cut->Affine, sizeof(Cut->Affine));
+    GDALInvGeoTransform(Transformer->DstAffine, Transformer->DstInvAffine);
     
-    // Cuts the mosaic
+    GDALRasterBandH Band = GDALGetRasterBand(Src.DS, 1);
+    Cut->DType = GDALGetRasterDataType(Band);
+    Cut->NumDstBands = Src.NumBands + ((Options->Coverage) ? 1 : 0);
+    
+    return true;
+}
+
+internal GDALResampleAlg
+GetWarpResampling(cut_options* Options)
+{
+    GDALResampleAlg Result = CutResampleAlgs[Options->Resampling];
+    return Result;
+}
+
+internal bool
+WarpCut(re_cut* Cut, GDALDatasetH DstDS, cut_options* Options)
+{
+    re_mosaic* Src = &Cut->Src;
+    
+    GDALSetProjection(DstDS, Cut->DstWKT);
+    GDALSetGeoTransform(DstDS, Cut->Affine);
     
     GDALWarpOptions* WarpOptions = GDALCreateWarpOptions();
-    WarpOptions->hSrcDS = Src.DS;
+    WarpOptions->hSrcDS = Src->DS;
     WarpOptions->hDstDS = DstDS;
-    WarpOptions->nBandCount = Src.NumBands;
-    WarpOptions->panSrcBands = (int*)CPLMalloc(sizeof(int) * Src.NumBands);
-    WarpOptions->panDstBands = (int*)CPLMalloc(sizeof(int) * Src.NumBands);
-    for (int BandIdx = 1; BandIdx <= Src.NumBands; BandIdx++)
+    WarpOptions->eResampleAlg = GetWarpResampling(Options);
+    WarpOptions->nBandCount = Src->NumBands;
+    WarpOptions->panSrcBands = (int*)CPLMalloc(sizeof(int) * Src->NumBands);
+    WarpOptions->panDstBands = (int*)CPLMalloc(sizeof(int) * Src->NumBands);
+    double* NoData = (double*)CPLMalloc(sizeof(double) * Src->NumBands);
+    bool AllNoData = true;
+    for (int BandIdx = 1; BandIdx <= Src->NumBands; BandIdx++)
     {
+        GDALRasterBandH InBand = GDALGetRasterBand(Src->DS, BandIdx);
+        int HasNoData = 0;
+        NoData[BandIdx-1] = GDALGetRasterNoDataValue(InBand, &HasNoData);
+        if (HasNoData)
+        {
+            GDALSetRasterNoDataValue(GDALGetRasterBand(DstDS, BandIdx), NoData[BandIdx-1]);
+        }
+        AllNoData = (AllNoData && HasNoData);
+        
         WarpOptions->panSrcBands[BandIdx-1] = BandIdx;
         WarpOptions->panDstBands[BandIdx-1] = BandIdx;
     }
-    WarpOptions->hCutline = PLGeom;
-    WarpOptions->pTransformerArg = GDALCreateGenImgProjTransformer(Src.DS, 0, DstDS, 0,
-                                                                   FALSE, 0, 1);
-    WarpOptions->pfnTransformer = GDALGenImgProjTransform;
-    
-    GDALWarpOperation Warp;
-    Warp.Initialize(WarpOptions);
-    Warp.ChunkAndWarpImage(0, 0, GDALGetRasterXSize(DstDS), GDALGetRasterYSize(DstDS));
-    
-    GDALDestroyGenImgProjTransformer(WarpOptions->pTransformerArg);
-    GDALDestroyWarpOptions(WarpOptions);
-    GDALClose(Src.DS);
-    if (NumSrcRasters > 1) VSIUnlink(Src.VSIName);
     
-    return DstDS;
+    // Pixels outside the cut are initialised, as the destination may be a reused
+    // buffer instead of a freshly created file. GDAL takes destination NoData for
+    // every band or none, so without it on every band they are set to 0.
+    if (AllNoData)
+    {
+        WarpOptions->padfDstNoDataReal = NoData;
+    }
+    else
+    {
+        CPLFree(NoData);
+    }
+    WarpOptions->papszWarpOptions = CSLSetNameValue(WarpOptions->papszWarpOptions, "INIT_DEST",
+                                                    (AllNoData) ? "NO_DATA" : "0");
+    if (Options->NumThreads != 0)
+    {
+        const char* NumThreads = (Options->NumThreads < 0) ? "ALL_CPUS"
+            : CPLSPrintf("%d", Options->NumThreads);
+        WarpOptions->papszWarpOptions = CSLSetNameValue(WarpOptions->papszWarpOptions,
+                                                        "NUM_THREADS", NumThreads);
+    }
+    WarpOptions->hCutline = Cut->PLGeom;
+    void* WarpTransformer = SetWarpTransformer(WarpOptions, &Cut->Transformer, Cut->DstWKT, Options);
+    
+    GDALWarpOperation Warp;
+    CPLErr Error = CE_Failure;
+    if (WarpOptions->pTransformerArg)
+    {
+        Error = Warp.Initialize(WarpOptions);
+    }
+    if (Error == CE_None)
+    {
+        Error = Warp.ChunkAndWarpImage(0, 0, Cut->XSize, Cut->YSize);
+    }
+    
+    if (WarpTransformer) GDALDestroyTransformer(WarpTransformer);
+    WarpOptions->hCutline = NULL; // Owned by [Cut], destroyed in CloseCut().
+    GDALDestroyWarpOptions(WarpOptions);
+    
+    return (Error == CE_None);
+}
+
+//
+// Coverage
+//
+// Exact fraction of each output pixel inside the cut polygon, from a signed-area
+// accumulation rasterizer: every edge adds its signed area to the pixels it
+// crosses and the pixel right after them, and the running sum along each row is
+// the coverage. Rows are rasterized a block at a time, next to the pixels.
+//
+
+struct cut_edge
+{
+    double X0, Y0, X1, Y1;  // Output pixels, with Y0 < Y1.
+    double Sign;            // Outer rings add coverage and holes remove it.
+};
+
+struct cut_coverage
+{
+    cut_edge* Edges;
+    int NumEdges;
+};
+
+internal cut_coverage
+BuildCoverageEdges(re_cut* Cut)
+{
+    int MaxEdges = 0;
+    for (int RingIdx = 0; RingIdx < Cut->NumRings; RingIdx++)
+    {
+        MaxEdges += Cut->CutRings[RingIdx].NumPoints;
+    }
+    
+    cut_coverage Coverage = {0};
+    Coverage.Edges = (cut_edge*)CPLMalloc(sizeof(cut_edge) * Max(MaxEdges, 1));
+    void* CutToDst = GetReprojection(Cut->CutWKT, Cut->DstWKT);
+    
+    for (int RingIdx = 0; RingIdx < Cut->NumRings; RingIdx++)
+    {
+        // Same rings as the cutline of XYGeomToPLGeom(), which drops orphan holes.
+        cut_ring* Ring = &Cut->CutRings[RingIdx];
+        if (Ring->Type != 0 && FindOuterCutRing(Cut->CutRings, Cut->NumRings, Ring) < 0)
+        {
+            continue;
+        }
+        int NumPoints = Ring->NumPoints;
+        double* Coords = (double*)CPLMalloc(sizeof(double) * 3 * Max(NumPoints, 1));
+        double* X = Coords;
+        double* Y = Coords + NumPoints;
+        double* Z = Coords + (2 * NumPoints);
+        ReprojectRing(CutToDst, Ring, X, Y, Z);
+        
+        double Area = 0;
+        for (int PointIdx = 0; PointIdx < NumPoints; PointIdx++)
+        {
+            GDALApplyGeoTransform(Cut->Transformer.DstInvAffine, X[PointIdx], Y[PointIdx],
+                                  &X[PointIdx], &Y[PointIdx]);
+        }
+        for (int PointIdx = 0; PointIdx < NumPoints; PointIdx++)
+        {
+            int NextIdx = (PointIdx + 1) % NumPoints;
+            Area += (X[PointIdx] * Y[NextIdx]) - (X[NextIdx] * Y[PointIdx]);
+        }
+        
+        // Rasterizer gives -1 inside rings with positive area, whatever the ring
+        // type, so the sign is fixed here to make holes subtract.
+        double RingSign = (Area > 0) ? -1 : 1;
+        RingSign = (Ring->Type == 0) ? RingSign : -RingSign;
+        
+        for (int PointIdx = 0; PointIdx < NumPoints; PointIdx++)
+        {
+            int NextIdx = (PointIdx + 1) % NumPoints;
+            if (Y[PointIdx] == Y[NextIdx]) continue;
+            
+            bool Down = (Y[PointIdx] < Y[NextIdx]);
+            cut_edge* Edge = &Coverage.Edges[Coverage.NumEdges++];
+            Edge->X0 = (Down) ? X[PointIdx] : X[NextIdx];
+            Edge->Y0 = (Down) ? Y[PointIdx] : Y[NextIdx];
+            Edge->X1 = (Down) ? X[NextIdx] : X[PointIdx];
+            Edge->Y1 = (Down) ? Y[NextIdx] : Y[PointIdx];
+            Edge->Sign = (Down) ? RingSign : -RingSign;
+        }
+        CPLFree(Coords);
+    }
+    
+    ReleaseCachedTransformer(CutToDst);
+    return Coverage;
+}
+
+internal void
+AccumulateSpan(double* Line, double XA, double XB, double Area)
+{
+    // Segment inside a single row, with both ends in [0, Width]. [Line] must have
+    // two extra values past the width.
+    
+    double X0 = Min(XA, XB);
+    double X1 = Max(XA, XB);
+    int X0Pixel = (int)floor(X0);
+    int X1Pixel = (int)ceil(X1);
+    
+    if (X1Pixel <= X0Pixel + 1)
+    {
+        double Middle = (0.5 * (XA + XB)) - X0Pixel;
+        Line[X0Pixel] += Area - (Area * Middle);
+        Line[X0Pixel+1] += Area * Middle;
+        return;
+    }
+    
+    double InvWidth = 1.0 / (X1 - X0);
+    double X0Frac = X0 - X0Pixel;
+    double X1Frac = X1 - X1Pixel + 1;
+    double FirstArea = 0.5 * InvWidth * (1 - X0Frac) * (1 - X0Frac);
+    double LastArea = 0.5 * InvWidth * X1Frac * X1Frac;
+    
+    Line[X0Pixel] += Area * FirstArea;
+    if (X1Pixel == X0Pixel + 2)
+    {
+        Line[X0Pixel+1] += Area * (1 - FirstArea - LastArea);
+    }
+    else
+    {
+        double SecondArea = InvWidth * (1.5 - X0Frac);
+        Line[X0Pixel+1] += Area * (SecondArea - FirstArea);
+        for (int Pixel = X0Pixel + 2; Pixel < X1Pixel - 1; Pixel++)
+        {
+            Line[Pixel] += Area * InvWidth;
+        }
+        double BeforeLastArea = SecondArea + ((X1Pixel - X0Pixel - 3) * InvWidth);
+        Line[X1Pixel-1] += Area * (1 - BeforeLastArea - LastArea);
+    }
+    Line[X1Pixel] += Area * LastArea;
+}
+
+internal void
+AccumulateClippedSpan(double* Line, int Width, double XA, double XB, double Area)
+{
+    // Parts of the segment left or right of the window are moved onto its border,
+    // which keeps the coverage inside exact.
+    
+    double Splits[4] = { 0 };
+    int NumSplits = 1;
+    if (XA != XB)
+    {
+        double Bounds[2] = { 0, (double)Width };
+        for (int BoundIdx = 0; BoundIdx < 2; BoundIdx++)
+        {
+            double T = (Bounds[BoundIdx] - XA) / (XB - XA);
+            if (T > 0 && T < 1) Splits[NumSplits++] = T;
+        }
+        if (NumSplits == 3 && Splits[1] > Splits[2])
+        {
+            double Swap = Splits[1];
+            Splits[1] = Splits[2];
+            Splits[2] = Swap;
+        }
+    }
+    Splits[NumSplits++] = 1;
+    
+    for (int SplitIdx = 0; SplitIdx < NumSplits - 1; SplitIdx++)
+    {
+        double SplitXA = XA + ((XB - XA) * Splits[SplitIdx]);
+        double SplitXB = XA + ((XB - XA) * Splits[SplitIdx+1]);
+        SplitXA = Min(Max(SplitXA, 0.0), (double)Width);
+        SplitXB = Min(Max(SplitXB, 0.0), (double)Width);
+        AccumulateSpan(Line, SplitXA, SplitXB,
+                       Area * (Splits[SplitIdx+1] - Splits[SplitIdx]));
+    }
+}
+
+internal void
+RasterizeCoverage(cut_coverage* Coverage, int Row, int NumRows, int Width,
+                  double* Accumulator, double* Result)
+{
+    // [Accumulator] holds ([Width] + 2) * [NumRows] values, and [Result] gets the
+    // coverage of [Width] * [NumRows] pixels, from 0 to 1.
+    
+    usz LineSize = (usz)Width + 2;
+    memset(Accumulator, 0, sizeof(double) * LineSize * NumRows);
+    
+    for (int EdgeIdx = 0; EdgeIdx < Coverage->NumEdges; EdgeIdx++)
+    {
+        cut_edge* Edge = &Coverage->Edges[EdgeIdx];
+        if (Edge->Y1 <= Row || Edge->Y0 >= Row + NumRows) continue;
+        
+        double DxDy = (Edge->X1 - Edge->X0) / (Edge->Y1 - Edge->Y0);
+        int FirstRow = Max((int)floor(Edge->Y0), Row);
+        int LastRow = Min((int)ceil(Edge->Y1), Row + NumRows);
+        for (int Y = FirstRow; Y < LastRow; Y++)
+        {
+            double YA = Max((double)Y, Edge->Y0);
+            double YB = Min((double)(Y + 1), Edge->Y1);
+            if (YB <= YA) continue;
+            
+            double XA = Edge->X0 + ((YA - Edge->Y0) * DxDy);
+            double XB = Edge->X0 + ((YB - Edge->Y0) * DxDy);
+            double* Line = Accumulator + ((Y - Row) * LineSize);
+            AccumulateClippedSpan(Line, Width, XA, XB, (YB - YA) * Edge->Sign);
+        }
+    }
+    
+    for (int LineIdx = 0; LineIdx < NumRows; LineIdx++)
+    {
+        double* Line = Accumulator + (LineIdx * LineSize);
+        double* ResultLine = Result + ((usz)LineIdx * Width);
+        double Sum = 0;
+        for (int Pixel = 0; Pixel < Width; Pixel++)
+        {
+            Sum += Line[Pixel];
+            ResultLine[Pixel] = Clamp01(Sum);
+        }
+    }
+}
+
+internal usz
+RasterizeCutMask(cut_coverage* Coverage, int Row, int NumRows, int Width,
+                 double* Accumulator, u8* Result)
+{
+    // Pixels with their center inside the cut, the ones the warp cutline keeps.
+    // [Accumulator] holds ([Width] + 2) * [NumRows] values, and [Result] gets
+    // [Width] * [NumRows] flags.
+    // Return: number of pixels inside.
+    
+    usz LineSize = (usz)Width + 2;
+    memset(Accumulator, 0, sizeof(double) * LineSize * NumRows);
+    
+    for (int EdgeIdx = 0; EdgeIdx < Coverage->NumEdges; EdgeIdx++)
+    {
+        cut_edge* Edge = &Coverage->Edges[EdgeIdx];
+        if (Edge->Y1 <= Row || Edge->Y0 >= Row + NumRows) continue;
+        
+        // Rows with their center in [Y0, Y1), crossing at the first pixel center
+        // right of the edge.
+        double DxDy = (Edge->X1 - Edge->X0) / (Edge->Y1 - Edge->Y0);
+        int FirstRow = Max((int)ceil(Edge->Y0 - 0.5), Row);
+        int LastRow = Min((int)ceil(Edge->Y1 - 0.5), Row + NumRows);
+        for (int Y = FirstRow; Y < LastRow; Y++)
+        {
+            double X = Edge->X0 + ((Y + 0.5 - Edge->Y0) * DxDy);
+            int Pixel = Clamp((int)ceil(X - 0.5), 0, Width);
+            Accumulator[((Y - Row) * LineSize) + Pixel] += Edge->Sign;
+        }
+    }
+    
+    usz NumInside = 0;
+    for (int LineIdx = 0; LineIdx < NumRows; LineIdx++)
+    {
+        double* Line = Accumulator + (LineIdx * LineSize);
+        u8* ResultLine = Result + ((usz)LineIdx * Width);
+        double Sum = 0;
+        for (int Pixel = 0; Pixel < Width; Pixel++)
+        {
+            Sum += Line[Pixel];
+            ResultLine[Pixel] = (Sum > 0.5);
+            NumInside += ResultLine[Pixel];
+        }
+    }
+    return NumInside;
+}
+
+internal double
+GetAlphaMax(GDALDataType DType)
+{
+    // Value of a fully covered pixel in the alpha band.
+    switch (DType)
+    {
+        case GDT_Byte:   return 255;
+        case GDT_UInt16: return 65535;
+        case GDT_Int16:  return 32767;
+        case GDT_UInt32: return 4294967295.0;
+        case GDT_Int32:  return 2147483647.0;
+        default:         return 1;
+    }
+}
+
+//
+// Overviews
+//
+// Overview levels of the output are filled from each block as soon as it is
+// composited, halving it in memory once per level, instead of reading the whole
+// output back afterwards. Blocks start at rows that are a multiple of the coarsest
+// factor, so every block maps to whole rows in every level.
+//
+
+#define CUT_MAX_OVERVIEWS 16
+
+struct cut_overviews
+{
+    int NumLevels;                   // Level N is (2^(N+1)) times coarser than the output.
+    int NumPlanes;                   // Bands of the output, alpha included.
+    bool Nearest;                    // Nearest neighbour instead of average.
+    double* NoData;                  // One per plane, NaN if the plane has no NoData.
+    GDALRasterBandH* Bands;          // [Level * NumPlanes + Plane].
+    double* Halves[2];               // Halved blocks, alternating between levels.
+};
+
+internal int
+GetNumOverviews(cut_options* Options, int XSize, int YSize)
+{
+    int Result = 0;
+    while (Result < Min(Options->NumOverviews, CUT_MAX_OVERVIEWS)
+           && Max(XSize, YSize) >> (Result + 1) > 0)
+    {
+        Result++;
+    }
+    return Result;
+}
+
+internal bool
+CreateOverviewLevels(GDALDatasetH DstDS, int NumLevels)
+{
+    // "NONE" creates the levels without computing them, they are filled by the cut.
+    
+    if (NumLevels <= 0) return true;
+    
+    int Factors[CUT_MAX_OVERVIEWS];
+    for (int Level = 0; Level < NumLevels; Level++)
+    {
+        Factors[Level] = 2 << Level;
+    }
+    CPLErr Error = GDALBuildOverviews(DstDS, "NONE", NumLevels, Factors, 0, NULL, NULL, NULL);
+    return (Error == CE_None);
+}
+
+internal cut_overviews
+OpenOverviewLevels(GDALDatasetH DstDS, int NumLevels, int NumPlanes, double* NoData,
+                   bool Nearest, int BlockRows)
+{
+    // Levels are matched by size, as drivers don't have to keep them in order.
+    // Only the levels present in every band are used.
+    
+    cut_overviews Overviews = {0};
+    if (NumLevels <= 0) return Overviews;
+    
+    Overviews.NumPlanes = NumPlanes;
+    Overviews.Nearest = Nearest;
+    Overviews.NoData = NoData;
+    Overviews.Bands = (GDALRasterBandH*)CPLCalloc(NumLevels * NumPlanes,
+                                                  sizeof(GDALRasterBandH));
+    int XSize = GDALGetRasterXSize(DstDS);
+    int YSize = GDALGetRasterYSize(DstDS);
+    
+    for (int Level = 0; Level < NumLevels; Level++)
+    {
+        int Factor = 2 << Level;
+        int LevelXSize = (XSize + Factor - 1) / Factor;
+        int LevelYSize = (YSize + Factor - 1) / Factor;
+        
+        bool Found = true;
+        for (int Plane = 0; Plane < NumPlanes && Found; Plane++)
+        {
+            GDALRasterBandH Band = GDALGetRasterBand(DstDS, Plane + 1);
+            GDALRasterBandH* LevelBand = &Overviews.Bands[(Level * NumPlanes) + Plane];
+            for (int OvrIdx = 0; OvrIdx < GDALGetOverviewCount(Band); OvrIdx++)
+            {
+                GDALRasterBandH Overview = GDALGetOverview(Band, OvrIdx);
+                if (GDALGetRasterBandXSize(Overview) == LevelXSize
+                    && GDALGetRasterBandYSize(Overview) == LevelYSize)
+                {
+                    *LevelBand = Overview;
+                    break;
+                }
+            }
+            Found = (*LevelBand != NULL);
+        }
+        if (!Found) break;
+        Overviews.NumLevels++;
+    }
+    
+    usz HalfSize = (usz)NumPlanes * ((XSize + 1) / 2) * ((BlockRows + 1) / 2);
+    Overviews.Halves[0] = (double*)CPLMalloc(sizeof(double) * Max(HalfSize, 1));
+    Overviews.Halves[1] = (double*)CPLMalloc(sizeof(double) * Max(HalfSize, 1));
+    return Overviews;
+}
+
+internal void
+CloseOverviewLevels(cut_overviews* Overviews)
+{
+    CPLFree(Overviews->Bands);
+    CPLFree(Overviews->Halves[0]);
+    CPLFree(Overviews->Halves[1]);
+    *Overviews = {0};
+}
+
+internal void
+HalveBlock(cut_overviews* Overviews, double* Src, int SrcXSize, int SrcYSize, double* Dst)
+{
+    // Both [Src] and [Dst] are band-sequential. The last column and row take the
+    // pixels left when the size is odd.
+    
+    int DstXSize = (SrcXSize + 1) / 2;
+    int DstYSize = (SrcYSize + 1) / 2;
+    for (int Plane = 0; Plane < Overviews->NumPlanes; Plane++)
+    {
+        double NoData = Overviews->NoData[Plane];
+        double* SrcPlane = Src + ((usz)Plane * SrcXSize * SrcYSize);
+        double* DstPlane = Dst + ((usz)Plane * DstXSize * DstYSize);
+        
+        for (int Y = 0; Y < DstYSize; Y++)
+        {
+            for (int X = 0; X < DstXSize; X++)
+            {
+                double* DstPixel = &DstPlane[((usz)Y * DstXSize) + X];
+                if (Overviews->Nearest)
+                {
+                    *DstPixel = SrcPlane[((usz)(2 * Y) * SrcXSize) + (2 * X)];
+                    continue;
+                }
+                
+                double Sum = 0;
+                int Count = 0;
+                for (int SrcY = 2 * Y; SrcY < Min(2 * Y + 2, SrcYSize); SrcY++)
+                {
+                    for (int SrcX = 2 * X; SrcX < Min(2 * X + 2, SrcXSize); SrcX++)
+                    {
+                        double Value = SrcPlane[((usz)SrcY * SrcXSize) + SrcX];
+                        if (Value == NoData) continue;
+                        Sum += Value;
+                        Count++;
+                    }
+                }
+                *DstPixel = (Count > 0) ? Sum / Count : NoData;
+            }
+        }
+    }
+}
+
+internal bool
+WriteOverviewBlocks(cut_overviews* Overviews, double* Block, int Row, int XSize, int NumRows)
+{
+    double* Src = Block;
+    int SrcXSize = XSize;
+    int SrcYSize = NumRows;
+    int SrcRow = Row;
+    
+    for (int Level = 0; Level < Overviews->NumLevels; Level++)
+    {
+        double* Dst = Overviews->Halves[Level % 2];
+        HalveBlock(Overviews, Src, SrcXSize, SrcYSize, Dst);
+        
+        int DstXSize = (SrcXSize + 1) / 2;
+        int DstYSize = (SrcYSize + 1) / 2;
+        int DstRow = SrcRow / 2;
+        for (int Plane = 0; Plane < Overviews->NumPlanes; Plane++)
+        {
+            GDALRasterBandH Band = Overviews->Bands[(Level * Overviews->NumPlanes) + Plane];
+            int NumLines = Min(DstYSize, GDALGetRasterBandYSize(Band) - DstRow);
+            if (NumLines <= 0) continue;
+            
+            double* DstPlane = Dst + ((usz)Plane * DstXSize * DstYSize);
+            if (GDALRasterIO(Band, GF_Write, 0, DstRow, DstXSize, NumLines, DstPlane,
+                             DstXSize, NumLines, GDT_Float64, 0, 0) != CE_None)
+            {
+                return false;
+            }
+        }
+        
+        Src = Dst;
+        SrcXSize = DstXSize;
+        SrcYSize = DstYSize;
+        SrcRow = DstRow;
+    }
+    return true;
+}
+
+//
+// Compositing
+//
+// With a blend mode other than CutBlend_LastValid, the sources are not read through
+// the VRT mosaic. Each one gets its own warp straight into the output grid, and the
+// output is written block by block, compositing all the sources of a block in
+// memory before it is written. Sources are sorted by priority first, so for the
+// priority modes a block stops reading sources as soon as every pixel is filled.
+//
+
+#define CUT_BLEND_BLOCK_SIZE (16*1024*1024) // Bytes of each block buffer.
+#define CUT_DEFAULT_FEATHER_WIDTH 16
+
+struct re_blend_source
+{
+    GDALDatasetH DS;
+    double Priority;                 // Sources are composited from lowest to highest.
+    int XSize, YSize;
+    cut_transformer Transformer;     // Source pixels -> output pixels.
+    void* WarpTransformer;           // From SetWarpTransformer(), NULL if none.
+    GDALWarpOperation* Warp;
+    GDALDatasetH OverviewDS;         // Read instead of [DS] for coarser outputs.
+};
+
+internal double
+DateToNumber(const char* Date)
+{
+    // Any date written from most to least significant field (2020-01-31T10:00:00,
+    // 2020:01:31 10:00:00, 20200131...) becomes YYYYMMDDhhmmss, which sorts in
+    // time order regardless of the separators used.
+    
+    double Result = 0;
+    int NumDigits = 0;
+    for (; *Date && NumDigits < 14; Date++)
+    {
+        if (*Date >= '0' && *Date <= '9')
+        {
+            Result = (Result * 10) + (*Date - '0');
+            NumDigits++;
+        }
+    }
+    for (; NumDigits < 14; NumDigits++)
+    {
+        Result *= 10;
+    }
+    return Result;
+}
+
+internal const char*
+FindPriorityItem(GDALDatasetH DS, const char* Key, const char** DefaultKeys)
+{
+    // Imagery metadata is either in the default domain or in IMAGERY, where GDAL
+    // puts the one read from sidecar files of satellite products.
+    
+    local const char* Domains[] = { NULL, "IMAGERY" };
+    for (int DomainIdx = 0; DomainIdx < (int)(ArrayCount(Domains)); DomainIdx++)
+    {
+        if (Key)
+        {
+            const char* Value = GDALGetMetadataItem(DS, Key, Domains[DomainIdx]);
+            if (Value) return Value;
+            continue;
+        }
+        for (const char** Name = DefaultKeys; *Name; Name++)
+        {
+            const char* Value = GDALGetMetadataItem(DS, *Name, Domains[DomainIdx]);
+            if (Value) return Value;
+        }
+    }
+    return NULL;
+}
+
+internal double
+GetSourcePriority(GDALDatasetH DS, cut_options* Options)
+{
+    local const char* DateKeys[] = { "ACQUISITIONDATETIME", "DATE_ACQUIRED",
+        "SENSING_TIME", "TIFFTAG_DATETIME", NULL };
+    local const char* CloudKeys[] = { "CLOUDCOVER", "CLOUD_COVER",
+        "CLOUD_COVERAGE_ASSESSMENT", "CLOUDY_PIXEL_PERCENTAGE", NULL };
+    
+    double Result = 0;
+    if (Options->Blend == CutBlend_MostRecent)
+    {
+        // Newest first, falling back to the modification time of the file.
+        const char* Date = FindPriorityItem(DS, Options->PriorityKey, DateKeys);
+        if (Date)
+        {
+            Result = -DateToNumber(Date);
+        }
+        else
+        {
+            VSIStatBufL Stat;
+            time_t ModifiedTime = 0;
+            struct tm* Time = NULL;
+            if (VSIStatL(GDALGetDescription(DS), &Stat) == 0)
+            {
+                ModifiedTime = Stat.st_mtime;
+                Time = gmtime(&ModifiedTime);
+            }
+            if (Time)
+            {
+                char TimeString[32];
+                strftime(TimeString, sizeof(TimeString), "%Y%m%d%H%M%S", Time);
+                Result = -DateToNumber(TimeString);
+            }
+        }
+    }
+    else if (Options->Blend == CutBlend_MinCloud)
+    {
+        // Sources without cloud cover go last.
+        const char* Cloud = FindPriorityItem(DS, Options->PriorityKey, CloudKeys);
+        Result = (Cloud) ? atof(Cloud) : 1000.0;
+    }
+    
+    return Result;
+}
+
+internal void
+CloseBlendSources(re_blend_source* Sources, int NumSources)
+{
+    for (int Idx = 0; Idx < NumSources; Idx++)
+    {
+        re_blend_source* Source = &Sources[Idx];
+        delete Source->Warp;
+        if (Source->WarpTransformer) GDALDestroyTransformer(Source->WarpTransformer);
+        if (Source->OverviewDS) GDALClose(Source->OverviewDS);
+        ReleaseCachedTransformer(Source->Transformer.Reprojection);
+    }
+    CPLFree(Sources);
+}
+
+internal bool
+OpenBlendSource(re_blend_source* Source, re_cut* Cut, GDALDatasetH DstDS, double* NoData,
+                cut_options* Options)
+{
+    // Mosaic was already swapped for its overview by PrepareCut(). Sources are
+    // assumed to have about the same resolution as the mosaic.
+    if (Source->DS != Cut->Src.DS)
+    {
+        Source->OverviewDS = OpenOverview(Source->DS, Cut->Scale);
+        if (Source->OverviewDS) Source->DS = Source->OverviewDS;
+    }
+    
+    const char* SrcWKT = GDALGetProjectionRef(Source->DS);
+    cut_transformer* Transformer = &Source->Transformer;
+    GDALGetGeoTransform(Source->DS, Transformer->SrcAffine);
+    GDALInvGeoTransform(Transformer->SrcAffine, Transformer->SrcInvAffine);
+    CopyData(Transformer->DstAffine, sizeof(Transformer->DstAffine),
+             Cut->Affine, sizeof(Cut->Affine));
+    GDALInvGeoTransform(Transformer->DstAffine, Transformer->DstInvAffine);
+    Transformer->Reprojection = GetReprojection(SrcWKT, Cut->DstWKT);
+    Source->XSize = GDALGetRasterXSize(Source->DS);
+    Source->YSize = GDALGetRasterYSize(Source->DS);
+    
+    int NumBands = Cut->Src.NumBands;
+    GDALWarpOptions* WarpOptions = GDALCreateWarpOptions();
+    WarpOptions->hSrcDS = Source->DS;
+    WarpOptions->hDstDS = DstDS;
+    WarpOptions->eResampleAlg = GetWarpResampling(Options);
+    WarpOptions->eWorkingDataType = GDT_Float64;
+    WarpOptions->nBandCount = NumBands;
+    WarpOptions->panSrcBands = (int*)CPLMalloc(sizeof(int) * NumBands);
+    WarpOptions->panDstBands = (int*)CPLMalloc(sizeof(int) * NumBands);
+    WarpOptions->padfSrcNoDataReal = (double*)CPLMalloc(sizeof(double) * NumBands);
+    WarpOptions->padfDstNoDataReal = (double*)CPLMalloc(sizeof(double) * NumBands);
+    for (int BandIdx = 1; BandIdx <= NumBands; BandIdx++)
+    {
+        GDALRasterBandH InBand = GDALGetRasterBand(Source->DS, BandIdx);
+        int HasNoData = 0;
+        double SrcNoData = GDALGetRasterNoDataValue(InBand, &HasNoData);
+        
+        WarpOptions->panSrcBands[BandIdx-1] = BandIdx;
+        WarpOptions->panDstBands[BandIdx-1] = BandIdx;
+        WarpOptions->padfSrcNoDataReal[BandIdx-1] = (HasNoData) ? SrcNoData : NoData[BandIdx-1];
+        WarpOptions->padfDstNoDataReal[BandIdx-1] = NoData[BandIdx-1];
+    }
+    if (Options->NumThreads != 0)
+    {
+        const char* NumThreads = (Options->NumThreads < 0) ? "ALL_CPUS"
+            : CPLSPrintf("%d", Options->NumThreads);
+        WarpOptions->papszWarpOptions = CSLSetNameValue(WarpOptions->papszWarpOptions,
+                                                        "NUM_THREADS", NumThreads);
+    }
+    
+    // Cutline must be in the pixels of this source, not the ones of the mosaic.
+    // With coverage, the whole window is warped and the coverage masks it instead,
+    // as pixels partially inside the polygon are kept.
+    if (!Options->Coverage)
+    {
+        void* CutToSrc = GetReprojection(Cut->CutWKT, SrcWKT);
+        WarpOptions->hCutline = XYGeomToPLGeom(Cut->CutRings, Cut->NumRings,
+                                               Transformer->SrcAffine, CutToSrc);
+        ReleaseCachedTransformer(CutToSrc);
+    }
+    
+    Source->WarpTransformer = SetWarpTransformer(WarpOptions, Transformer, Cut->DstWKT, Options);
+    
+    // The warp operation keeps its own copy of the options and the cutline.
+    Source->Warp = new GDALWarpOperation;
+    CPLErr Error = CE_Failure;
+    if (WarpOptions->pTransformerArg)
+    {
+        Error = Source->Warp->Initialize(WarpOptions);
+    }
+    if (WarpOptions->hCutline) OGR_G_DestroyGeometry(WarpOptions->hCutline);
+    WarpOptions->hCutline = NULL;
+    GDALDestroyWarpOptions(WarpOptions);
+    
+    return (Error == CE_None);
+}
+
+internal void
+GetFeatherWeights(re_blend_source* Source, int Row, int XSize, int YSize, double Width,
+                  double* Weights, double* Scratch)
+{
+    // Weight of each output pixel grows linearly from the edge of the source
+    // footprint up to one at [Width] pixels inside. [Scratch] holds 4 * [XSize].
+    
+    double* X = Scratch;
+    double* Y = Scratch + XSize;
+    double* Z = Scratch + (2 * XSize);
+    int* Success = (int*)(Scratch + (3 * XSize));
+    const GDALWarpOptions* WarpOptions = Source->Warp->GetOptions();
+    
+    for (int LineIdx = 0; LineIdx < YSize; LineIdx++)
+    {
+        for (int PixelIdx = 0; PixelIdx < XSize; PixelIdx++)
+        {
+            X[PixelIdx] = PixelIdx + 0.5;
+            Y[PixelIdx] = Row + LineIdx + 0.5;
+            Z[PixelIdx] = 0;
+        }
+        WarpOptions->pfnTransformer(WarpOptions->pTransformerArg, TRUE, XSize, X, Y, Z, Success);
+        
+        double* LineWeights = Weights + ((usz)LineIdx * XSize);
+        for (int PixelIdx = 0; PixelIdx < XSize; PixelIdx++)
+        {
+            double Distance = Min(Min(X[PixelIdx], Source->XSize - X[PixelIdx]),
+                                  Min(Y[PixelIdx], Source->YSize - Y[PixelIdx]));
+            double Weight = Distance / Width;
+            LineWeights[PixelIdx] = (Success[PixelIdx]) ? Max(Clamp01(Weight), 1e-6) : 1e-6;
+        }
+    }
+}
+
+internal void
+AccumulateStats(cut_stats* Stats, int NumStats, double* Pixels, double* Cover,
+                usz NumPixels, int NumBands, double* NoData)
+{
+    // [Cover] weights each pixel by its area inside the cut, and is NULL when the
+    // pixels outside were already set to NoData by the cutline.
+    
+    for (int BandIdx = 0; BandIdx < Min(NumBands, NumStats); BandIdx++)
+    {
+        cut_stats* Band = &Stats[BandIdx];
+        double* Values = Pixels + (BandIdx * NumPixels);
+        double BinScale = CUT_HISTOGRAM_BINS / (Band->HistMax - Band->HistMin);
+        
+        for (usz Idx = 0; Idx < NumPixels; Idx++)
+        {
+            double Value = Values[Idx];
+            double Weight = (Cover) ? Cover[Idx] : 1.0;
+            if (Value == NoData[BandIdx] || Weight <= 0) continue;
+            
+            Band->Count += Weight;
+            Band->Sum += Weight * Value;
+            Band->Min = Min(Band->Min, Value);
+            Band->Max = Max(Band->Max, Value);
+            
+            if (Value >= Band->HistMin && Value <= Band->HistMax)
+            {
+                int Bin = (int)((Value - Band->HistMin) * BinScale);
+                Band->Histogram[Min(Bin, CUT_HISTOGRAM_BINS - 1)] += Weight;
+            }
+        }
+    }
+}
+
+internal void
+InitStats(cut_stats* Stats, int NumStats, GDALDatasetH DS)
+{
+    for (int BandIdx = 0; BandIdx < NumStats; BandIdx++)
+    {
+        cut_stats* Band = &Stats[BandIdx];
+        double HistMin = Band->HistMin;
+        double HistMax = Band->HistMax;
+        if (BandIdx < GDALGetRasterCount(DS) && HistMin >= HistMax)
+        {
+            GDALRasterBandH InBand = GDALGetRasterBand(DS, BandIdx + 1);
+            if (GDALGetRasterDataType(InBand) == GDT_Byte)
+            {
+                HistMin = 0;
+                HistMax = 255;
+            }
+            else
+            {
+                // Approximate range is read from overviews when there are some.
+                double MinMax[2] = { 0, 0 };
+                GDALComputeRasterMinMax(InBand, TRUE, MinMax);
+                HistMin = MinMax[0];
+                HistMax = (MinMax[1] > MinMax[0]) ? MinMax[1] : MinMax[0] + 1;
+            }
+        }
+        
+        *Band = {0};
+        Band->Min = INFINITY;
+        Band->Max = -INFINITY;
+        Band->HistMin = HistMin;
+        Band->HistMax = HistMax;
+    }
+}
+
+internal bool
+BlendCut(re_cut* Cut, GDALDatasetH DstDS, cut_stats* Stats, int NumStats,
+         cut_options* Options)
+{
+    // Without blending (or with a single source) the mosaic is the only source,
+    // and the block pass is only used to apply the coverage. Without [DstDS], the
+    // pixels of each block are accumulated into [Stats] instead of written.
+    
+    re_mosaic* Src = &Cut->Src;
+    int NumBands = Src->NumBands;
+    bool Blend = (Options->Blend != CutBlend_LastValid && Src->NumSrcDS > 1);
+    int NumSources = (Blend) ? Src->NumSrcDS : 1;
+    
+    if (DstDS)
+    {
+        GDALSetProjection(DstDS, Cut->DstWKT);
+        GDALSetGeoTransform(DstDS, Cut->Affine);
+    }
+    
+    // OBS: Bands without NoData are filled with zero, as WarpCut() does, and the output
+    // only gets a NoData value for the bands that have one.
+    double* NoData = (double*)CPLMalloc(sizeof(double) * NumBands);
+    for (int BandIdx = 1; BandIdx <= NumBands; BandIdx++)
+    {
+        GDALRasterBandH InBand = GDALGetRasterBand(Src->DS, BandIdx);
+        int HasNoData = 0;
+        double BandNoData = GDALGetRasterNoDataValue(InBand, &HasNoData);
+        NoData[BandIdx-1] = (HasNoData) ? BandNoData : 0;
+        if (DstDS && HasNoData)
+        {
+            GDALSetRasterNoDataValue(GDALGetRasterBand(DstDS, BandIdx), NoData[BandIdx-1]);
+        }
+    }
+    
+    // Stable insertion sort, so sources with the same priority keep list order.
+    
+    re_blend_source* Sources = (re_blend_source*)CPLCalloc(NumSources,
+                                                           sizeof(re_blend_source));
+    for (int Idx = 0; Idx < NumSources; Idx++)
+    {
+        re_blend_source Source = {0};
+        Source.DS = (Blend) ? Src->SrcDS[Idx] : Src->DS;
+        Source.Priority = GetSourcePriority(Source.DS, Options);
+        
+        int InsertIdx = Idx;
+        while (InsertIdx > 0 && Sources[InsertIdx-1].Priority > Source.Priority)
+        {
+            Sources[InsertIdx] = Sources[InsertIdx-1];
+            InsertIdx--;
+        }
+        Sources[InsertIdx] = Source;
+    }
+    
+    bool Result = true;
+    for (int Idx = 0; Idx < NumSources && Result; Idx++)
+    {
+        Result = OpenBlendSource(&Sources[Idx], Cut, DstDS, NoData, Options);
+    }
+    
+    // Each block is a band-sequential set of full rows. Feathering needs the
+    // per-pixel weights and their sum besides the pixels themselves.
+    
+    bool Feather = (Options->Blend == CutBlend_Feather);
+    double FeatherWidth = (Options->FeatherWidth > 0) ? Options->FeatherWidth
+        : CUT_DEFAULT_FEATHER_WIDTH;
+    int NumPlanes = NumBands + ((DstDS && Options->Coverage) ? 1 : 0);
+    int NumLevels = (DstDS) ? GetNumOverviews(Options, Cut->XSize, Cut->YSize) : 0;
+    int RowAlign = 1 << NumLevels;
+    usz RowSize = (usz)Cut->XSize * NumPlanes * sizeof(double);
+    int BlockRows = Clamp((int)(CUT_BLEND_BLOCK_SIZE / Max(RowSize, 1)), 1, Max(Cut->YSize, 1));
+    BlockRows = Max((BlockRows / RowAlign) * RowAlign, RowAlign);
+    usz BlockPixels = (usz)Cut->XSize * BlockRows;
+    
+    double* Composite = (double*)CPLMalloc(sizeof(double) * BlockPixels * NumPlanes);
+    double* Block = (double*)CPLMalloc(sizeof(double) * BlockPixels * NumBands);
+    u8* Filled = (u8*)CPLMalloc(BlockPixels);
+    u8* Inside = (u8*)CPLMalloc(BlockPixels);
+    double* Weights = (Feather) ? (double*)CPLMalloc(sizeof(double) * BlockPixels) : NULL;
+    double* WeightSum = (Feather) ? (double*)CPLMalloc(sizeof(double) * BlockPixels) : NULL;
+    double* Scratch = (Feather) ? (double*)CPLMalloc(sizeof(double) * 4 * Cut->XSize) : NULL;
+    
+    // Cut edges in output pixels also give the pixels each block must fill, so
+    // sources are only read until all of them are.
+    cut_coverage Coverage = BuildCoverageEdges(Cut);
+    double* Accumulator = (double*)CPLMalloc(sizeof(double) * (Cut->XSize + 2) * BlockRows);
+    double* Cover = NULL;
+    double AlphaMax = GetAlphaMax(Cut->DType);
+    if (Options->Coverage)
+    {
+        Cover = (double*)CPLMalloc(sizeof(double) * BlockPixels);
+        if (DstDS)
+        {
+            GDALRasterBandH AlphaBand = GDALGetRasterBand(DstDS, NumBands + 1);
+            GDALSetRasterColorInterpretation(AlphaBand, GCI_AlphaBand);
+        }
+    }
+    
+    // Alpha plane has no NoData, and NaN never compares equal.
+    double* PlaneNoData = (double*)CPLMalloc(sizeof(double) * NumPlanes);
+    for (int Plane = 0; Plane < NumPlanes; Plane++)
+    {
+        PlaneNoData[Plane] = (Plane < NumBands) ? NoData[Plane] : NAN;
+    }
+    cut_overviews Overviews = OpenOverviewLevels(DstDS, NumLevels, NumPlanes, PlaneNoData,
+                                                 Options->OverviewResampling
+                                                 == CutResample_Nearest, BlockRows);
+    
+    for (int Row = 0; Row < Cut->YSize && Result; Row += BlockRows)
+    {
+        int NumRows = Min(BlockRows, Cut->YSize - Row);
+        usz NumPixels = (usz)Cut->XSize * NumRows;
+        usz NumFilled = 0;
+        usz NumInside = 0;
+        
+        // With coverage the whole window is warped, and partially covered pixels
+        // are kept too.
+        if (Options->Coverage)
+        {
+            RasterizeCoverage(&Coverage, Row, NumRows, Cut->XSize, Accumulator, Cover);
+            for (usz Idx = 0; Idx < NumPixels; Idx++)
+            {
+                Inside[Idx] = (Cover[Idx] > 0);
+                NumInside += Inside[Idx];
+            }
+        }
+        else
+        {
+            NumInside = RasterizeCutMask(&Coverage, Row, NumRows, Cut->XSize,
+                                         Accumulator, Inside);
+        }
+        
+        for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+        {
+            double* Band = Composite + (BandIdx * NumPixels);
+            for (usz Idx = 0; Idx < NumPixels; Idx++)
+            {
+                Band[Idx] = (Feather) ? 0 : NoData[BandIdx];
+            }
+        }
+        memset(Filled, 0, NumPixels);
+        if (Feather) memset(WeightSum, 0, sizeof(double) * NumPixels);
+        
+        for (int SourceIdx = 0; SourceIdx < NumSources && NumFilled < NumInside; SourceIdx++)
+        {
+            re_blend_source* Source = &Sources[SourceIdx];
+            for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+            {
+                double* Band = Block + (BandIdx * NumPixels);
+                for (usz Idx = 0; Idx < NumPixels; Idx++)
+                {
+                    Band[Idx] = NoData[BandIdx];
+                }
+            }
+            if (Source->Warp->WarpRegionToBuffer(0, Row, Cut->XSize, NumRows, Block,
+                                                 GDT_Float64) != CE_None)
+            {
+                Result = false;
+                break;
+            }
+            
+            if (Feather)
+            {
+                GetFeatherWeights(Source, Row, Cut->XSize, NumRows, FeatherWidth,
+                                  Weights, Scratch);
+            }
+            
+            for (usz Idx = 0; Idx < NumPixels; Idx++)
+            {
+                bool IsValid = false;
+                for (int BandIdx = 0; BandIdx < NumBands && !IsValid; BandIdx++)
+                {
+                    IsValid = (Block[(BandIdx * NumPixels) + Idx] != NoData[BandIdx]);
+                }
+                
+                if (!IsValid || (!Feather && Filled[Idx]))
+                {
+                    continue;
+                }
+                
+                if (Feather)
+                {
+                    for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+                    {
+                        usz BandPixel = (BandIdx * NumPixels) + Idx;
+                        Composite[BandPixel] += Weights[Idx] * Block[BandPixel];
+                    }
+                    WeightSum[Idx] += Weights[Idx];
+                    Filled[Idx] = 1;
+                }
+                else
+                {
+                    for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+                    {
+                        usz BandPixel = (BandIdx * NumPixels) + Idx;
+                        Composite[BandPixel] = Block[BandPixel];
+                    }
+                    Filled[Idx] = 1;
+                    NumFilled += Inside[Idx];
+                }
+            }
+        }
+        
+        if (Feather)
+        {
+            for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+            {
+                double* Band = Composite + (BandIdx * NumPixels);
+                for (usz Idx = 0; Idx < NumPixels; Idx++)
+                {
+                    Band[Idx] = (Filled[Idx]) ? Band[Idx] / WeightSum[Idx] : NoData[BandIdx];
+                }
+            }
+        }
+        
+        if (Options->Coverage)
+        {
+            for (int BandIdx = 0; BandIdx < NumBands; BandIdx++)
+            {
+                double* Band = Composite + (BandIdx * NumPixels);
+                for (usz Idx = 0; Idx < NumPixels; Idx++)
+                {
+                    Band[Idx] = (Cover[Idx] > 0) ? Band[Idx] : NoData[BandIdx];
+                }
+            }
+        }
+        
+        if (Result && !DstDS)
+        {
+            AccumulateStats(Stats, NumStats, Composite, Cover, NumPixels, NumBands, NoData);
+        }
+        else if (Result)
+        {
+            if (NumPlanes > NumBands)
+            {
+                double* Alpha = Composite + (NumBands * NumPixels);
+                for (usz Idx = 0; Idx < NumPixels; Idx++)
+                {
+                    Alpha[Idx] = Cover[Idx] * AlphaMax;
+                }
+            }
+            
+            Result = (GDALDatasetRasterIO(DstDS, GF_Write, 0, Row, Cut->XSize, NumRows,
+                                          Composite, Cut->XSize, NumRows, GDT_Float64,
+                                          NumPlanes, NULL, 0, 0, 0) == CE_None);
+            if (Result && Overviews.NumLevels > 0)
+            {
+                Result = WriteOverviewBlocks(&Overviews, Composite, Row, Cut->XSize, NumRows);
+            }
+        }
+    }
+    
+    CPLFree(Composite);
+    CPLFree(Block);
+    CPLFree(Filled);
+    CPLFree(Inside);
+    CPLFree(Weights);
+    CPLFree(WeightSum);
+    CPLFree(Scratch);
+    CPLFree(Coverage.Edges);
+    CPLFree(Cover);
+    CPLFree(Accumulator);
+    CloseOverviewLevels(&Overviews);
+    CPLFree(PlaneNoData);
+    CPLFree(NoData);
+    CloseBlendSources(Sources, NumSources);
+    
+    return Result;
+}
+
+internal bool
+WriteCut(re_cut* Cut, GDALDatasetH DstDS, cut_options* Options)
+{
+    // A single source has nothing to blend with.
+    bool Blend = (Options->Blend != CutBlend_LastValid && Cut->Src.NumSrcDS > 1);
+    bool Stream = (Blend || Options->Coverage || Options->NumOverviews > 0);
+    bool Result = (Stream) ? BlendCut(Cut, DstDS, NULL, 0, Options)
+        : WarpCut(Cut, DstDS, Options);
+    return Result;
+}
+
+external GDALDatasetH
+RasterCut(char* DstRaster, char** SrcRasterList, int NumSrcRasters, cut_ring* CutRings,
+          int NumRings, cut_options* Options)
+{
+    GDALDatasetH DstDS = 0;
+    cut_options DefaultOptions = {0};
+    if (!Options) Options = &DefaultOptions;
+    
+    re_cut Cut = {0};
+    if (!PrepareCut(&Cut, SrcRasterList, NumSrcRasters, CutRings, NumRings, Options))
+    {
+        return DstDS;
+    }
+    
+    if (DstRaster)
+    {
+        DstDS = CreateOutputRaster(DstRaster, Options, Cut.XSize, Cut.YSize,
+                                   Cut.NumDstBands, Cut.DType);
+    }
+    else
+    {
+        GDALDriverH MemDriver = GDALGetDriverByName("MEM");
+        DstDS = GDALCreate(MemDriver, "", Cut.XSize, Cut.YSize, Cut.NumDstBands,
+                           Cut.DType, NULL);
+    }
+    
+    if (DstDS)
+    {
+        int NumOverviews = GetNumOverviews(Options, Cut.XSize, Cut.YSize);
+        if (!CreateOverviewLevels(DstDS, NumOverviews)
+            || !WriteCut(&Cut, DstDS, Options))
+        {
+            GDALClose(DstDS);
+            DstDS = NULL;
+        }
+        else if (DstRaster)
+        {
+            DstDS = FinishOutputRaster(DstRaster, Options, DstDS);
+        }
+    }
+    
+    CloseCut(&Cut);
+    return DstDS;
+}
+
+external bool
+RasterCutToBuffer(buffer* Dst, cut_info* Info, char** SrcRasterList, int NumSrcRasters,
+                  cut_ring* CutRings, int NumRings, cut_options* Options)
+{
+    cut_options DefaultOptions = {0};
+    if (!Options) Options = &DefaultOptions;
+    
+    re_cut Cut = {0};
+    if (!PrepareCut(&Cut, SrcRasterList, NumSrcRasters, CutRings, NumRings, Options))
+    {
+        return false;
+    }
+    
+    usz DTypeSize = GDALGetDataTypeSizeBytes(Cut.DType);
+    usz BandSize = (usz)Cut.XSize * Cut.YSize * DTypeSize;
+    
+    Info->XSize = Cut.XSize;
+    Info->YSize = Cut.YSize;
+    Info->NumBands = Cut.NumDstBands;
+    Info->DType = Cut.DType;
+    Info->BufferSize = BandSize * Cut.NumDstBands;
+    CopyData(Info->Affine, sizeof(Info->Affine), Cut.Affine, sizeof(Cut.Affine));
+    
+    bool Result = false;
+    if (Info->BufferSize > 0
+        && Dst->Base
+        && Info->BufferSize <= Dst->Size)
+    {
+        // MEM dataset wraps the caller memory, so the warp writes directly into it.
+        
+        GDALDriverH MemDriver = GDALGetDriverByName("MEM");
+        GDALDatasetH DstDS = GDALCreate(MemDriver, "", Cut.XSize, Cut.YSize, 0, Cut.DType, NULL);
+        if (DstDS)
+        {
+            for (int BandIdx = 0; BandIdx < Cut.NumDstBands; BandIdx++)
+            {
+                u8* BandPtr = Dst->Base + (BandIdx * BandSize);
+                char** BandOptions = NULL;
+                char PointerStr[64] = {0};
+                CPLPrintPointer(PointerStr, BandPtr, sizeof(PointerStr));
+                BandOptions = CSLSetNameValue(BandOptions, "DATAPOINTER", PointerStr);
+                BandOptions = CSLSetNameValue(BandOptions, "PIXELOFFSET",
+                                              CPLSPrintf("%d", (int)DTypeSize));
+                BandOptions = CSLSetNameValue(BandOptions, "LINEOFFSET",
+                                              CPLSPrintf("%d", (int)(DTypeSize * Cut.XSize)));
+                GDALAddBand(DstDS, Cut.DType, BandOptions);
+                CSLDestroy(BandOptions);
+            }
+            
+            Result = WriteCut(&Cut, DstDS, Options);
+            GDALClose(DstDS);
+            
+            if (Result) Dst->WriteCur = Info->BufferSize;
+        }
+    }
+    
+    CloseCut(&Cut);
+    return Result;
+}
+
+external bool
+RasterCutStats(cut_stats* Stats, int NumStats, char** SrcRasterList, int NumSrcRasters,
+               cut_ring* CutRings, int NumRings, cut_options* Options)
+{
+    cut_options DefaultOptions = {0};
+    if (!Options) Options = &DefaultOptions;
+    
+    re_cut Cut = {0};
+    if (!PrepareCut(&Cut, SrcRasterList, NumSrcRasters, CutRings, NumRings, Options))
+    {
+        return false;
+    }
+    
+    InitStats(Stats, NumStats, Cut.Src.DS);
+    bool Result = BlendCut(&Cut, NULL, Stats, NumStats, Options);
+    for (int BandIdx = 0; BandIdx < NumStats; BandIdx++)
+    {
+        cut_stats* Band = &Stats[BandIdx];
+        if (Band->Count > 0)
+        {
+            Band->Mean = Band->Sum / Band->Count;
+        }
+        else
+        {
+            Band->Min = 0;
+            Band->Max = 0;
+        }
+    }
+    
+    CloseCut(&Cut);
+    return Result;
 }
\ No newline at end of file
@@ -3,26 +3,183 @@
 // raster-cut.h
 //
 // Module for mosaicking and cutting rasters into a single output raster.
-// Given a list of rasters and a single polygon (without holes), the
-// resulting image is all the pixels in the original image within the
-// area of the polygon.
+// Given a list of rasters and a polygon, the resulting image is all the
+// pixels in the original image within the area of the polygon.
+//
+// The polygon is passed as an array of cut_ring, and may have holes and
+// multiple parts. Each outer ring starts a new part, and the inner rings
+// that follow it are the holes of that part, the same order used by the
+// poly_info of raster-outline.h (A-outer -> A-inner -> B-outer -> ...).
+// All parts are cut in a single pass over the source rasters.
 //=========================================================================
 #define RASTER_CUT_H
 
 #include "gdal.h"
 #include "gdal_priv.h"
 
+#include "tinybase-memory.h"
 #include "geotypes-base.h"
 
+enum cut_compression
+{
+    CutCompress_LZW,     // Default.
+    CutCompress_None,
+    CutCompress_Deflate,
+    CutCompress_ZSTD
+};
+
+enum cut_blend
+{
+    CutBlend_LastValid,  // Default. Later sources in the list cover earlier ones.
+    CutBlend_FirstValid, // Earlier sources in the list cover later ones.
+    CutBlend_MostRecent, // Newest acquisition date covers older ones.
+    CutBlend_MinCloud,   // Lowest cloud cover covers higher ones.
+    CutBlend_Feather     // Overlaps are averaged, weighted by distance to each source edge.
+};
+
+enum cut_resampling
+{
+    CutResample_Nearest, // Default.
+    CutResample_Average,
+    CutResample_Bilinear
+};
+
+struct cut_options
+{
+    char* Driver;                // GDAL driver short name. "GTiff" if NULL.
+    cut_compression Compression;
+    int Predictor;               // 1: None, 2: Horizontal, 3: Floating point. 0: default.
+    int Level;                   // Deflate or ZSTD compression level. 0: default.
+    int TileSize;                // Side of square tiles in pixels. 0: striped layout.
+    int NumThreads;              // Threads used for compression. 0: single, -1: all CPUs.
+    bool BigTiff;                // Forces BigTIFF output, for files larger than 4 GB.
+    bool CloudOptimized;         // Writes a Cloud-Optimized GeoTIFF (requires GDAL 3.1).
+    char** CreateOptions;        // Extra NAME=VALUE creation options, passed as-is.
+    char* CutSRS;                // SRS of the cut polygon. NULL: same as the output.
+    char* DstSRS;                // SRS of the output. NULL: same as the first source.
+    cut_blend Blend;             // How overlapping sources are composited.
+    int FeatherWidth;            // Pixels over which CutBlend_Feather fades. 0: 16.
+    char* PriorityKey;           // Metadata item read for MostRecent and MinCloud.
+    bool Coverage;               // Adds an alpha band with the fraction of each pixel in the cut.
+    double PixelSize;            // Output pixel size in output SRS units. 0: source size.
+    int OutXSize;                // Output width in pixels, overrides [.PixelSize]. 0: unused.
+    cut_resampling Resampling;   // Used when the output and source pixels differ.
+    int NumOverviews;            // Overview levels (2x, 4x, 8x...) written with the output.
+    cut_resampling OverviewResampling; // Nearest, or average (also used for bilinear).
+};
+
+struct cut_ring
+{
+    v2* Vertices;
+    int NumPoints;
+    int Type;                    // 0: Outer, 1: Inner.
+};
+
+#define CUT_HISTOGRAM_BINS 256
+
+struct cut_stats
+{
+    double Count;                // Pixels in the cut, or their area inside it with coverage.
+    double Sum;
+    double Min, Max;
+    double Mean;
+    double HistMin, HistMax;     // Histogram range, read from the source if not set.
+    double Histogram[CUT_HISTOGRAM_BINS];
+};
+
+struct cut_info
+{
+    int XSize, YSize;
+    int NumBands;
+    GDALDataType DType;
+    double Affine[6];
+    usz BufferSize;              // Bytes needed to hold all bands of the cut.
+};
+
 external GDALDatasetH RasterCut(char* DstRaster, char** SrcRasterList, int NumSrcRasters,
-                                v2* CutPolygon, int NumPoints);
-
-/* Creates output polygon given a [SrcRasterList] and a [CutPolygon]. The number
-|  of rasters in the list and number of vertices in the polygon are passed in
-|  [NumSrcRasters] and [NumPoints], respectively. [DstRaster] must be a path
- |  in the filesystem with the output filename. Currently only accepts output
-|  files in TIFF format.
-|--- Return: GDAL Dataset containing the created raster.*/
+                                cut_ring* CutRings, int NumRings, cut_options* Options);
+
+/* Creates output raster given a [SrcRasterList] and a cut polygon made of
+|  [CutRings]. The number of rasters in the list and number of rings in the
+|  polygon are passed in [NumSrcRasters] and [NumRings], respectively.
+ |  [DstRaster] must be a path in the filesystem with the output filename, or
+|  NULL, in which case the raster is created with the MEM driver and never
+|  touches the disk.
+|  
+|  Rings may come in any order: each inner ring is a hole of the innermost outer
+|  ring around it. A polygon without outer rings over the sources is an error.
+|  
+|  [Options] controls the format of the output file, and can be NULL, in which
+|  case a striped GeoTIFF with LZW compression is created. The compression,
+|  predictor, tiling, BigTIFF and thread fields are only used by the GTiff
+ |  driver (and the COG driver, when [.CloudOptimized] is set); other drivers
+|  only receive [.CreateOptions]. Cloud-Optimized output is tiled by default,
+ |  and is assembled in memory before being copied to [DstRaster].
+|  
+|  [.CutSRS] and [.DstSRS] take anything GDAL understands as an SRS (EPSG:4326,
+|  WKT, PROJ strings), and the polygon and sources are reprojected on the fly
+|  when they differ from the output. Sources in a different SRS than the first
+|  one are warped to it before mosaicking. Reprojection transformers are cached
+|  across calls, see ClearCutTransformCache().
+|  
+|  Overlapping sources are composited following [.Blend]. With any mode but the
+|  default, each source is warped on its own and composited block by block in
+|  the pass that writes the output. MostRecent and MinCloud read [.PriorityKey]
+|  from the metadata of each source or, if NULL, common names for acquisition
+|  date and cloud cover (MostRecent falls back to the file modification time).
+|  
+|  With [.Coverage], an alpha band is added after the source bands with the
+|  exact area of each pixel inside the polygon, from 0 to the largest value of
+|  integer types (255 for Byte, 65535 for UInt16, and so on) or 1 (floating
+|  point). Every pixel touched by the polygon is then kept, instead of only the
+|  ones with their centre inside.
+|  
+|  [.PixelSize] or [.OutXSize] make the output coarser than the sources (the
+|  height follows the aspect of the cut). Pixels are then read from the
+|  closest overview of each source that is still as fine as the output, and
+|  resampled with [.Resampling].
+|  
+|  [.NumOverviews] levels of overviews are added to the output, each one half
+|  the size of the previous. They are computed in memory from every block of
+|  the output as it is written, so the output is never read back.
+|--- Return: GDAL Dataset containing the created raster, NULL if not successful.*/
+
+external bool RasterCutToBuffer(buffer* Dst, cut_info* Info, char** SrcRasterList,
+                                int NumSrcRasters, cut_ring* CutRings, int NumRings,
+                                cut_options* Options);
+
+/* Same as RasterCut(), but writes the pixels directly into [Dst] memory, which
+|  must be allocated by the caller, instead of creating a dataset. Bands are laid
+|  out one after the other, each one [.XSize] by [.YSize] pixels of [.DType],
+ |  with no padding. Pixels outside the polygon are set to the NoData value of
+|  the source (or zero). [Info] is always filled with the cut dimensions and
+ |  geotransform, so if [Dst] is too small, the call can be repeated with a
+|  buffer of [Info.BufferSize] bytes. With [.Coverage], the alpha band is the
+|  last one. The format and overview fields of [Options] are not used, and it
+|  can be NULL.
+|--- Return: true if the cut was written to [Dst], false if not. */
+
+external bool RasterCutStats(cut_stats* Stats, int NumStats, char** SrcRasterList,
+                             int NumSrcRasters, cut_ring* CutRings, int NumRings,
+                             cut_options* Options);
+
+/* Same as RasterCut(), but instead of creating a raster, the pixels inside the
+|  polygon are streamed into per-band statistics, one [Stats] for each of the
+|  first [NumStats] bands. NoData pixels are skipped. If [.HistMin] and
+|  [.HistMax] are left equal, Byte bands use 0-255 and other types the
+|  approximate range of the source; values outside it are not in the histogram.
+|  With [.Coverage] in [Options], pixels touched by the polygon are weighted by
+|  their area inside it, otherwise only the ones with their centre inside count.
+|  The format fields of [Options] are not used, and it can be NULL.
+|--- Return: true if successful, false if not. */
+
+external void ClearCutTransformCache();
+
+/* Destroys the reprojection transformers cached by RasterCut() and
+|  RasterCutToBuffer() on the calling thread, except the ones held by a cut in
+|  progress. Each thread has its own cache, so threads running cuts that
+|  reproject should call this before exiting.
+|--- Return: nothing. */
 
 
 #if !defined(RASTER_EDITING_STATIC_LINKING)
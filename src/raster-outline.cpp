@@ -1,13 +1,12 @@
 #include "tinybase-platform.h"
 #include "raster-outline-testblock.cpp"
 
+#include <math.h>
+
 //================================
 // Structs and defines
 //================================
 
-#define EDGE_DATA_START_SIZE Kilobyte(64)
-#define RING_DATA_START_SIZE Kilobyte(64)
-
 #define Assert(Exp) { if (!(Exp)) *(int*)0 = 0; }
 
 struct edge
@@ -43,7 +42,7 @@ struct edge_info
     double ValueB;
     u32 DTypeSize;
     
-    buffer EdgeMem;
+    grow_arena EdgeMem;
     u32 EdgeCount;
     u32 VertexCount;
     edge* EdgeList;
@@ -52,7 +51,7 @@ struct edge_info
     ~edge_info()
     {
         FreeMemory(&LineSweepMem);
-        FreeMemory(&EdgeMem);
+        FreeGrowArena(&EdgeMem);
     }
 };
 
@@ -193,81 +192,78 @@ SetBleedLine(u8* Line, int Width, double Target, GDALDataType DType)
     }
 }
 
+internal bool
+PushEdge(edge_info* Info, edge_type Type, int Row, int Col)
+{
+    // OBS: The edge list is reserved for the worst case up front, so it grows in
+    // place and [Info->EdgeList] never moves.
+    edge* NewEdge = PushGrowStruct(&Info->EdgeMem, edge);
+    if (!NewEdge)
+    {
+        return false;
+    }
+    Info->EdgeCount++;
+    *NewEdge = { Type, Row, Col, 0, 0, false };
+    
+    // Updates the above and below edge pointers. When BottomLeft or BottomRight,
+    // we simply save the new idx. When TopLeft or TopRight, we update the edge
+    // pointer at by the ColTable to show that the edge below is the NewEdge, and
+    // the NewEdge to show that the above is the previous one at ColTable. This
+    // way we can navigate the edge list in any direction. When it's type Cross
+    // it behaves like both a Top and Bottom, so it will update the edges first
+    // and then update the ColTable with itself.
+    
+    u32 NewEdgeIdx = Info->EdgeCount-1;
+    switch (Type)
+    {
+        case EdgeType_BottomLeft:
+        case EdgeType_BottomRight:
+        {
+            Info->ColTable[Col] = NewEdgeIdx;
+            Info->VertexCount++;
+        } break;
+        
+        case EdgeType_TopLeft:
+        case EdgeType_TopRight:
+        {
+            u32 AboveEdgeIdx = Info->ColTable[Col];
+            edge* AboveEdge = &Info->EdgeList[AboveEdgeIdx];
+            NewEdge->Above = AboveEdgeIdx;
+            AboveEdge->Below = NewEdgeIdx;
+            Info->VertexCount++;
+        } break;
+        
+        case EdgeType_Cross:
+        {
+            u32 AboveEdgeIdx = Info->ColTable[Col];
+            edge* AboveEdge = &Info->EdgeList[AboveEdgeIdx];
+            NewEdge->Above = AboveEdgeIdx;
+            AboveEdge->Below = NewEdgeIdx;
+            NewEdge->TimesChecked = -1;
+            
+            Info->ColTable[Col] = NewEdgeIdx;
+            Info->VertexCount += 2; // Crosses count twice.
+        } break;
+        
+        case EdgeType_None: break;
+    }
+    
+    return true;
+}
+
 internal bool
 ProcessSweepLine(edge_info* Info, int Row)
 {
-    buffer* Mem = &Info->EdgeMem;
     u8* FirstLine = Info->FirstLine;
     u8* SecondLine = Info->SecondLine;
     
-    for (int Col = 0; Col < Info->InspectWidth-1; Col++)
+    for (int Col = 0; Col < (int)Info->InspectWidth-1; Col++)
     {
         edge_type Type = Info->TestBlock(FirstLine, SecondLine, Info->InspectWidth,
                                          Info->BandCount, Info->ValueA, Info->ValueB);
-        if (Type != EdgeType_None)
+        if (Type != EdgeType_None && !PushEdge(Info, Type, Row, Col))
         {
-            Info->EdgeCount++;
-            u32 RequiredSize = Info->EdgeCount * sizeof(edge);
-            if (Mem->Size < RequiredSize)
-            {
-                usz NewAllocSize = Max(Mem->Size * 2, RequiredSize);
-                buffer NewAlloc = GetMemory(NewAllocSize, 0, MEM_WRITE);
-                if (!NewAlloc.Base)
-                {
-                    return false;
-                }
-                CopyData(NewAlloc.Base, NewAlloc.Size, Mem->Base, Mem->WriteCur);
-                NewAlloc.WriteCur = Mem->WriteCur;
-                FreeMemory(Mem);
-                
-                *Mem = NewAlloc;
-                Info->EdgeList = (edge*)NewAlloc.Base;
-                Info->EdgeMem = NewAlloc;
-            }
-            
-            edge* NewEdge = PushSize(Mem, sizeof(edge), edge);
-            *NewEdge = { Type, Row, Col, 0, 0, false };
-            
-            // Updates the above and below edge pointers. When BottomLeft or BottomRight,
-            // we simply save the new idx. When TopLeft or TopRight, we update the edge
-            // pointer at by the ColTable to show that the edge below is the NewEdge, and
-            // the NewEdge to show that the above is the previous one at ColTable. This
-            // way we can navigate the edge list in any direction. When it's type Cross
-            // it behaves like both a Top and Bottom, so it will update the edges first
-            // and then update the ColTable with itself.
-            
-            u32 NewEdgeIdx = Info->EdgeCount-1;
-            switch (Type)
-            {
-                case EdgeType_BottomLeft:
-                case EdgeType_BottomRight:
-                {
-                    Info->ColTable[Col] = NewEdgeIdx;
-                    Info->VertexCount++;
-                } break;
-                
-                case EdgeType_TopLeft:
-                case EdgeType_TopRight:
-                {
-                    u32 AboveEdgeIdx = Info->ColTable[Col];
-                    edge* AboveEdge = &Info->EdgeList[AboveEdgeIdx];
-                    NewEdge->Above = AboveEdgeIdx;
-                    AboveEdge->Below = NewEdgeIdx;
-                    Info->VertexCount++;
-                } break;
-                
-                case EdgeType_Cross:
-                {
-                    u32 AboveEdgeIdx = Info->ColTable[Col];
-                    edge* AboveEdge = &Info->EdgeList[AboveEdgeIdx];
-                    NewEdge->Above = AboveEdgeIdx;
-                    AboveEdge->Below = NewEdgeIdx;
-                    NewEdge->TimesChecked = -1;
-                    
-                    Info->ColTable[Col] = NewEdgeIdx;
-                    Info->VertexCount += 2; // Crosses count twice.
-                } break;
-            }
+            return false;
         }
         FirstLine += Info->DTypeSize;
         SecondLine += Info->DTypeSize;
@@ -276,11 +272,66 @@ ProcessSweepLine(edge_info* Info, int Row)
     return true;
 }
 
-internal void
-WriteVertex(buffer* PolyRings, double* Affine, edge* Edge, bbox2* BBox)
+internal bool
+ProcessPixelLine(edge_info* Info, int Row, u8* Top, u8* Bottom)
+{
+    // Same as ProcessSweepLine() for a single band, but [Top] and [Bottom] are rows of
+    // the raster itself, without the bleed columns. Only the first and last blocks hold
+    // a bleed pixel, so they are put together in [Block], and the rest is tested in place.
+    // OBS: TestBlock() only follows its stride argument to reach the next band, so with a
+    // single band it's never used; each call passes the width of the line it tests.
+    
+    usz DTypeSize = Info->DTypeSize;
+    int Width = Info->InspectWidth - 2;
+    u8* Bleed = Info->FirstLine; // Bleed line, every pixel is the bleed value.
+    
+    f64 BlockMem[4];
+    u8* Block = (u8*)BlockMem;
+    CopyData(Block, DTypeSize, Bleed, DTypeSize);
+    CopyData(Block + DTypeSize, DTypeSize, Top, DTypeSize);
+    CopyData(Block + DTypeSize*2, DTypeSize, Bleed, DTypeSize);
+    CopyData(Block + DTypeSize*3, DTypeSize, Bottom, DTypeSize);
+    
+    edge_type Type = Info->TestBlock(Block, Block + DTypeSize*2, 4, 1,
+                                     Info->ValueA, Info->ValueB);
+    if (Type != EdgeType_None && !PushEdge(Info, Type, Row, 0))
+    {
+        return false;
+    }
+    
+    for (int Col = 1; Col < Width; Col++)
+    {
+        Type = Info->TestBlock(Top, Bottom, Width, 1, Info->ValueA, Info->ValueB);
+        if (Type != EdgeType_None && !PushEdge(Info, Type, Row, Col))
+        {
+            return false;
+        }
+        Top += DTypeSize;
+        Bottom += DTypeSize;
+    }
+    
+    CopyData(Block, DTypeSize, Top, DTypeSize);
+    CopyData(Block + DTypeSize, DTypeSize, Bleed, DTypeSize);
+    CopyData(Block + DTypeSize*2, DTypeSize, Bottom, DTypeSize);
+    CopyData(Block + DTypeSize*3, DTypeSize, Bleed, DTypeSize);
+    
+    Type = Info->TestBlock(Block, Block + DTypeSize*2, 4, 1, Info->ValueA, Info->ValueB);
+    if (Type != EdgeType_None && !PushEdge(Info, Type, Row, Width))
+    {
+        return false;
+    }
+    
+    return true;
+}
+
+internal bool
+WriteVertex(grow_arena* PolyRings, double* Affine, edge* Edge, bbox2* BBox)
 {
-    v2* Vertex = PushStruct(PolyRings, v2);
-    if (!Vertex) Assert(0);
+    v2* Vertex = PushGrowStruct(PolyRings, v2);
+    if (!Vertex)
+    {
+        return false;
+    }
     
     f64 X = Affine[0] + Affine[1] * Edge->Col;
     f64 Y = Affine[3] + Affine[5] * Edge->Row;
@@ -290,6 +341,7 @@ WriteVertex(buffer* PolyRings, double* Affine, edge* Edge, bbox2* BBox)
     BBox->Min.Y = Min(Y, BBox->Min.Y);
     BBox->Max.X = Max(X, BBox->Max.X);
     BBox->Max.Y = Max(Y, BBox->Max.Y);
+    return true;
 }
 
 internal ring_info*
@@ -361,140 +413,60 @@ IsRingInsideRing(ring_info* A, ring_info* B)
     return false;
 }
 
-external poly_info
-RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
-                int BandCount, int* BandIdx)
+internal bool
+TraceOutline(poly_info* Result, edge_info* Info, double* Affine)
 {
-    poly_info Poly = {0}, EmptyPoly = {0};
-    
-    GDALRasterBandH Band = GDALGetRasterBand(DS, 1);
-    GDALDataType DType = GDALGetRasterDataType(Band);
-    int Width = GDALGetRasterXSize(DS);
-    int Height = GDALGetRasterYSize(DS);
-    int Bands = GDALGetRasterCount(DS);
-    double Affine[6];
-    GDALGetGeoTransform(DS, Affine);
-    
-    u32 InspectWidth = Width + 2;   // Two extra columns to protect from overflow.
-    u32 InspectHeight = Height + 2; // Two extra rows to protect from overflow.
-    
-    double BleedValue = GetBleedValue(ValueA, ValueB, TestType, DType);
-    if (BleedValue == INF64)
-    {
-        // Failure to get the bleed value means all pixels would be selected. and
-        // getting the BBox amounts to the same thing.
-        
-        buffer BBox = GetMemory(BBOX_BUFFER_SIZE, 0, MEM_WRITE);
-        if (BBox.Base)
-        {
-            Poly = BBoxOutline(DS, BBox.Base);
-        }
-        return Poly;
-    }
-    
-    //========================
-    // Prepare memory arenas.
-    //========================
-    
-    usz DTypeSize = GetDTypeSize(DType);
-    usz ColTableSize = Width * sizeof(u32);
-    usz LineSize = InspectWidth * DTypeSize;
-    usz LoadPixelsSize = LineSize * 2 * BandCount; // x2 because we load two rows.
-    buffer LineSweepMem = GetMemory(LoadPixelsSize + ColTableSize, 0, MEM_WRITE);
-    buffer EdgeMem = GetMemory(EDGE_DATA_START_SIZE, 0, MEM_WRITE);
-    if (!LineSweepMem.Base || !EdgeMem.Base)
-    {
-        return EmptyPoly;
-    }
-    u32 AllBandsLineSize = LineSize * BandCount;
-    
-    edge_info Info = {0};
-    Info.LineSweepMem = LineSweepMem;
-    Info.FirstLine = LineSweepMem.Base;
-    Info.SecondLine = Info.FirstLine + AllBandsLineSize;
-    Info.ColTable = (u32*)(Info.SecondLine + AllBandsLineSize);
-    Info.InspectWidth = InspectWidth;
-    Info.BandCount = BandCount;
-    Info.TestBlock = GetTestBlockCallback(DType, TestType);
-    Info.ValueA = ValueA;
-    Info.ValueB = ValueB;
-    Info.DTypeSize = DTypeSize;
-    Info.EdgeMem = EdgeMem;
-    Info.EdgeList = PushStruct(&Info.EdgeMem, edge); // Inits list with stub [idx 0].
-    Info.EdgeCount++;
-    
-    //=========================
-    // Get edges line by line.
-    //=========================
-    
-    u8* LineReadPtr = Info.SecondLine + DTypeSize;
-    SetBleedLine(Info.FirstLine, InspectWidth * BandCount, BleedValue, DType);
-    CopyData(Info.SecondLine, AllBandsLineSize, Info.FirstLine, AllBandsLineSize);
-    for (int Row = 0; Row < Height; Row++)
-    {
-        GDALDatasetRasterIO(DS, GF_Read, 0, Row, Width, 1, LineReadPtr, Width, 1, DType,
-                            BandCount, BandIdx, 0, LineSize, 0);
-        if (!ProcessSweepLine(&Info, Row)) return EmptyPoly;
-        
-        // This turn's second line is next turn's first line, copy to avoid re-reading.
-        CopyData(Info.FirstLine, AllBandsLineSize, Info.SecondLine, AllBandsLineSize);
-    }
-    
-    // Do the last line.
-    SetBleedLine(Info.SecondLine, InspectWidth * BandCount, BleedValue, DType);
-    if (!ProcessSweepLine(&Info, Height)) return EmptyPoly;
+    // OBS: [Result] is left empty when no pixel was selected, which is not a failure.
+    poly_info Poly = {0};
     
-    if (Info.EdgeCount == 1) // No occurances found.
+    if (Info->EdgeCount == 1) // No occurances found.
     {
-        return EmptyPoly;
+        return true;
     }
     
     //========================================
     // Go through edges saving them as rings.
     //========================================
     
-    usz RingDataSize = RING_DATA_START_SIZE;
-    usz PolyDataSize = Align(RingDataSize + (Info.VertexCount * sizeof(v2)),
-                             gSysInfo.PageSize);
-    buffer PolyRings = GetMemory(PolyDataSize, 0, MEM_WRITE);
+    // OBS: Every ring has at least 4 vertices, plus the repeated one that closes it.
+    usz MaxRings = Info->VertexCount / 4 + 1;
+    usz MaxRingsSize = (Info->VertexCount * sizeof(v2)) + (MaxRings * (RING_SIZE + sizeof(v2)));
+    grow_arena PolyRings = ReserveGrowArena(MaxRingsSize, MEM_WRITE);
     if (!PolyRings.Base)
     {
-        return EmptyPoly;
+        return false;
     }
     Poly.Rings = (ring_info*)PolyRings.Base;
+    Poly.BBox = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+    
+    // OBS: rings are always traced clockwise in pixel space, the affine
+    // transform flips that when the X and Y pixel sizes have opposite signs.
+    Poly.Clockwise = (Affine[1] * Affine[5]) < 0;
     
-    edge* FirstEdge = &Info.EdgeList[1];
-    edge* EndOfEdgeList = &Info.EdgeList[Info.EdgeCount];
+    edge* FirstEdge = &Info->EdgeList[1];
+    edge* EndOfEdgeList = &Info->EdgeList[Info->EdgeCount];
     while (FirstEdge < EndOfEdgeList)
     {
-        usz NumVerticesLeft = Info.VertexCount - Poly.NumVertices;
-        usz RequiredRingSize = RING_SIZE + (NumVerticesLeft * sizeof(v2));
-        if (RequiredRingSize > (PolyRings.Size - PolyRings.WriteCur))
+        // OBS: Pages of the arena are committed as it grows, which can still fail when
+        // the system runs out of memory; the outline fails then, instead of the process.
+        ring_info* Ring = PushGrowStruct(&PolyRings, ring_info);
+        if (!Ring)
         {
-            RingDataSize += RING_DATA_START_SIZE;
-            usz NewSize = Align(RingDataSize + (Info.VertexCount * sizeof(v2)),
-                                gSysInfo.PageSize);
-            buffer NewMem = GetMemory(NewSize, 0, MEM_WRITE);
-            if (!NewMem.Base)
-            {
-                return EmptyPoly;
-            }
-            CopyData(NewMem.Base, NewMem.Size, PolyRings.Base, PolyRings.WriteCur);
-            NewMem.WriteCur = PolyRings.WriteCur;
-            FreeMemory(&PolyRings);
-            PolyRings = NewMem;
+            FreeGrowArena(&PolyRings);
+            return false;
         }
         
-        ring_info* Ring = PushStruct(&PolyRings, ring_info);
-        if (!Ring) Assert(0);
-        
         bbox2 BBox = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
         edge* Edge = FirstEdge;
         line_dir Dir = LineDir_Right; // Going clockwise always starts to the right.
         
         do
         {
-            WriteVertex(&PolyRings, Affine, Edge, &BBox);
+            if (!WriteVertex(&PolyRings, Affine, Edge, &BBox))
+            {
+                FreeGrowArena(&PolyRings);
+                return false;
+            }
             Edge->TimesChecked++;
             
             switch (Dir)
@@ -519,7 +491,7 @@ RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
                 
                 case LineDir_Down:
                 {
-                    Edge = &Info.EdgeList[Edge->Below];
+                    Edge = &Info->EdgeList[Edge->Below];
                     if (Edge->Type == EdgeType_TopLeft) Dir = LineDir_Left;
                     else if (Edge->Type == EdgeType_TopRight) Dir = LineDir_Right;
                     else if (Edge->Type == EdgeType_Cross) Dir = LineDir_Left;
@@ -528,7 +500,7 @@ RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
                 
                 case LineDir_Up:
                 {
-                    Edge = &Info.EdgeList[Edge->Above];
+                    Edge = &Info->EdgeList[Edge->Above];
                     if (Edge->Type == EdgeType_BottomLeft) Dir = LineDir_Left;
                     else if (Edge->Type == EdgeType_BottomRight) Dir = LineDir_Right;
                     else if (Edge->Type == EdgeType_Cross) Dir = LineDir_Right;
@@ -538,17 +510,27 @@ RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
         } while (Edge != FirstEdge);
         
         // Repeat the first edge to close the polygon.
-        WriteVertex(&PolyRings, Affine, Edge, &BBox);
-        Info.VertexCount++;
+        if (!WriteVertex(&PolyRings, Affine, Edge, &BBox))
+        {
+            FreeGrowArena(&PolyRings);
+            return false;
+        }
+        Info->VertexCount++;
         
         Ring->NumVertices = (v2*)&PolyRings.Base[PolyRings.WriteCur] - Ring->Vertices;
         Poly.NumVertices += Ring->NumVertices;
         Poly.NumRings++;
         
-        tree_node* Node = PushStruct(&PolyRings, tree_node);
-        if (!Node) Assert(0);
+        tree_node* Node = PushGrowStruct(&PolyRings, tree_node);
+        if (!Node)
+        {
+            FreeGrowArena(&PolyRings);
+            return false;
+        }
         
         Node->BBoxArea = (BBox.Max.X - BBox.Min.X) * (BBox.Max.Y - BBox.Min.Y);
+        Ring->BBox = BBox;
+        Poly.BBox = Merge(Poly.BBox, BBox);
         Node->RingOffset = (usz)Node - (usz)Ring;
         
         while (FirstEdge < EndOfEdgeList)
@@ -561,7 +543,7 @@ RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
         }
     }
     
-    Poly.Rings = (ring_info*)PolyRings.Base; // Updates in case resizing was necessary.
+    Poly.Mem = Buffer(PolyRings.Base, PolyRings.WriteCur, PolyRings.Reserved);
     
     //================================
     // Order polygons by outer/inner.
@@ -632,11 +614,354 @@ RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
         Node = GetNextTreeNode(Node);
     }
     
+    *Result = Poly;
+    return true;
+}
+
+internal bool
+SweepOutline(poly_info* Result, raster_source* Source, f64 ValueA, f64 ValueB,
+             test_type TestType, int BandCount, int* BandIdx)
+{
+    // OBS: Same as SourceToOutline(), but tells failures apart from finding nothing.
+    
+    GDALDataType DType = Source->DType;
+    int Width = Source->Width;
+    int Height = Source->Height;
+    double* Affine = Source->Affine;
+    
+    u32 InspectWidth = Width + 2;   // Two extra columns to protect from overflow.
+    u32 InspectHeight = Height + 2; // Two extra rows to protect from overflow.
+    
+    double BleedValue = GetBleedValue(ValueA, ValueB, TestType, DType);
+    if (BleedValue == INF64)
+    {
+        // Failure to get the bleed value means all pixels would be selected. and
+        // getting the BBox amounts to the same thing.
+        
+        buffer BBox = GetMemory(BBOX_BUFFER_SIZE, 0, MEM_WRITE);
+        if (!BBox.Base)
+        {
+            return false;
+        }
+        *Result = SourceBBoxOutline(Source, BBox.Base);
+        Result->Mem = BBox;
+        return true;
+    }
+    
+    //========================
+    // Prepare memory arenas.
+    //========================
+    
+    usz DTypeSize = GetDTypeSize(DType);
+    usz ColTableSize = Width * sizeof(u32);
+    usz LineSize = InspectWidth * DTypeSize;
+    usz LoadPixelsSize = LineSize * 2 * BandCount; // x2 because we load two rows.
+    // OBS: The edge list grows to many GB on big rasters, and is walked in random order
+    // while tracing, so it (and very wide lines) asks for huge pages to cut TLB misses.
+    // Every pixel corner can hold at most one edge, plus the stub edge at [idx 0].
+    usz MaxEdgesSize = ((usz)InspectWidth * InspectHeight + 1) * sizeof(edge);
+    MaxEdgesSize = Min(MaxEdgesSize, (usz)U32_MAX * sizeof(edge));
+    // The line buffers are only touched by the thread running the sweep, so they are
+    // bound to its NUMA node; outlines run from several threads each stay local.
+    buffer LineSweepMem = GetMemoryOnNode(LoadPixelsSize + ColTableSize, NODE_LOCAL,
+                                          MEM_WRITE|MEM_HUGEPAGE);
+    grow_arena EdgeMem = ReserveGrowArena(MaxEdgesSize, MEM_WRITE|MEM_HUGEPAGE);
+    if (!LineSweepMem.Base || !EdgeMem.Base)
+    {
+        if (LineSweepMem.Base) FreeMemory(&LineSweepMem);
+        if (EdgeMem.Base) FreeGrowArena(&EdgeMem);
+        return false;
+    }
+    u32 AllBandsLineSize = LineSize * BandCount;
+    
+    edge_info Info = {0};
+    Info.LineSweepMem = LineSweepMem;
+    Info.FirstLine = LineSweepMem.Base;
+    Info.SecondLine = Info.FirstLine + AllBandsLineSize;
+    Info.ColTable = (u32*)(Info.SecondLine + AllBandsLineSize);
+    Info.InspectWidth = InspectWidth;
+    Info.BandCount = BandCount;
+    Info.TestBlock = GetTestBlockCallback(DType, TestType);
+    Info.ValueA = ValueA;
+    Info.ValueB = ValueB;
+    Info.DTypeSize = DTypeSize;
+    Info.EdgeMem = EdgeMem;
+    Info.EdgeList = PushGrowStruct(&Info.EdgeMem, edge); // Inits list with stub [idx 0].
+    if (!Info.EdgeList)
+    {
+        return false;
+    }
+    Info.EdgeCount++;
+    
+    //=========================
+    // Get edges line by line.
+    //=========================
+    
+    SetBleedLine(Info.FirstLine, InspectWidth * BandCount, BleedValue, DType);
+    if (Source->Pixels && BandCount == 1)
+    {
+        // OBS: A single band already in memory is swept where it is, so no rows are
+        // copied and the cost is only the tests. [FirstLine] stays the bleed line.
+        int Band = (BandIdx) ? BandIdx[0] : 1;
+        if (Band < 1 || Band > Source->BandCount)
+        {
+            return false;
+        }
+        u8* Pixels = Source->Pixels + (Band-1) * Source->PixelBandStride;
+        
+        u8* Top = Info.FirstLine + DTypeSize;
+        for (int Row = 0; Row <= Height; Row++)
+        {
+            u8* Bottom = (Row < Height) ? Pixels + Row * Source->PixelRowStride
+                                        : Info.FirstLine + DTypeSize;
+            if (!ProcessPixelLine(&Info, Row, Top, Bottom)) return false;
+            Top = Bottom;
+        }
+    }
+    else
+    {
+        u8* LineReadPtr = Info.SecondLine + DTypeSize;
+        CopyData(Info.SecondLine, AllBandsLineSize, Info.FirstLine, AllBandsLineSize);
+        for (int Row = 0; Row < Height; Row++)
+        {
+            if (!ReadSourceRows(Source, Row, 1, BandCount, BandIdx, LineReadPtr,
+                                AllBandsLineSize, LineSize))
+            {
+                return false;
+            }
+            if (!ProcessSweepLine(&Info, Row)) return false;
+            
+            // This turn's second line is next turn's first line, copy to avoid re-reading.
+            CopyData(Info.FirstLine, AllBandsLineSize, Info.SecondLine, AllBandsLineSize);
+        }
+        
+        // Do the last line.
+        SetBleedLine(Info.SecondLine, InspectWidth * BandCount, BleedValue, DType);
+        if (!ProcessSweepLine(&Info, Height)) return false;
+    }
+    
+    bool Traced = TraceOutline(Result, &Info, Affine);
+    return Traced;
+}
+
+external poly_info
+SourceToOutline(raster_source* Source, f64 ValueA, f64 ValueB, test_type TestType,
+                int BandCount, int* BandIdx)
+{
+    poly_info Poly = {0};
+    SweepOutline(&Poly, Source, ValueA, ValueB, TestType, BandCount, BandIdx);
     return Poly;
 }
 
 external poly_info
-BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer)
+RasterToOutline(GDALDatasetH DS, f64 ValueA, f64 ValueB, test_type TestType,
+                int BandCount, int* BandIdx)
+{
+    raster_source Source = GdalRasterSource(DS);
+    poly_info Poly = SourceToOutline(&Source, ValueA, ValueB, TestType, BandCount, BandIdx);
+    CloseRasterSource(&Source);
+    return Poly;
+}
+
+external poly_info
+BufferToOutline(void* Pixels, isz RowStride, int Width, int Height, GDALDataType DType,
+                double* Affine, f64 ValueA, f64 ValueB, test_type TestType)
+{
+    poly_info Poly = {0};
+    if (GetDTypeSize(DType) == 0)
+    {
+        return Poly;
+    }
+    
+    raster_source Source = MemoryRasterSource(Pixels, Width, Height, 1, DType,
+                                              RowStride, 0, Affine);
+    if (Source.Pixels)
+    {
+        Poly = SourceToOutline(&Source, ValueA, ValueB, TestType, 1, NULL);
+    }
+    return Poly;
+}
+
+internal bbox2
+GetPixelBBox(bbox2 BBox, double* Affine)
+{
+    // OBS: Vertices lie on pixel corners, so rounding only drops the float error.
+    f64 X0 = round((BBox.Min.X - Affine[0]) / Affine[1]);
+    f64 X1 = round((BBox.Max.X - Affine[0]) / Affine[1]);
+    f64 Y0 = round((BBox.Min.Y - Affine[3]) / Affine[5]);
+    f64 Y1 = round((BBox.Max.Y - Affine[3]) / Affine[5]);
+    bbox2 Result = BBox2(Min(X0, X1), Min(Y0, Y1), Max(X0, X1), Max(Y0, Y1));
+    return Result;
+}
+
+internal void
+AppendRing(poly_info* Poly, u8** WritePtr, ring_info** LastRing, ring_info* Ring)
+{
+    usz RingSize = sizeof(ring_info) + Ring->NumVertices * sizeof(v2);
+    ring_info* NewRing = (ring_info*)*WritePtr;
+    CopyData(NewRing, RingSize, Ring, RingSize);
+    NewRing->Next = NULL;
+    *WritePtr += RingSize;
+    
+    if (*LastRing) (*LastRing)->Next = NewRing;
+    else Poly->Rings = NewRing;
+    *LastRing = NewRing;
+    
+    Poly->NumRings++;
+    Poly->NumVertices += NewRing->NumVertices;
+    Poly->BBox = Merge(Poly->BBox, NewRing->BBox);
+}
+
+external bool
+UpdateOutline(poly_info* Result, poly_info Prev, raster_source* Source, pixel_rect* Dirty,
+              int NumDirty, f64 ValueA, f64 ValueB, test_type TestType, int BandCount,
+              int* BandIdx)
+{
+    poly_info Poly = {0}, EmptyPoly = {0};
+    double* Affine = Source->Affine;
+    *Result = EmptyPoly;
+    
+    if (GetBleedValue(ValueA, ValueB, TestType, Source->DType) == INF64
+        || Affine[2] != 0 || Affine[4] != 0)
+    {
+        // Every pixel is selected, the outline is the raster BBox whatever changed.
+        // OBS: Polygons are matched to pixels by their BBox, which a rotated geotransform
+        // doesn't map to a pixel rectangle, so those rasters are swept whole too.
+        bool Swept = SweepOutline(Result, Source, ValueA, ValueB, TestType,
+                                  BandCount, BandIdx);
+        return Swept;
+    }
+    
+    //================================================
+    // Grow the dirty window over the touched rings.
+    //================================================
+    
+    bbox2 Raster = BBox2(0, 0, Source->Width, Source->Height);
+    bbox2 Window = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+    for (int Idx = 0; Idx < NumDirty; Idx++)
+    {
+        pixel_rect Rect = Dirty[Idx];
+        bbox2 RectBBox = BBox2(Max(Rect.X, 0), Max(Rect.Y, 0),
+                               Min(Rect.X + Rect.Width, Source->Width),
+                               Min(Rect.Y + Rect.Height, Source->Height));
+        if (RectBBox.Min.X < RectBBox.Max.X && RectBBox.Min.Y < RectBBox.Max.Y)
+        {
+            Window = Merge(Window, RectBBox);
+        }
+    }
+    
+    // OBS: A polygon in the new outline that touches a changed pixel can only extend
+    // over pixels of old polygons that touched the window, so the window takes in those
+    // until none is left touching it. Nothing crossing its border is then selected, and
+    // sweeping just the window gives whole polygons to replace the ones it took in.
+    // Polygons are tested by the BBox of their outer ring, which covers their inner
+    // rings and any polygon inside of those.
+    
+    buffer GroupMem = {0};
+    bbox2* GroupBBoxes = NULL;
+    bool* Redo = NULL;
+    if (Prev.NumRings)
+    {
+        GroupMem = GetMemory(Prev.NumRings * (sizeof(bbox2) + sizeof(bool)), 0, MEM_WRITE);
+        if (!GroupMem.Base)
+        {
+            return false;
+        }
+        GroupBBoxes = (bbox2*)GroupMem.Base;
+        Redo = (bool*)(GroupBBoxes + Prev.NumRings);
+    }
+    
+    u32 NumGroups = 0;
+    for (ring_info* Ring = Prev.Rings; Ring; Ring = Ring->Next)
+    {
+        if (Ring->Type == 0)
+        {
+            GroupBBoxes[NumGroups++] = GetPixelBBox(Ring->BBox, Affine);
+        }
+    }
+    
+    for (bool Grown = true; Grown;)
+    {
+        Grown = false;
+        for (u32 Group = 0; Group < NumGroups; Group++)
+        {
+            if (!Redo[Group] && Intersects(GroupBBoxes[Group], Window))
+            {
+                Redo[Group] = true;
+                Window = Merge(Window, GroupBBoxes[Group]);
+                Grown = true;
+            }
+        }
+    }
+    
+    //==========================================
+    // Sweep the window and patch the outline.
+    //==========================================
+    
+    poly_info WindowPoly = {0};
+    bool Success = true;
+    if (Intersects(Window, Raster))
+    {
+        raster_source WindowSource = WindowRasterSource(Source, (int)Window.Min.X,
+                                                        (int)Window.Min.Y,
+                                                        (int)(Window.Max.X - Window.Min.X),
+                                                        (int)(Window.Max.Y - Window.Min.Y));
+        Success = (WindowSource.ReadRows
+                   && SweepOutline(&WindowPoly, &WindowSource, ValueA, ValueB, TestType,
+                                   BandCount, BandIdx));
+        CloseRasterSource(&WindowSource);
+    }
+    
+    usz PolySize = 0;
+    int Group = -1;
+    for (ring_info* Ring = (Success) ? Prev.Rings : NULL; Ring; Ring = Ring->Next)
+    {
+        // OBS: Rings before the first outer one have no group, and are kept.
+        if (Ring->Type == 0) Group++;
+        if (Group < 0 || !Redo[Group]) PolySize += sizeof(ring_info) + Ring->NumVertices * sizeof(v2);
+    }
+    for (ring_info* Ring = WindowPoly.Rings; Ring; Ring = Ring->Next)
+    {
+        PolySize += sizeof(ring_info) + Ring->NumVertices * sizeof(v2);
+    }
+    
+    buffer PolyMem = {0};
+    if (Success && PolySize)
+    {
+        PolyMem = GetMemory(PolySize, 0, MEM_WRITE);
+        Success = (PolyMem.Base != NULL);
+    }
+    if (PolyMem.Base)
+    {
+        Poly.BBox = BBox2(DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX);
+        Poly.Clockwise = (Affine[1] * Affine[5]) < 0;
+        
+        u8* WritePtr = PolyMem.Base;
+        ring_info* LastRing = NULL;
+        Group = -1;
+        for (ring_info* Ring = Prev.Rings; Ring; Ring = Ring->Next)
+        {
+            if (Ring->Type == 0) Group++;
+            if (Group < 0 || !Redo[Group]) AppendRing(&Poly, &WritePtr, &LastRing, Ring);
+        }
+        for (ring_info* Ring = WindowPoly.Rings; Ring; Ring = Ring->Next)
+        {
+            AppendRing(&Poly, &WritePtr, &LastRing, Ring);
+        }
+        Poly.Mem = Buffer(PolyMem.Base, PolySize, PolyMem.Size);
+        *Result = Poly;
+    }
+    
+    FreePolyInfo(WindowPoly);
+    if (GroupMem.Base)
+    {
+        FreeMemory(&GroupMem);
+    }
+    return Success;
+}
+
+external poly_info
+SourceBBoxOutline(raster_source* Source, u8* BBoxBuffer)
 {
     poly_info Poly = {0};
     
@@ -644,10 +969,9 @@ BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer)
     Poly.NumVertices = 5;
     Poly.NumRings = 1;
     
-    int Width = GDALGetRasterXSize(DS);
-    int Height = GDALGetRasterYSize(DS);
-    double Affine[6];
-    GDALGetGeoTransform(DS, Affine);
+    int Width = Source->Width;
+    int Height = Source->Height;
+    double* Affine = Source->Affine;
     
     usz PolyDataSize = BBOX_BUFFER_SIZE;
     Poly.Rings = (ring_info*)BBoxBuffer;
@@ -657,17 +981,39 @@ BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer)
     Poly.Rings->Vertices[2] = V2(Affine[0] + (Width * Affine[1]),
                                  Affine[3] + (Height * Affine[5]));
     Poly.Rings->Vertices[3] = V2(Affine[0], Affine[3] + (Height * Affine[5]));
+    Poly.BBox = BBox2(Min(Poly.Rings->Vertices[0].X, Poly.Rings->Vertices[2].X),
+                      Min(Poly.Rings->Vertices[0].Y, Poly.Rings->Vertices[2].Y),
+                      Max(Poly.Rings->Vertices[0].X, Poly.Rings->Vertices[2].X),
+                      Max(Poly.Rings->Vertices[0].Y, Poly.Rings->Vertices[2].Y));
+    Poly.Rings->BBox = Poly.BBox;
+    Poly.Clockwise = (Affine[1] * Affine[5]) < 0;
+    
+    return Poly;
+}
+
+external poly_info
+BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer)
+{
+    // OBS: Only the size and geotransform are needed, so no pixels are opened.
+    raster_source Source = {0};
+    Source.Width = GDALGetRasterXSize(DS);
+    Source.Height = GDALGetRasterYSize(DS);
+    if (GDALGetGeoTransform(DS, Source.Affine) != CE_None)
+    {
+        // OBS: Same pixel coordinates GdalRasterSource() falls back to.
+        double Identity[6] = { 0, 1, 0, 0, 0, 1 };
+        CopyData(Source.Affine, sizeof(Source.Affine), Identity, sizeof(Identity));
+    }
     
+    poly_info Poly = SourceBBoxOutline(&Source, BBoxBuffer);
     return Poly;
 }
 
 external void
 FreePolyInfo(poly_info Poly)
 {
-    usz GeomSize = sizeof(v2) * Poly.NumVertices;
-    buffer Rings = { (u8*)Poly.Rings, GeomSize, GeomSize };
-    Rings.WriteCur += RING_SIZE * Poly.NumRings;
-    Rings.Size += Align(RING_SIZE * Poly.NumRings, RING_DATA_START_SIZE);
-    FreeMemory(&Rings);
-    
-}
\ No newline at end of file
+    if (Poly.Mem.Base)
+    {
+        FreeMemory(&Poly.Mem);
+    }
+}
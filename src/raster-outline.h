@@ -22,6 +22,20 @@
 // to see if the ring is outer or inner. The read ends when [Next] returns
 // a NULL pointer.
 //
+// The bounding box of each ring, and of all of them, is tracked while
+// tracing and returned in the [BBox] members. Every ring is traced with
+// the same winding, reported in [Clockwise] (in map coordinates), so
+// serializers can orient outer and inner rings without inspecting the
+// vertices again.
+//
+// Pixels are read through a raster_source (see raster-source.h), so the
+// outline can be made from a GDAL dataset, from pixels already in memory
+// or from a custom source; the GDALDatasetH versions of the functions
+// just wrap a GDAL source. A single band in memory is swept in place, and
+// BufferToOutline() takes such a buffer directly. When only parts of a
+// raster change, UpdateOutline() patches a previous outline by sweeping
+// just the area around the changes.
+//
 // Alternatively the BBoxOutline() function can be used to extract the
 // polygon outline of the entire image area. Memory is not allocated by
 // the internals, but instead expected to be passed by the application,
@@ -31,7 +45,9 @@
 #define RASTER_OUTLINE_H
 
 #include "gdal.h"
+#include "tinybase-memory.h"
 #include "geotypes-base.h"
+#include "raster-source.h"
 
 #define BBOX_BUFFER_SIZE (sizeof(ring_info) + sizeof(v2) * 5)
 
@@ -52,14 +68,26 @@ struct ring_info
     
     u32 Type; // 0: Outer, 1: Inner
     u32 NumVertices; // Number of vertices in this ring alone.
+    bbox2 BBox;
     v2 Vertices[0];
 };
 
+struct pixel_rect
+{
+    int X;      // First column.
+    int Y;      // First row.
+    int Width;
+    int Height;
+};
+
 struct poly_info
 {
     u32 NumVertices; // Total number of vertices in all rings.
     u32 NumRings;    // Total number of rings (outer and inner).
     ring_info* Rings;
+    bbox2 BBox;      // Bounding box of all rings.
+    bool Clockwise;  // Winding of every ring, outer and inner alike.
+    buffer Mem;      // Memory holding the rings, released by FreePolyInfo().
 };
 
 external poly_info RasterToOutline(GDALDatasetH DS, double ValueA, double ValueB,
@@ -78,6 +106,45 @@ external poly_info RasterToOutline(GDALDatasetH DS, double ValueA, double ValueB
  |  raster bands.
 |--- Return: poly_info object with all the outlines, or empty if failure.*/
 
+external poly_info SourceToOutline(raster_source* Source, double ValueA, double ValueB,
+                                   test_type TestType, int BandCount, int* BandIdx);
+
+/* Same as RasterToOutline(), reading the pixels from [Source] instead, e.g. a
+ |  MemoryRasterSource() over pixels that are already in memory.
+|--- Return: poly_info object with all the outlines, or empty if failure.*/
+
+external poly_info BufferToOutline(void* Pixels, isz RowStride, int Width, int Height,
+                                   GDALDataType DType, double* Affine, double ValueA,
+                                   double ValueB, test_type TestType);
+
+/* Same as RasterToOutline(), for a single band of [Width] x [Height] pixels of type
+ |  [DType] at [Pixels], with [RowStride] bytes between rows (negative for bottom-up
+ |  images). [Affine] is the geotransform, or NULL for pixel coordinates. The pixels
+ |  are tested where they are, without copying any row, so the cost per call is only
+ |  the sweep and tracing, e.g. for outlining every frame of a live raster.
+|--- Return: poly_info object with all the outlines, or empty if failure.*/
+
+external bool UpdateOutline(poly_info* Result, poly_info Prev, raster_source* Source,
+                           pixel_rect* Dirty, int NumDirty, double ValueA, double ValueB,
+                           test_type TestType, int BandCount, int* BandIdx);
+
+/* Writes to [Result] the update of [Prev], the outline of [Source] before some of its
+ |  pixels changed, given the [NumDirty] rectangles in [Dirty] that hold all the changed
+ |  pixels. Only the smallest window holding the rectangles and every polygon of [Prev]
+ |  touching them is swept again, so the pixels read follow the size of the change and
+ |  of the polygons around it, not of the raster. The rest still follows the size of
+ |  [Prev]: polygons away from the window are copied from it as they are, followed by
+ |  the ones traced in the window, and every pass that grows the window tests all of
+ |  them, with as many passes as polygons chained one into the next across the window
+ |  (quadratic in the worst case).
+ |  
+ |  [Prev] must come from this module, for a raster of the same size and geotransform,
+ |  with the same test and bands passed here. It is not changed, and still has to be
+ |  released with FreePolyInfo(), as does [Result]. On failure [Result] is left empty,
+ |  which is otherwise a valid outline with no polygons. Rasters with a rotated
+ |  geotransform are always swept whole.
+|--- Return: true if successful, false if not. */
+
 external poly_info BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer);
 
 /* Creates outline of image boundary of raster [DS] in memory [BBoxBuffer].
@@ -85,6 +152,11 @@ external poly_info BBoxOutline(GDALDatasetH DS, u8* BBoxBuffer);
 |  and writing permission (it can be just an array on the stack).
 |--- Return: poly_info object with image boundary outline. */
 
+external poly_info SourceBBoxOutline(raster_source* Source, u8* BBoxBuffer);
+
+/* Same as BBoxOutline(), for the raster of [Source].
+|--- Return: poly_info object with image boundary outline. */
+
 external void FreePolyInfo(poly_info Poly);
 
 /* Use after calling RasterToOutline() to free the memory allocated in
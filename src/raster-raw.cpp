@@ -0,0 +1,394 @@
+#include "tinybase-platform.h"
+#include "cpl_string.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+internal bool
+_MapRawFile(raw_raster* Raw, const char* Filename)
+{
+    // OBS: GDAL filenames are UTF-8, while files are opened with the path encoding of
+    // the system, so on Windows it's transcoded to UTF-16 first.
+#if defined(TT_WINDOWS)
+    u8 PathMem[MAX_PATH_SIZE] = {0};
+    path FilePath = Path(PathMem);
+    if (!Transcode(StringC((void*)Filename, EC_UTF8), &FilePath))
+    {
+        return false;
+    }
+    file File = OpenFileHandle(FilePath.Base, READ_SHARE);
+#else
+    file File = OpenFileHandle((void*)Filename, READ_SHARE);
+#endif
+    if (File == INVALID_FILE)
+    {
+        return false;
+    }
+    
+    Raw->File = MapFileToMemory(File, MEM_READ);
+    CloseFileHandle(File);
+    return (Raw->File.Base != NULL);
+}
+
+internal bool
+_AllocBlockOffsets(raw_raster* Raw, int NumOffsets)
+{
+    Raw->Mem = GetMemory(NumOffsets * sizeof(usz), 0, MEM_READ|MEM_WRITE);
+    Raw->BlockOffsets = (usz*)Raw->Mem.Base;
+    return (Raw->Mem.Base != NULL);
+}
+
+internal bool
+_CheckRawBlocks(raw_raster* Raw)
+{
+    // OBS: Edge tiles are stored padded to the full tile, but the last strip only holds
+    // the rows left, so the extent of each block is checked against the file.
+    int NumOffsets = (Raw->BandBlocks) ? Raw->NumBlocks * Raw->BandCount : Raw->NumBlocks;
+    for (int Idx = 0; Idx < NumOffsets; Idx++)
+    {
+        int BlockRow = (Idx % Raw->NumBlocks) / Raw->BlocksPerRow;
+        usz Rows = Min(Raw->BlockHeight, Raw->Height - BlockRow * Raw->BlockHeight);
+        usz Extent = (Rows-1) * Raw->RowStride + Raw->BlockWidth * Raw->PixelStride;
+        if (Raw->BlockOffsets[Idx] == 0 || Raw->BlockOffsets[Idx] + Extent > Raw->File.Size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+internal bool
+_OpenRawTiff(raw_raster* Raw, GDALDatasetH DS)
+{
+    GDALRasterBandH Band = GDALGetRasterBand(DS, 1);
+    const char* Compression = GDALGetMetadataItem(DS, "COMPRESSION", "IMAGE_STRUCTURE");
+    const char* NBits = GDALGetMetadataItem(Band, "NBITS", "IMAGE_STRUCTURE");
+    const char* Interleave = GDALGetMetadataItem(DS, "INTERLEAVE", "IMAGE_STRUCTURE");
+    if ((Compression && !EQUAL(Compression, "NONE")) || NBits)
+    {
+        return false;
+    }
+    
+    if (!_MapRawFile(Raw, GDALGetDescription(DS)) || Raw->File.Size < 8)
+    {
+        return false;
+    }
+    Raw->SwapBytes = (Raw->File.Base[0] == 'M'); // OBS: "MM" is big-endian, "II" little.
+    
+    GDALGetBlockSize(Band, &Raw->BlockWidth, &Raw->BlockHeight);
+    if (Raw->BlockWidth <= 0 || Raw->BlockHeight <= 0)
+    {
+        return false;
+    }
+    Raw->BlocksPerRow = (Raw->Width + Raw->BlockWidth - 1) / Raw->BlockWidth;
+    Raw->NumBlocks = Raw->BlocksPerRow * ((Raw->Height + Raw->BlockHeight - 1) / Raw->BlockHeight);
+    
+    Raw->BandBlocks = (Raw->BandCount > 1 && Interleave && EQUAL(Interleave, "BAND"));
+    if (Raw->BandBlocks)
+    {
+        Raw->PixelStride = Raw->DTypeSize;
+        Raw->BandStride = 0;
+    }
+    else
+    {
+        Raw->PixelStride = Raw->DTypeSize * Raw->BandCount;
+        Raw->BandStride = Raw->DTypeSize;
+    }
+    Raw->RowStride = Raw->PixelStride * Raw->BlockWidth;
+    
+    // OBS: GDAL exposes where each strip or tile starts through the TIFF metadata
+    // domain, so offsets are looked up once here instead of parsing the IFDs again.
+    int NumOffsetBands = (Raw->BandBlocks) ? Raw->BandCount : 1;
+    if (!_AllocBlockOffsets(Raw, Raw->NumBlocks * NumOffsetBands))
+    {
+        return false;
+    }
+    
+    char Key[64];
+    for (int BandNum = 0; BandNum < NumOffsetBands; BandNum++)
+    {
+        GDALRasterBandH OffsetBand = GDALGetRasterBand(DS, BandNum+1);
+        for (int Idx = 0; Idx < Raw->NumBlocks; Idx++)
+        {
+            snprintf(Key, sizeof(Key), "BLOCK_OFFSET_%d_%d",
+                     Idx % Raw->BlocksPerRow, Idx / Raw->BlocksPerRow);
+            const char* Offset = GDALGetMetadataItem(OffsetBand, Key, "TIFF");
+            if (!Offset) return false; // Sparse block, or an older GDAL.
+            Raw->BlockOffsets[BandNum * Raw->NumBlocks + Idx] = strtoull(Offset, NULL, 10);
+        }
+    }
+    
+    return _CheckRawBlocks(Raw);
+}
+
+internal bool
+_EnviValue(buffer Header, const char* Key, char* Dst, usz DstSize)
+{
+    usz KeyLen = strlen(Key);
+    char* Line = (char*)Header.Base;
+    char* End = (char*)Header.Base + Header.WriteCur;
+    while (Line < End)
+    {
+        char* LineEnd = Line;
+        while (LineEnd < End && *LineEnd != '\n') LineEnd++;
+        
+        char* Ptr = Line;
+        while (Ptr < LineEnd && (*Ptr == ' ' || *Ptr == '\t')) Ptr++;
+        if ((usz)(LineEnd - Ptr) > KeyLen && EQUALN(Ptr, Key, KeyLen))
+        {
+            Ptr += KeyLen;
+            while (Ptr < LineEnd && (*Ptr == ' ' || *Ptr == '\t')) Ptr++;
+            if (Ptr < LineEnd && *Ptr == '=')
+            {
+                Ptr++;
+                while (Ptr < LineEnd && (*Ptr == ' ' || *Ptr == '\t')) Ptr++;
+                usz Len = 0;
+                while (Ptr + Len < LineEnd && Ptr[Len] != '\r' && Len+1 < DstSize) Len++;
+                CopyData(Dst, DstSize, Ptr, Len);
+                Dst[Len] = 0;
+                return true;
+            }
+        }
+        Line = LineEnd + 1;
+    }
+    return false;
+}
+
+internal bool
+_SetRawLayout(raw_raster* Raw, usz DataOffset, raw_interleave Interleave)
+{
+    // OBS: The whole band (BSQ and BIL) or image (BIP) is a single block, and the
+    // interleaving only changes the strides between pixels, rows and bands.
+    usz RowSize = Raw->DTypeSize * Raw->Width;
+    Raw->BlockWidth = Raw->Width;
+    Raw->BlockHeight = Raw->Height;
+    Raw->BlocksPerRow = 1;
+    Raw->NumBlocks = 1;
+    switch (Interleave)
+    {
+        case RawInterleave_BIP:
+        {
+            Raw->BandBlocks = false;
+            Raw->PixelStride = Raw->DTypeSize * Raw->BandCount;
+            Raw->RowStride = RowSize * Raw->BandCount;
+            Raw->BandStride = Raw->DTypeSize;
+        } break;
+        
+        case RawInterleave_BIL:
+        case RawInterleave_BSQ:
+        {
+            Raw->BandBlocks = true;
+            Raw->PixelStride = Raw->DTypeSize;
+            Raw->RowStride = (Interleave == RawInterleave_BIL) ? RowSize * Raw->BandCount : RowSize;
+            Raw->BandStride = 0;
+        } break;
+        
+        default: return false;
+    }
+    
+    int NumOffsets = (Raw->BandBlocks) ? Raw->BandCount : 1;
+    if (!_AllocBlockOffsets(Raw, NumOffsets))
+    {
+        return false;
+    }
+    usz BandOffset = (Interleave == RawInterleave_BIL) ? RowSize : RowSize * Raw->Height;
+    for (int BandNum = 0; BandNum < NumOffsets; BandNum++)
+    {
+        Raw->BlockOffsets[BandNum] = DataOffset + BandNum * BandOffset;
+    }
+    
+    // OBS: Unlike TIFF blocks, these may start at offset 0.
+    for (int Idx = 0; Idx < NumOffsets; Idx++)
+    {
+        usz Extent = (Raw->Height-1) * Raw->RowStride + Raw->Width * Raw->PixelStride;
+        if (Raw->BlockOffsets[Idx] + Extent > Raw->File.Size) return false;
+    }
+    return true;
+}
+
+internal bool
+_OpenRawEnvi(raw_raster* Raw, GDALDatasetH DS)
+{
+    // OBS: GDAL lists the .hdr header among the files of the dataset.
+    buffer Header = {0};
+    char** FileList = GDALGetFileList(DS);
+    for (int Idx = 0; FileList && FileList[Idx] && !Header.Base; Idx++)
+    {
+        usz Len = strlen(FileList[Idx]);
+        if (Len > 4 && EQUAL(FileList[Idx] + Len - 4, ".hdr"))
+        {
+            file File = OpenFileHandle(FileList[Idx], READ_SHARE);
+            if (File != INVALID_FILE)
+            {
+                Header = ReadEntireFile(File);
+                CloseFileHandle(File);
+            }
+        }
+    }
+    CSLDestroy(FileList);
+    if (!Header.Base)
+    {
+        return false;
+    }
+    
+    char Interleave[16] = "bsq", ByteOrder[16] = "0", Offset[32] = "0";
+    _EnviValue(Header, "interleave", Interleave, sizeof(Interleave));
+    _EnviValue(Header, "byte order", ByteOrder, sizeof(ByteOrder));
+    _EnviValue(Header, "header offset", Offset, sizeof(Offset));
+    FreeMemory(&Header);
+    
+    raw_interleave Layout = RawInterleave_BSQ;
+    if (EQUAL(Interleave, "bil")) Layout = RawInterleave_BIL;
+    else if (EQUAL(Interleave, "bip")) Layout = RawInterleave_BIP;
+    else if (!EQUAL(Interleave, "bsq")) return false;
+    
+    if (!_MapRawFile(Raw, GDALGetDescription(DS)))
+    {
+        return false;
+    }
+    Raw->SwapBytes = (atoi(ByteOrder) == 1);
+    return _SetRawLayout(Raw, strtoull(Offset, NULL, 10), Layout);
+}
+
+external raw_raster
+OpenRawRaster(GDALDatasetH DS)
+{
+    raw_raster Result = {0};
+    GDALDriverH Driver = GDALGetDatasetDriver(DS);
+    const char* DriverName = (Driver) ? GDALGetDriverShortName(Driver) : NULL;
+    if (!DriverName || GDALGetRasterCount(DS) < 1)
+    {
+        return Result;
+    }
+    
+    Result.Width = GDALGetRasterXSize(DS);
+    Result.Height = GDALGetRasterYSize(DS);
+    Result.BandCount = GDALGetRasterCount(DS);
+    Result.DType = GDALGetRasterDataType(GDALGetRasterBand(DS, 1));
+    Result.DTypeSize = GDALGetDataTypeSizeBytes(Result.DType);
+    for (int BandNum = 2; BandNum <= Result.BandCount; BandNum++)
+    {
+        if (GDALGetRasterDataType(GDALGetRasterBand(DS, BandNum)) != Result.DType)
+        {
+            return Result;
+        }
+    }
+    
+    bool Opened = false;
+    if (Result.DTypeSize > 0 && Result.Width > 0 && Result.Height > 0)
+    {
+        if (EQUAL(DriverName, "GTiff")) Opened = _OpenRawTiff(&Result, DS);
+        else if (EQUAL(DriverName, "ENVI")) Opened = _OpenRawEnvi(&Result, DS);
+    }
+    
+    if (!Opened)
+    {
+        CloseRawRaster(&Result);
+    }
+    return Result;
+}
+
+external raw_raster
+MapRawRaster(void* Filename, int Width, int Height, int BandCount, GDALDataType DType,
+             usz DataOffset, raw_interleave Interleave, bool BigEndian)
+{
+    raw_raster Result = {0};
+    Result.Width = Width;
+    Result.Height = Height;
+    Result.BandCount = BandCount;
+    Result.DType = DType;
+    Result.DTypeSize = GDALGetDataTypeSizeBytes(DType);
+    Result.SwapBytes = BigEndian; // OBS: Hosts supported are all little-endian.
+    
+    if (Width <= 0 || Height <= 0 || BandCount <= 0 || Result.DTypeSize == 0
+        || !_MapRawFile(&Result, (const char*)Filename)
+        || !_SetRawLayout(&Result, DataOffset, Interleave))
+    {
+        CloseRawRaster(&Result);
+    }
+    return Result;
+}
+
+internal void
+_SwapRawBytes(u8* Data, usz Count, usz WordSize)
+{
+    for (usz Idx = 0; Idx < Count; Idx++, Data += WordSize)
+    {
+        for (usz Lo = 0, Hi = WordSize-1; Lo < Hi; Lo++, Hi--)
+        {
+            u8 Tmp = Data[Lo];
+            Data[Lo] = Data[Hi];
+            Data[Hi] = Tmp;
+        }
+    }
+}
+
+external bool
+ReadRawRow(raw_raster* Raw, int Row, int Col, int NumCols, int BandCount, int* BandIdx,
+           u8* Dst, usz BandSpace)
+{
+    if (!Raw->File.Base || Row < 0 || Row >= Raw->Height
+        || Col < 0 || NumCols <= 0 || Col + NumCols > Raw->Width)
+    {
+        return false;
+    }
+    
+    int BlockRow = Row / Raw->BlockHeight;
+    usz RowInBlock = (usz)(Row % Raw->BlockHeight) * Raw->RowStride;
+    int FirstBlockCol = Col / Raw->BlockWidth;
+    int LastBlockCol = (Col + NumCols - 1) / Raw->BlockWidth;
+    for (int Idx = 0; Idx < BandCount; Idx++)
+    {
+        int Band = (BandIdx) ? BandIdx[Idx] - 1 : Idx;
+        if (Band < 0 || Band >= Raw->BandCount) return false;
+        
+        u8* BandDst = Dst + Idx * BandSpace;
+        usz* Offsets = Raw->BlockOffsets + BlockRow * Raw->BlocksPerRow;
+        usz BandInPixel = Band * Raw->BandStride;
+        if (Raw->BandBlocks) Offsets += Band * Raw->NumBlocks;
+        
+        for (int BlockCol = FirstBlockCol; BlockCol <= LastBlockCol; BlockCol++)
+        {
+            // OBS: Only the part of the block inside the span, which can start or end
+            // in the middle of the first and last blocks.
+            int BlockStart = BlockCol * Raw->BlockWidth;
+            int Start = Max(BlockStart, Col);
+            int End = Min(BlockStart + Raw->BlockWidth, Col + NumCols);
+            usz Count = End - Start;
+            u8* Src = (Raw->File.Base + Offsets[BlockCol] + RowInBlock + BandInPixel
+                       + (Start - BlockStart) * Raw->PixelStride);
+            u8* Out = BandDst + (Start - Col) * Raw->DTypeSize;
+            
+            // OBS: Planar rows are copied in one go; interleaved ones are gathered.
+            if (Raw->PixelStride == Raw->DTypeSize)
+            {
+                CopyData(Out, Count * Raw->DTypeSize, Src, Count * Raw->DTypeSize);
+            }
+            else
+            {
+                for (usz Px = 0; Px < Count; Px++, Src += Raw->PixelStride, Out += Raw->DTypeSize)
+                {
+                    CopyData(Out, Raw->DTypeSize, Src, Raw->DTypeSize);
+                }
+            }
+        }
+        
+        if (Raw->SwapBytes && Raw->DTypeSize > 1)
+        {
+            // OBS: Complex values are swapped as two separate words, real and imaginary.
+            usz Words = (GDALDataTypeIsComplex(Raw->DType)) ? 2 : 1;
+            _SwapRawBytes(BandDst, (usz)NumCols * Words, Raw->DTypeSize / Words);
+        }
+    }
+    
+    return true;
+}
+
+external void
+CloseRawRaster(raw_raster* Raw)
+{
+    if (Raw->File.Base) UnmapFileFromMemory(&Raw->File);
+    if (Raw->Mem.Base) FreeMemory(&Raw->Mem);
+    buffer RawBuffer = Buffer(Raw, sizeof(raw_raster), sizeof(raw_raster));
+    ClearMemory(&RawBuffer);
+}
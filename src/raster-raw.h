@@ -0,0 +1,91 @@
+#ifndef RASTER_RAW_H
+//=========================================================================
+// raster-raw.h
+//
+// Module for reading the pixels of uncompressed rasters straight from
+// their files, without going through GDAL's RasterIO and block cache.
+// Supported layouts are uncompressed GeoTIFF, stripped or tiled, with
+// pixel or band interleaving, and ENVI in BSQ, BIL or BIP order.
+//
+// The dataset is still opened with GDAL, which provides the size, type
+// and layout; OpenRawRaster() then resolves the file offset of every
+// strip or tile once, and maps the file into memory. Rows are copied
+// from the mapping with ReadRawRow(), in the same layout a call to
+// GDALDatasetRasterIO() would give.
+//
+// Datasets in any other format, or with compression, sparse blocks,
+// sub-byte or mixed pixel types, or not backed by a local file, can't be
+// read this way and OpenRawRaster() returns an empty raw_raster, so
+// callers can fall back to GDAL. Headerless files of a known layout can
+// also be mapped without GDAL with MapRawRaster().
+//=========================================================================
+#define RASTER_RAW_H
+
+#include "gdal.h"
+#include "tinybase-memory.h"
+
+enum raw_interleave
+{
+    RawInterleave_BSQ, // Band after band.
+    RawInterleave_BIL, // Row of each band, row after row.
+    RawInterleave_BIP  // All bands of each pixel, pixel after pixel.
+};
+
+struct raw_raster
+{
+    buffer File;        // Read-only mapping of the whole pixel file.
+    int Width;
+    int Height;
+    int BandCount;
+    GDALDataType DType;
+    usz DTypeSize;
+    bool SwapBytes;     // File byte order is not the host's.
+
+    int BlockWidth;     // Strips and ENVI blocks span whole rows.
+    int BlockHeight;
+    int BlocksPerRow;
+    int NumBlocks;      // Blocks of a single band.
+    bool BandBlocks;    // Each band has blocks of its own (planar layouts).
+    usz PixelStride;    // Bytes between two pixels of a row.
+    usz RowStride;      // Bytes between two rows of a block.
+    usz BandStride;     // Bytes between two bands of a pixel, if not [BandBlocks].
+    usz* BlockOffsets;  // Per block, and per band first if [BandBlocks].
+    buffer Mem;
+};
+
+external raw_raster OpenRawRaster(GDALDatasetH DS);
+
+/* Checks if the pixels of [DS] are stored in one of the supported uncompressed
+ |  layouts, and if so maps its file and resolves the offsets of its blocks. The
+ |  file is read as it is on disk, so writes to [DS] not yet flushed are not seen.
+ |--- Return: raw_raster of the dataset if supported, or empty if not. */
+
+external raw_raster MapRawRaster(void* Filename, int Width, int Height, int BandCount,
+                                 GDALDataType DType, usz DataOffset,
+                                 raw_interleave Interleave, bool BigEndian);
+
+/* Maps a headerless raster file at [Filename], for when the layout is already known
+ |  and GDAL isn't needed to open it: [BandCount] bands of [Width] x [Height] pixels
+ |  of type [DType], starting [DataOffset] bytes into the file, in [Interleave] order.
+ |--- Return: raw_raster of the file if successful, or empty if not. */
+
+external bool ReadRawRow(raw_raster* Raw, int Row, int Col, int NumCols, int BandCount,
+                         int* BandIdx, u8* Dst, usz BandSpace);
+
+/* Copies [NumCols] pixels from [Col] of [Row] of [BandCount] bands into [Dst], with
+ |  pixels packed and each band [BandSpace] bytes after the previous, fixing the byte
+ |  order if needed. [BandIdx] lists 1-based band numbers, or is NULL for the first
+ |  [BandCount] bands.
+ |--- Return: true if successful, false if not. */
+
+external void CloseRawRaster(raw_raster* Raw);
+
+/* Unmaps the file of [Raw] and frees its memory. Can be called on an empty one.
+ |--- Return: nothing. */
+
+
+#if !defined(RASTER_EDITING_STATIC_LINKING)
+#include "raster-raw.cpp"
+#endif
+
+#endif //RASTER_RAW_H
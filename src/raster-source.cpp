@@ -0,0 +1,208 @@
+#include "tinybase-platform.h"
+
+internal void
+_SetSourceAffine(raster_source* Source, double* Affine)
+{
+    double Identity[6] = { 0, 1, 0, 0, 0, 1 };
+    CopyData(Source->Affine, sizeof(Source->Affine),
+             (Affine) ? Affine : Identity, sizeof(Identity));
+}
+
+internal bool
+_CheckSourceRows(raster_source* Source, int Row, int NumRows, int BandCount, int* BandIdx)
+{
+    if (Row < 0 || NumRows <= 0 || Row + NumRows > Source->Height || BandCount <= 0)
+    {
+        return false;
+    }
+    for (int Idx = 0; BandIdx && Idx < BandCount; Idx++)
+    {
+        if (BandIdx[Idx] < 1 || BandIdx[Idx] > Source->BandCount) return false;
+    }
+    return (BandIdx || BandCount <= Source->BandCount);
+}
+
+internal RASTER_READ_PROC(_ReadGdalRows)
+{
+    CPLErr Err = GDALDatasetRasterIO(Source->DS, GF_Read, Col, Row, NumCols, NumRows, Dst,
+                                     NumCols, NumRows, Source->DType, BandCount, BandIdx,
+                                     0, RowSpace, BandSpace);
+    return (Err == CE_None);
+}
+
+internal RASTER_READ_PROC(_ReadRawRows)
+{
+    // OBS: A row the mapping fails to serve is read with GDAL instead, when the source
+    // has a dataset behind it.
+    for (int Idx = 0; Idx < NumRows; Idx++)
+    {
+        u8* RowDst = Dst + Idx * RowSpace;
+        if (!ReadRawRow(&Source->Raw, Row + Idx, Col, NumCols, BandCount, BandIdx,
+                        RowDst, BandSpace)
+            && (!Source->DS
+                || !_ReadGdalRows(Source, Col, Row + Idx, NumCols, 1, BandCount, BandIdx,
+                                  RowDst, RowSpace, BandSpace)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+internal RASTER_READ_PROC(_ReadMemoryRows)
+{
+    usz DTypeSize = GDALGetDataTypeSizeBytes(Source->DType);
+    usz RowSize = NumCols * DTypeSize;
+    for (int Idx = 0; Idx < BandCount; Idx++)
+    {
+        int Band = (BandIdx) ? BandIdx[Idx] - 1 : Idx;
+        u8* Src = (Source->Pixels + Band * Source->PixelBandStride + Row * Source->PixelRowStride
+                   + Col * DTypeSize);
+        u8* Out = Dst + Idx * BandSpace;
+        for (int RowIdx = 0; RowIdx < NumRows; RowIdx++)
+        {
+            CopyData(Out, RowSize, Src, RowSize);
+            Src += Source->PixelRowStride;
+            Out += RowSpace;
+        }
+    }
+    return true;
+}
+
+internal RASTER_READ_PROC(_ReadWindowRows)
+{
+    // OBS: Bands and rows were checked against the window, which fits in [Parent].
+    raster_source* Parent = Source->Parent;
+    bool Result = Parent->ReadRows(Parent, Source->ParentX + Col, Source->ParentY + Row,
+                                   NumCols, NumRows, BandCount, BandIdx, Dst,
+                                   RowSpace, BandSpace);
+    return Result;
+}
+
+external raster_source
+GdalRasterSource(GDALDatasetH DS)
+{
+    raster_source Result = {0};
+    if (GDALGetRasterCount(DS) < 1)
+    {
+        return Result;
+    }
+    
+    Result.Width = GDALGetRasterXSize(DS);
+    Result.Height = GDALGetRasterYSize(DS);
+    Result.BandCount = GDALGetRasterCount(DS);
+    Result.DType = GDALGetRasterDataType(GDALGetRasterBand(DS, 1));
+    if (GDALGetGeoTransform(DS, Result.Affine) != CE_None)
+    {
+        _SetSourceAffine(&Result, NULL);
+    }
+    Result.DS = DS;
+    
+    // OBS: Uncompressed rasters are copied from the file mapping, skipping GDAL's
+    // block cache and its per-call overhead. Only for read-only datasets, as the
+    // mapping doesn't see blocks written to the cache of an updatable one.
+    if (GDALGetAccess(DS) == GA_ReadOnly)
+    {
+        Result.Raw = OpenRawRaster(DS);
+    }
+    Result.ReadRows = (Result.Raw.File.Base) ? _ReadRawRows : _ReadGdalRows;
+    return Result;
+}
+
+external raster_source
+MemoryRasterSource(void* Pixels, int Width, int Height, int BandCount, GDALDataType DType,
+                   isz RowStride, isz BandStride, double* Affine)
+{
+    raster_source Result = {0};
+    if (!Pixels || Width <= 0 || Height <= 0 || BandCount <= 0
+        || GDALGetDataTypeSizeBytes(DType) <= 0)
+    {
+        return Result;
+    }
+    
+    Result.Width = Width;
+    Result.Height = Height;
+    Result.BandCount = BandCount;
+    Result.DType = DType;
+    _SetSourceAffine(&Result, Affine);
+    Result.Pixels = (u8*)Pixels;
+    Result.PixelRowStride = RowStride;
+    Result.PixelBandStride = BandStride;
+    Result.ReadRows = _ReadMemoryRows;
+    return Result;
+}
+
+external raster_source
+RawRasterSource(raw_raster Raw, double* Affine)
+{
+    raster_source Result = {0};
+    if (!Raw.File.Base)
+    {
+        return Result;
+    }
+    
+    Result.Width = Raw.Width;
+    Result.Height = Raw.Height;
+    Result.BandCount = Raw.BandCount;
+    Result.DType = Raw.DType;
+    _SetSourceAffine(&Result, Affine);
+    Result.Raw = Raw;
+    Result.ReadRows = _ReadRawRows;
+    return Result;
+}
+
+external raster_source
+WindowRasterSource(raster_source* Parent, int X, int Y, int Width, int Height)
+{
+    raster_source Result = {0};
+    if (!Parent->ReadRows || X < 0 || Y < 0 || Width <= 0 || Height <= 0
+        || X + Width > Parent->Width || Y + Height > Parent->Height)
+    {
+        return Result;
+    }
+    
+    double* A = Parent->Affine;
+    double Affine[6] = { A[0] + X * A[1] + Y * A[2], A[1], A[2],
+                         A[3] + X * A[4] + Y * A[5], A[4], A[5] };
+    if (Parent->Pixels)
+    {
+        usz DTypeSize = GDALGetDataTypeSizeBytes(Parent->DType);
+        u8* Pixels = Parent->Pixels + Y * Parent->PixelRowStride + X * DTypeSize;
+        Result = MemoryRasterSource(Pixels, Width, Height, Parent->BandCount, Parent->DType,
+                                    Parent->PixelRowStride, Parent->PixelBandStride, Affine);
+        return Result;
+    }
+    
+    Result.Width = Width;
+    Result.Height = Height;
+    Result.BandCount = Parent->BandCount;
+    Result.DType = Parent->DType;
+    _SetSourceAffine(&Result, Affine);
+    Result.Parent = Parent;
+    Result.ParentX = X;
+    Result.ParentY = Y;
+    Result.ReadRows = _ReadWindowRows;
+    return Result;
+}
+
+external bool
+ReadSourceRows(raster_source* Source, int Row, int NumRows, int BandCount, int* BandIdx,
+               u8* Dst, usz RowSpace, usz BandSpace)
+{
+    if (!Source->ReadRows || !_CheckSourceRows(Source, Row, NumRows, BandCount, BandIdx))
+    {
+        return false;
+    }
+    
+    bool Result = Source->ReadRows(Source, 0, Row, Source->Width, NumRows, BandCount, BandIdx,
+                                   Dst, RowSpace, BandSpace);
+    return Result;
+}
+
+external void
+CloseRasterSource(raster_source* Source)
+{
+    CloseRawRaster(&Source->Raw);
+    buffer SourceBuffer = Buffer(Source, sizeof(raster_source), sizeof(raster_source));
+    ClearMemory(&SourceBuffer);
+}
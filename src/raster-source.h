@@ -0,0 +1,104 @@
+#ifndef RASTER_SOURCE_H
+//=========================================================================
+// raster-source.h
+//
+// Module for reading raster pixels through a common interface, so that
+// the raster modules don't depend on where the pixels come from. A
+// raster_source describes the size, type and geotransform of a raster,
+// and reads rows of it, or a span of columns of them, through its
+// [ReadRows] callback.
+//
+// Sources can be created for a GDAL dataset, for pixels already in
+// memory, for a raw_raster file mapping (see raster-raw.h), and for a
+// window into another source. Other sources, e.g. a tile cache, are
+// made by filling a raster_source with a callback of their own, keeping
+// whatever state it needs in [Data].
+//=========================================================================
+#define RASTER_SOURCE_H
+
+#include "gdal.h"
+#include "tinybase-memory.h"
+#include "raster-raw.h"
+
+struct raster_source;
+
+// OBS: Reads [NumCols] pixels from [Col] of each row, already checked to be inside.
+#define RASTER_READ_PROC(Name) bool Name(raster_source* Source, int Col, int Row,       \
+                                         int NumCols, int NumRows, int BandCount,       \
+                                         int* BandIdx, u8* Dst, usz RowSpace,           \
+                                         usz BandSpace)
+typedef bool (*raster_read_proc)(raster_source*, int, int, int, int, int, int*, u8*, usz, usz);
+
+struct raster_source
+{
+    int Width;
+    int Height;
+    int BandCount;
+    GDALDataType DType;  // Of all bands.
+    double Affine[6];    // Same layout as GDALGetGeoTransform().
+    raster_read_proc ReadRows;
+    void* Data;          // Free for custom sources.
+
+    // Used by the built-in sources.
+    GDALDatasetH DS;
+    raw_raster Raw;
+    u8* Pixels;
+    isz PixelRowStride;
+    isz PixelBandStride;
+    raster_source* Parent;
+    int ParentX;
+    int ParentY;
+};
+
+external raster_source GdalRasterSource(GDALDatasetH DS);
+
+/* Creates a source reading [DS]. Uncompressed GeoTIFF and ENVI datasets opened
+ |  read-only are read straight from their files with raster-raw.h, anything else
+ |  with GDAL. Rows the file mapping fails to serve are read with GDAL too.
+ |--- Return: source of [DS], or empty source if it has no bands. */
+
+external raster_source MemoryRasterSource(void* Pixels, int Width, int Height, int BandCount,
+                                          GDALDataType DType, isz RowStride, isz BandStride,
+                                          double* Affine);
+
+/* Creates a source reading [BandCount] bands of [Width] x [Height] pixels of type [DType]
+ |  at [Pixels], with pixels packed in each row, [RowStride] bytes between rows and
+ |  [BandStride] bytes between bands. [Affine] is the geotransform, or NULL for pixel
+ |  coordinates. Memory is not copied, and must outlive the source.
+ |--- Return: source of the pixels, or empty source if arguments are invalid. */
+
+external raster_source RawRasterSource(raw_raster Raw, double* Affine);
+
+/* Creates a source reading the file mapped in [Raw], which the source takes over and
+ |  closes with it. [Affine] is the geotransform, or NULL for pixel coordinates.
+ |--- Return: source of the file, or empty source if [Raw] is empty. */
+
+external raster_source WindowRasterSource(raster_source* Parent, int X, int Y,
+                                          int Width, int Height);
+
+/* Creates a source reading the [Width] x [Height] pixels of [Parent] starting at pixel
+ |  [X], [Y], with the geotransform moved to match. Windows of memory sources are memory
+ |  sources over the same pixels; others read just the columns of the window from
+ |  [Parent]. [Parent] is not copied, and must outlive the window.
+ |--- Return: source of the window, or empty source if it doesn't fit in [Parent]. */
+
+external bool ReadSourceRows(raster_source* Source, int Row, int NumRows, int BandCount,
+                             int* BandIdx, u8* Dst, usz RowSpace, usz BandSpace);
+
+/* Reads [NumRows] rows from [Row] of [BandCount] bands of [Source] into [Dst], with
+ |  pixels packed, [RowSpace] bytes between rows and [BandSpace] bytes between bands.
+ |  [BandIdx] lists 1-based band numbers, or is NULL for the first [BandCount] bands.
+ |--- Return: true if successful, false if not. */
+
+external void CloseRasterSource(raster_source* Source);
+
+/* Releases what a built-in source opened (not the GDAL dataset, the memory of a
+ |  memory source, nor the parent of a window), and zeroes out [Source].
+ |--- Return: nothing. */
+
+
+#if !defined(RASTER_EDITING_STATIC_LINKING)
+#include "raster-source.cpp"
+#endif
+
+#endif //RASTER_SOURCE_H
@@ -4,13 +4,27 @@
 #define USAGE_CODE \
 "Usage: raster-cut.exe [output_raster] [cut_polygon] [input_raster ...]\n" \
 "    > output_raster: Path where raster will be created (must be TIFF).\n" \
-"    > cut_polygon: Path to polygon used for boundary (must be SHAPEFILE).\n" \
+"    > cut_polygon: Path to polygon used for boundary (must be SHAPEFILE). All " \
+"polygons in it are used, and may have holes. If a .prj file is next to it, the " \
+"polygon is reprojected to the rasters' projection.\n" \
 "    > input_raster: List of rasters used for input, separated by a space.\n" \
 "Example: raster-cut.exe path/to/output.tif path/to/cut-poly.shp " \
 "img1.tif img2.tif img3.tif\n" \
 "Output: GeoTIFF raster with all input files mosaicked and cut to the polygon's " \
 "border.\n"
 
+internal int
+GetShpRingType(shp_part Ring)
+{
+    // Shapefile outer rings are clockwise, meaning a negative signed area.
+    f64 Area = 0;
+    for (i32 Idx = 0; Idx < Ring.NumPoints-1; Idx++)
+    {
+        Area += Cross(Ring.XY[Idx], Ring.XY[Idx+1]);
+    }
+    return (Area < 0) ? 0 : 1;
+}
+
 int main(int Argc, char** Argv)
 {
     if (Argc < 4)
@@ -23,31 +37,69 @@ int main(int Argc, char** Argv)
     path ShpPath = Path(ShpPathBuf);
     AppendStringToPath(StringC(Argv[2], EC_UTF8), &ShpPath);
     
-    shapefile Shape = OpenAndImportShp(ShpPathBuf);
-    if (Shape.Type == ShpType_Polygon
-        || Shape.Type == ShpType_PolygonM
-        || Shape.Type == ShpType_PolygonZM)
+    shapefile Shape = OpenAndMapShp(ShpPathBuf);
+    if (Shape.Type != ShpType_Polygon
+        && Shape.Type != ShpType_PolygonM
+        && Shape.Type != ShpType_PolygonZM)
+    {
+        fprintf(stderr, "Error: Geometry was not of type Polygon.\n");
+        return -1;
+    }
+    
+    // All parts of all features are cut together, as a single multipolygon.
+    
+    int NumRings = 0;
+    for (i32 FeatIdx = 0; FeatIdx < Shape.NumFeatures; FeatIdx++)
+    {
+        NumRings += GetFeature(&Shape, FeatIdx).NumParts;
+    }
+    
+    buffer RingsMem = GetMemoryFromHeap(NumRings * sizeof(cut_ring));
+    if (!RingsMem.Base)
+    {
+        fprintf(stderr, "Error: Not enough memory.\n");
+        return -1;
+    }
+    
+    cut_ring* Rings = (cut_ring*)RingsMem.Base;
+    int RingIdx = 0;
+    for (i32 FeatIdx = 0; FeatIdx < Shape.NumFeatures; FeatIdx++)
     {
-        shp_feature Feat = GetFeature(&Shape, 0);
-        if (Feat.NumParts == 1)
+        shp_feature Feat = GetFeature(&Shape, FeatIdx);
+        for (i32 PartIdx = 0; PartIdx < Feat.NumParts; PartIdx++)
         {
-            GDALAllRegister();
-            
-            shp_part Geom = GetGeometry(Feat, 0);
-            GDALDatasetH DstDS = RasterCut(Argv[1], Argv+3, Argc-3, Geom.XY, Geom.NumPoints);
-            GDALClose(DstDS);
+            shp_part Geom = GetGeometry(Feat, PartIdx);
+            Rings[RingIdx++] = { Geom.XY, Geom.NumPoints, GetShpRingType(Geom) };
         }
-        else
+    }
+    
+    // The .prj sidecar holds the polygon SRS as WKT, and GDAL can read it from
+    // the path directly.
+    
+    char PrjPath[MAX_PATH_SIZE] = {0};
+    cut_options Options = {0};
+    size_t ShpPathLen = strlen(Argv[2]);
+    if (ShpPathLen > 4 && ShpPathLen < MAX_PATH_SIZE)
+    {
+        memcpy(PrjPath, Argv[2], ShpPathLen - 4);
+        memcpy(PrjPath + ShpPathLen - 4, ".prj", 4);
+        FILE* PrjFile = fopen(PrjPath, "rb");
+        if (PrjFile)
         {
-            fprintf(stderr, "Error: Polygon must not contain any holes.\n");
-            return -1;
+            Options.CutSRS = PrjPath;
+            fclose(PrjFile);
         }
     }
-    else
+    
+    GDALAllRegister();
+    
+    GDALDatasetH DstDS = RasterCut(Argv[1], Argv+3, Argc-3, Rings, NumRings, &Options);
+    if (!DstDS)
     {
-        fprintf(stderr, "Error: Geometry was not of type Polygon.\n");
+        fprintf(stderr, "Error: RasterCut() failed.\n");
         return -1;
     }
+    GDALClose(DstDS);
     
     return 0;
 }
\ No newline at end of file
@@ -2,7 +2,7 @@
 #include "geotypes-shp.h"
 
 #define USAGE_CODE \
-"Usage: raster-outline.exe [input_raster] [operation] [value] [bands]\n" \
+"Usage: raster-outline.exe [input_raster] [operation] [value] [bands] [split]\n" \
 "    > input_raster: Path to raster from which to extract the outline.\n" \
 "    > operation: The operation to be performed. Options: 'equal', 'not_equal', " \
 "'bigger_than', 'bigger_or_equal_to', 'less_than', 'less_or_equal_to', " \
@@ -10,7 +10,9 @@
 "    > value: Pixel value of the operation. If the operation is 'between', type " \
 "two values comma-separated, ex: 406,1027.\n" \
 "    > bands: Bands to investigate the value in. Must be comma-separated, ex: " \
-"2,4,5,8.\n\n" \
+"2,4,5,8.\n" \
+"    > split (optional): Type 'split' to write each polygon (an outer ring and its " \
+"holes) as a feature of its own, which lets outputs past 2GB be split in shards.\n\n" \
 "Example: raster-outline.exe path/to/image.ecw less_than 186 2,3,5\n" \
 "Output: Shapefile with a single multipolygon feature, created at the same path as" \
 "image, containing all pixels less than 186 in bands 2, 3 and 5.\n"
@@ -25,10 +27,11 @@ struct parsed_args
     f64 ValueB;
     int* Bands;
     int BandCount;
+    bool Split;
 };
 
 internal bool
-ParseArgs(char** Argv, parsed_args* Parse)
+ParseArgs(int Argc, char** Argv, parsed_args* Parse)
 {
     GDALDatasetH DS = GDALOpen(Argv[1], GA_ReadOnly);
     if (!DS)
@@ -102,19 +105,27 @@ ParseArgs(char** Argv, parsed_args* Parse)
         }
     }
     
+    bool Split = (Argc == 6);
+    if (Split && !MemCmp(Argv[5], "split"))
+    {
+        fprintf(stderr, "Error: Last parameter must be 'split', if present.\n");
+        return false;
+    }
+    
     Parse->DS = DS;
     Parse->Type = Type;
     Parse->ValueA = ValueA;
     Parse->ValueB = ValueB;
     Parse->Bands = Bands;
     Parse->BandCount = BandCount;
+    Parse->Split = Split;
     
     return true;
 }
 
 int main(int Argc, char** Argv)
 {
-    if (Argc != 5)
+    if (Argc != 5 && Argc != 6)
     {
         fprintf(stderr, "Error: Incorrect number of parameters.\n" USAGE_CODE);
         return -1;
@@ -124,7 +135,7 @@ int main(int Argc, char** Argv)
     LoadSystemInfo();
     
     parsed_args Parse = {0};
-    if (!ParseArgs(Argv, &Parse))
+    if (!ParseArgs(Argc, Argv, &Parse))
     {
         return -1;
     }
@@ -137,54 +148,65 @@ int main(int Argc, char** Argv)
         return -1;
     }
     
-    usz OutFullSize = ((sizeof(i32) * Poly.NumRings)
-                       + (sizeof(v2) * Poly.NumVertices)
-                       + 152 + 108 + 35); // Headers for SHP, SHX and DBF.
-    buffer OutShapefile = GetMemory(OutFullSize, 0, MEM_WRITE);
-    if (!OutShapefile.Base)
+    char OutPathBuf[MAX_PATH_SIZE] = {0};
+    path OutPath = Path(OutPathBuf);
+    AppendStringToPath(String(Argv[1], strlen(Argv[1]), 0, EC_ASCII), &OutPath);
+    OutPath.WriteCur = CharInString('.', OutPath, RETURN_IDX_AFTER|SEARCH_REVERSE);
+    AppendStringToString(StringLit("shp"), &OutPath);
+    
+    shp_writer Out = OpenShpWriter(OutPath.Base, ShpType_Polygon, Megabyte(8), true);
+    if (!Out.Shape.ShpFilePtr)
     {
-        fprintf(stderr, "Error: Not enough memory.\n");
+        fprintf(stderr, "Error: Could not create output shapefile.\n");
         return -1;
     }
     
-    u8* OutShp = (u8*)OutShapefile.Base;
-    u8* OutDbf = OutShp + OutFullSize - 35;
-    u8* OutShx = OutDbf - 108;
-    
-    shapefile Out = CreatePolygon(OutShp, OutShx, OutDbf);
-    shp_feature Feat = AddFeature(&Out, Poly.NumRings, Poly.NumVertices);
+    buffer RingsMem = GetMemory(sizeof(shp_ring) * Poly.NumRings, 0, MEM_WRITE);
+    if (!RingsMem.Base)
+    {
+        fprintf(stderr, "Error: Not enough memory.\n");
+        CloseShpWriter(&Out);
+        return -1;
+    }
     
+    // OBS: The outline is a single multipolygon feature, unless split in one feature
+    // per polygon (outer ring and the inner rings that follow it), so the writer can
+    // put huge outlines in shards between them. Shapefile outer rings are clockwise
+    // and inner rings counterclockwise, while the outline has every ring with the
+    // same winding.
+    shp_ring* Rings = (shp_ring*)RingsMem.Base;
     ring_info* Ring = Poly.Rings;
-    for (u32 RingIdx = 0; RingIdx < Poly.NumRings; RingIdx++)
+    u32 RingIdx = 0;
+    while (RingIdx < Poly.NumRings)
     {
-        shp_ring_type Type = (Ring->Type == 0) ? ShpRing_Outer : ShpRing_Inner;
-        AddRing(&Feat, Type, Ring->NumVertices, Ring->Vertices, 0, 0, sizeof(v2));
-        Ring = Ring->Next;
+        bbox2 BBox = (Parse.Split) ? Ring->BBox : Poly.BBox;
+        i32 NumRings = 0;
+        do
+        {
+            Rings[NumRings].Vertices = Ring->Vertices;
+            Rings[NumRings].NumPoints = Ring->NumVertices;
+            Rings[NumRings].Reverse = (Ring->Type == 1) == Poly.Clockwise;
+            NumRings++;
+            RingIdx++;
+            Ring = Ring->Next;
+        } while (RingIdx < Poly.NumRings && (!Parse.Split || Ring->Type == 1));
+        
+        shp_feature Feat = AddStreamPolygon(&Out, NumRings, Rings, BBox);
+        if (!Feat.Shape)
+        {
+            fprintf(stderr, "Error: Could not write outline to shapefile.\n");
+            FreeMemory(&RingsMem);
+            CloseShpWriter(&Out);
+            return -1;
+        }
     }
+    FreeMemory(&RingsMem);
     
-    char OutPathBuf[MAX_PATH_SIZE] = {0};
-    path OutPath = Path(OutPathBuf);
-    AppendStringToPath(String(Argv[1], strlen(Argv[1]), 0, EC_ASCII), &OutPath);
-    
-    usz InsertIdx = OutPath.WriteCur = CharInString('.', OutPath, RETURN_IDX_AFTER|SEARCH_REVERSE);
-    AppendStringToString(StringLit("shp"), &OutPath);
-    file Shp = CreateNewFile(OutPath.Base, WRITE_SOLO|FORCE_CREATE);
-    
-    OutPath.WriteCur = InsertIdx;
-    AppendStringToString(StringLit("shx"), &OutPath);
-    file Shx = CreateNewFile(OutPath.Base, WRITE_SOLO|FORCE_CREATE);
-    
-    OutPath.WriteCur = InsertIdx;
-    AppendStringToString(StringLit("dbf"), &OutPath);
-    file Dbf = CreateNewFile(OutPath.Base, WRITE_SOLO|FORCE_CREATE);
-    
-    WriteEntireFile(Shp, Buffer(Out.ShpFilePtr, Out.ShpFileSize, 0));
-    WriteEntireFile(Shx, Buffer(Out.ShxFilePtr, Out.ShxFileSize, 0));
-    WriteEntireFile(Dbf, Buffer(Out.DbfFilePtr, Out.DbfFileSize, 0));
-    
-    CloseFileHandle(Shp);
-    CloseFileHandle(Shx);
-    CloseFileHandle(Dbf);
+    if (!CloseShpWriter(&Out))
+    {
+        fprintf(stderr, "Error: Could not write output shapefile.\n");
+        return -1;
+    }
     
     return 0;
 }
\ No newline at end of file